@@ -0,0 +1,522 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "config.h" /* FRR config.h */
+#include "lib/zebra.h"
+#include "lib/libfrr.h"
+#include "zebra/zebra_dplane.h" /* dplane_get_thread_master() */
+#include <dplane-rpc/dplane-rpc.h> /* HH's rpc dataplane library */
+
+#include "hh_dp_internal.h"
+#include "hh_dp_msg_cache.h"
+#include "hh_dp_msg.h"
+#include "hh_dp_comm.h"
+#include "hh_dp_state.h"
+#include "hh_dp_audit.h"
+
+DEFINE_MTYPE_STATIC(ZEBRA, HH_DP_AUDIT, "HH Dataplane audit");
+
+#define DFLT_DP_AUDIT_INTERVAL_SEC 300
+#define DP_AUDIT_TICK_SEC 10
+#define DP_AUDIT_RETRY_SEC 1
+
+/* prefix ranges per table and ip version, by the first byte of the prefix */
+#define DP_AUDIT_RANGES 256
+
+/* Digests of the routes in a table: one per prefix range and one for the table. A digest is
+ * the sum of the hashes of the routes, so that it does not depend on the order of the routes */
+struct dp_audit_table {
+    uint32_t tableid;
+    uint64_t root;
+    uint64_t range[2][DP_AUDIT_RANGES];     /* [IPV6?][first byte] */
+    bool differ[2][DP_AUDIT_RANGES];        /* ranges to compare route by route */
+};
+
+/* digests of the routes of a vrf */
+struct dp_audit_digest {
+    struct dp_audit_table *tables;
+    uint32_t num_tables;
+};
+
+/* a route, as needed to compare it */
+struct dp_audit_entry {
+    uint32_t tableid;
+    uint8_t ipver;
+    uint8_t len;
+    uint8_t addr[16];
+    uint64_t hash;
+};
+
+static struct dp_audit {
+    _Atomic uint32_t interval_sec;
+    struct event *ev_tick;
+    uint64_t t_last;            /* end of last cycle */
+
+    /* ongoing cycle */
+    bool active;
+    bool started;               /* vrfid is set */
+    VrfId vrfid;
+    bool pending;               /* Get outstanding for vrfid */
+    uint64_t gen;               /* snapshot generation when Get was sent */
+    struct dp_audit_entry *entries;
+    size_t num_entries;
+    size_t cap_entries;
+
+    /* counters */
+    uint64_t cycles;
+    uint64_t vrfs;
+    uint64_t vrfs_clean;
+    uint64_t vrfs_aborted;
+    uint64_t get_failures;
+    uint64_t tables_differ;
+    uint64_t ranges_differ;
+    uint64_t added;
+    uint64_t updated;
+    uint64_t deleted;
+} audit = {
+    .interval_sec = DFLT_DP_AUDIT_INTERVAL_SEC,
+};
+
+/* FNV-1a */
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+static inline uint64_t fnv_add(uint64_t h, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ p[i]) * FNV_PRIME;
+    return h;
+}
+#define HASH_VAL(h, val) ({ typeof(val) __v = (val); fnv_add(h, &__v, sizeof(__v)); })
+
+/* final mix, so that sums of hashes do not cancel out easily */
+static inline uint64_t hash_mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static inline uint64_t hash_address(uint64_t h, const struct IpAddress *addr)
+{
+    h = HASH_VAL(h, (uint8_t)addr->ipver);
+    if (addr->ipver == IPV4)
+        return HASH_VAL(h, addr->addr.ipv4);
+    if (addr->ipver == IPV6)
+        return fnv_add(h, addr->addr.ipv6, sizeof(addr->addr.ipv6));
+    return h;
+}
+
+/* Hash a route. Only the fields set by the plugin are hashed, one by one, so that padding
+ * or unset fields in the objects returned by dataplane do not matter. Next-hops are hashed
+ * independently of their order */
+static uint64_t dp_audit_hash(const struct ip_route *route)
+{
+    uint64_t h = FNV_OFFSET;
+    uint64_t nhops = 0;
+
+    h = hash_address(h, &route->prefix);
+    h = HASH_VAL(h, route->len);
+    h = HASH_VAL(h, route->tableid);
+    h = HASH_VAL(h, (uint32_t)route->type);
+    h = HASH_VAL(h, route->distance);
+    h = HASH_VAL(h, route->metric);
+
+    for (uint8_t i = 0; i < route->num_nhops; i++) {
+        const struct next_hop *nhop = &route->nhops[i];
+        uint64_t hn = hash_address(FNV_OFFSET, &nhop->address);
+        hn = HASH_VAL(hn, nhop->ifindex);
+        hn = HASH_VAL(hn, nhop->vrfid);
+        hn = HASH_VAL(hn, (uint32_t)nhop->fwaction);
+        hn = HASH_VAL(hn, (uint32_t)nhop->encap.type);
+        if (nhop->encap.type == VXLAN)
+            hn = HASH_VAL(hn, nhop->encap.vxlan.vni);
+        nhops += hash_mix(hn);
+    }
+    h = HASH_VAL(h, nhops);
+    return hash_mix(h);
+}
+
+/* build the entry of a route. The address is laid out as in the snapshot keys */
+static void dp_audit_entry_set(struct dp_audit_entry *e, const struct ip_route *route)
+{
+    memset(e, 0, sizeof(*e));
+    e->tableid = route->tableid;
+    e->ipver = route->prefix.ipver;
+    e->len = route->len;
+    if (route->prefix.ipver == IPV4)
+        memcpy(e->addr, &route->prefix.addr.ipv4, 4);
+    else
+        memcpy(e->addr, route->prefix.addr.ipv6, 16);
+    e->hash = dp_audit_hash(route);
+}
+
+#define ENTRY_CMP(a, b, field) \
+    do { if ((a)->field != (b)->field) return (a)->field < (b)->field ? -1 : 1; } while (0)
+
+/* order of entries: the same as that of routes in the snapshot */
+static int dp_audit_entry_cmp(const struct dp_audit_entry *a, const struct dp_audit_entry *b)
+{
+    ENTRY_CMP(a, b, tableid);
+    ENTRY_CMP(a, b, ipver);
+    int r = memcmp(a->addr, b->addr, sizeof(a->addr));
+    if (r)
+        return r;
+    ENTRY_CMP(a, b, len);
+    return 0;
+}
+static int dp_audit_entry_qsort_cmp(const void *a, const void *b)
+{
+    return dp_audit_entry_cmp(a, b);
+}
+
+/* digests */
+static struct dp_audit_table *dp_audit_table_get(struct dp_audit_digest *digest, uint32_t tableid)
+{
+    for (uint32_t i = 0; i < digest->num_tables; i++) {
+        if (digest->tables[i].tableid == tableid)
+            return &digest->tables[i];
+    }
+    digest->tables = XREALLOC(MTYPE_HH_DP_AUDIT, digest->tables, (digest->num_tables + 1) * sizeof(*digest->tables));
+    struct dp_audit_table *t = &digest->tables[digest->num_tables++];
+    memset(t, 0, sizeof(*t));
+    t->tableid = tableid;
+    return t;
+}
+static inline uint32_t dp_audit_range(const struct dp_audit_entry *e)
+{
+    return e->addr[0];
+}
+static inline uint32_t dp_audit_ipv(const struct dp_audit_entry *e)
+{
+    return e->ipver == IPV6 ? 1 : 0;
+}
+static void dp_audit_digest_add(struct dp_audit_digest *digest, const struct dp_audit_entry *e)
+{
+    struct dp_audit_table *t = dp_audit_table_get(digest, e->tableid);
+    t->range[dp_audit_ipv(e)][dp_audit_range(e)] += e->hash;
+    t->root += e->hash;
+}
+static void dp_audit_digest_free(struct dp_audit_digest *digest)
+{
+    if (digest->tables)
+        XFREE(MTYPE_HH_DP_AUDIT, digest->tables);
+    digest->num_tables = 0;
+}
+static void dp_audit_digest_route(const struct RpcObject *object, void *arg)
+{
+    struct dp_audit_entry e;
+    dp_audit_entry_set(&e, &object->route);
+    dp_audit_digest_add(arg, &e);
+}
+
+/* Compare the digests of the plugin with those of dataplane, top-down, and flag the ranges
+ * that differ in the plugin's digest. Returns the number of those ranges */
+static uint32_t dp_audit_digest_cmp(struct dp_audit_digest *ours, struct dp_audit_digest *theirs)
+{
+    uint32_t num_differ = 0;
+
+    /* tables that only dataplane has */
+    for (uint32_t i = 0; i < theirs->num_tables; i++)
+        dp_audit_table_get(ours, theirs->tables[i].tableid);
+
+    for (uint32_t i = 0; i < ours->num_tables; i++) {
+        struct dp_audit_table *t = &ours->tables[i];
+        struct dp_audit_table *dpt = dp_audit_table_get(theirs, t->tableid);
+
+        if (t->root == dpt->root)
+            continue;
+        audit.tables_differ++;
+        for (int v = 0; v < 2; v++) {
+            for (int r = 0; r < DP_AUDIT_RANGES; r++) {
+                if (t->range[v][r] != dpt->range[v][r]) {
+                    t->differ[v][r] = true;
+                    num_differ++;
+                }
+            }
+        }
+    }
+    audit.ranges_differ += num_differ;
+    return num_differ;
+}
+
+/* repair */
+struct dp_audit_repair {
+    struct dp_audit_digest *digest;
+    size_t cursor;                          /* next entry of dataplane */
+    const struct dp_audit_entry *last;      /* last entry visited, to skip duplicates */
+};
+static bool dp_audit_in_differ(struct dp_audit_digest *digest, const struct dp_audit_entry *e)
+{
+    struct dp_audit_table *t = dp_audit_table_get(digest, e->tableid);
+    return t->differ[dp_audit_ipv(e)][dp_audit_range(e)];
+}
+
+/* remove a route that dataplane has and we don't */
+static void dp_audit_repair_extra(const struct dp_audit_entry *e)
+{
+    struct RpcObject object = {0};
+
+    object.type = IpRoute;
+    object.route.vrfid = audit.vrfid;
+    object.route.tableid = e->tableid;
+    object.route.len = e->len;
+    object.route.prefix.ipver = e->ipver;
+    if (e->ipver == IPV4)
+        memcpy(&object.route.prefix.addr.ipv4, e->addr, 4);
+    else
+        memcpy(object.route.prefix.addr.ipv6, e->addr, 16);
+
+    send_rpc_request_stale(&object);
+    audit.deleted++;
+}
+
+/* advance the dataplane cursor up to a route, removing the routes before it in differing ranges.
+ * Duplicates are skipped. Returns the entry for the route, if dataplane has it */
+static const struct dp_audit_entry *dp_audit_repair_seek(struct dp_audit_repair *rp, const struct dp_audit_entry *upto)
+{
+    while (rp->cursor < audit.num_entries) {
+        const struct dp_audit_entry *e = &audit.entries[rp->cursor];
+        int r = upto ? dp_audit_entry_cmp(e, upto) : -1;
+        if (r > 0)
+            break;
+        rp->cursor++;
+
+        bool dup = rp->last && dp_audit_entry_cmp(rp->last, e) == 0;
+        rp->last = e;
+        if (r == 0)
+            return e;
+        if (!dup && dp_audit_in_differ(rp->digest, e))
+            dp_audit_repair_extra(e);
+    }
+    return NULL;
+}
+
+static void dp_audit_repair_route(const struct RpcObject *object, void *arg)
+{
+    struct dp_audit_repair *rp = arg;
+    struct dp_audit_entry ours;
+
+    dp_audit_entry_set(&ours, &object->route);
+    if (!dp_audit_in_differ(rp->digest, &ours))
+        return;
+
+    const struct dp_audit_entry *theirs = dp_audit_repair_seek(rp, &ours);
+    if (!theirs) {
+        send_rpc_request_replay(object);
+        audit.added++;
+    } else if (theirs->hash != ours.hash) {
+        send_rpc_request_replay(object);
+        audit.updated++;
+    }
+}
+
+/* compare the routes of the vrf with those of dataplane, and repair differences */
+static void dp_audit_vrf(void)
+{
+    struct dp_audit_digest ours = {0}, theirs = {0};
+    uint64_t added = audit.added, updated = audit.updated, deleted = audit.deleted;
+
+    audit.vrfs++;
+    dp_state_route_walk(audit.vrfid, dp_audit_digest_route, &ours);
+    for (size_t i = 0; i < audit.num_entries; i++)
+        dp_audit_digest_add(&theirs, &audit.entries[i]);
+
+    if (dp_audit_digest_cmp(&ours, &theirs) == 0) {
+        audit.vrfs_clean++;
+        goto done;
+    }
+
+    /* walk both sides in the same order, visiting only the ranges that differ */
+    struct dp_audit_repair rp = { .digest = &ours };
+    qsort(audit.entries, audit.num_entries, sizeof(*audit.entries), dp_audit_entry_qsort_cmp);
+    dp_state_route_walk(audit.vrfid, dp_audit_repair_route, &rp);
+    dp_audit_repair_seek(&rp, NULL);
+
+    zlog_warn("Audit of vrf %u found drift in dataplane: %"PRIu64" routes added, %"PRIu64" updated, %"PRIu64" removed",
+            audit.vrfid, audit.added - added, audit.updated - updated, audit.deleted - deleted);
+done:
+    dp_audit_digest_free(&ours);
+    dp_audit_digest_free(&theirs);
+}
+
+static void dp_audit_tick(struct event *ev);
+static void dp_audit_schedule(uint32_t sec)
+{
+    EVENT_OFF(audit.ev_tick);
+    if (sec)
+        event_add_timer(dplane_get_thread_master(), dp_audit_tick, NULL, sec, &audit.ev_tick);
+    else
+        event_add_event(dplane_get_thread_master(), dp_audit_tick, NULL, 0, &audit.ev_tick);
+}
+
+/* audit the next vrf. Gets are only sent with nothing pending and a complete snapshot, so
+ * that the snapshot can be compared with what dataplane answers */
+static void dp_audit_next(void)
+{
+    if (!dp_state_is_settled() || !dplane_is_ready() || dp_msg_unsent_count() || dp_msg_in_flight_count())
+        return;
+
+    if (!dp_state_route_vrf_next(audit.started, &audit.vrfid)) {
+        audit.active = false;
+        audit.cycles++;
+        audit.t_last = hh_monotime_us();
+        zlog_debug("Audit of dataplane routes completed");
+        return;
+    }
+    audit.started = true;
+
+    struct RpcObject object = {0};
+    object.type = IpRoute;
+    object.route.vrfid = audit.vrfid;   /* table 0: all tables */
+
+    audit.pending = true;
+    audit.gen = dp_state_generation();
+    audit.num_entries = 0;
+    send_rpc_request_get(&object);
+}
+
+static void dp_audit_tick(struct event *ev)
+{
+    uint32_t interval_sec = atomic_load_explicit(&audit.interval_sec, memory_order_relaxed);
+
+    if (!audit.active && interval_sec &&
+        hh_monotime_us() - audit.t_last >= (uint64_t)interval_sec * 1000000ULL) {
+        audit.active = true;
+        audit.started = false;
+    }
+    if (audit.active && !audit.pending)
+        dp_audit_next();
+
+    dp_audit_schedule(audit.active ? DP_AUDIT_RETRY_SEC : DP_AUDIT_TICK_SEC);
+}
+
+/* handle a response to an audit Get, partial or not */
+void dp_audit_response(const struct RpcResponse *resp)
+{
+    BUG(!resp);
+    if (!audit.pending)
+        return;
+
+    for (uint8_t i = 0; i < resp->num_objects; i++) {
+        const struct RpcObject *object = &resp->objects[i];
+        if (object->type != IpRoute || object->route.vrfid != audit.vrfid)
+            continue;
+        if (audit.num_entries == audit.cap_entries) {
+            audit.cap_entries = audit.cap_entries ? audit.cap_entries * 2 : 1024;
+            audit.entries = XREALLOC(MTYPE_HH_DP_AUDIT, audit.entries, audit.cap_entries * sizeof(*audit.entries));
+        }
+        dp_audit_entry_set(&audit.entries[audit.num_entries++], &object->route);
+    }
+    if (resp->rescode == ExpectMore)
+        return;
+
+    audit.pending = false;
+    if (resp->rescode != Ok) {
+        zlog_warn("Dataplane failed audit Get for vrf %u: %s", audit.vrfid, str_rescode(resp->rescode));
+        audit.get_failures++;
+    } else if (dp_state_generation() != audit.gen) {
+        /* the snapshot changed meanwhile: the routes can't be compared */
+        audit.vrfs_aborted++;
+    } else {
+        dp_audit_vrf();
+    }
+    audit.num_entries = 0;
+    dp_audit_schedule(0);
+}
+
+/* drop the audit of the current vrf */
+void dp_audit_abort(const char *reason)
+{
+    if (!audit.pending)
+        return;
+    zlog_debug("Aborting audit of vrf %u: %s", audit.vrfid, reason);
+    audit.pending = false;
+    audit.vrfs_aborted++;
+    audit.num_entries = 0;
+}
+
+/* set the interval between audits. Called from the main thread */
+int dp_audit_set_interval(uint32_t interval_sec)
+{
+    atomic_store_explicit(&audit.interval_sec, interval_sec, memory_order_relaxed);
+    zlog_info("Audit of dataplane routes %s (interval %u s)", interval_sec ? "enabled" : "disabled", interval_sec);
+    return 0;
+}
+
+/* vty: write the audit interval, if not the default, to the running config */
+int dp_audit_config_write(struct vty *vty)
+{
+    BUG(!vty, 0);
+    uint32_t interval_sec = atomic_load_explicit(&audit.interval_sec, memory_order_relaxed);
+
+    if (interval_sec == DFLT_DP_AUDIT_INTERVAL_SEC)
+        return 0;
+    vty_out(vty, "hedgehog audit interval %u\n", interval_sec);
+    return 1;
+}
+
+/* vty: show audit status */
+void hh_vty_show_audit(struct vty *vty)
+{
+    BUG(!vty);
+    uint32_t interval_sec = atomic_load_explicit(&audit.interval_sec, memory_order_relaxed);
+
+    if (interval_sec)
+        vty_out(vty, " Audit of dataplane routes: every %u s\n", interval_sec);
+    else
+        vty_out(vty, " Audit of dataplane routes: disabled\n");
+    if (audit.active && audit.started)
+        vty_out(vty, "   state: auditing vrf %u\n", audit.vrfid);
+    else
+        vty_out(vty, "   state: %s\n", audit.active ? "starting" : "idle");
+    if (audit.t_last)
+        vty_out(vty, "   last cycle: %"PRIu64" s ago\n", (hh_monotime_us() - audit.t_last) / 1000000);
+    vty_out(vty, "   cycles: %"PRIu64", vrfs audited: %"PRIu64" (%"PRIu64" clean), aborted: %"PRIu64", get failures: %"PRIu64"\n",
+            audit.cycles, audit.vrfs, audit.vrfs_clean, audit.vrfs_aborted, audit.get_failures);
+    vty_out(vty, "   tables differing: %"PRIu64", ranges differing: %"PRIu64"\n", audit.tables_differ, audit.ranges_differ);
+    vty_out(vty, "   repairs: %"PRIu64" routes added, %"PRIu64" updated, %"PRIu64" removed\n",
+            audit.added, audit.updated, audit.deleted);
+}
+struct json_object *hh_json_audit(void)
+{
+    struct json_object *json = hh_json_new();
+
+    json_object_int_add(json, "intervalSec", atomic_load_explicit(&audit.interval_sec, memory_order_relaxed));
+    json_object_string_add(json, "state", audit.active ? (audit.started ? "auditing" : "starting") : "idle");
+    if (audit.active && audit.started)
+        json_object_int_add(json, "vrf", audit.vrfid);
+    if (audit.t_last)
+        json_object_int_add(json, "lastCycleUsec", audit.t_last);
+    json_object_int_add(json, "cycles", audit.cycles);
+    json_object_int_add(json, "vrfsAudited", audit.vrfs);
+    json_object_int_add(json, "vrfsClean", audit.vrfs_clean);
+    json_object_int_add(json, "vrfsAborted", audit.vrfs_aborted);
+    json_object_int_add(json, "getFailures", audit.get_failures);
+    json_object_int_add(json, "tablesDiffering", audit.tables_differ);
+    json_object_int_add(json, "rangesDiffering", audit.ranges_differ);
+    json_object_int_add(json, "routesAdded", audit.added);
+    json_object_int_add(json, "routesUpdated", audit.updated);
+    json_object_int_add(json, "routesRemoved", audit.deleted);
+    return json;
+}
+
+/* initialize the audit. The first one happens an interval after startup */
+void init_dp_audit(void)
+{
+    zlog_debug("Initializing dataplane audit...");
+    audit.t_last = hh_monotime_us();
+    dp_audit_schedule(DP_AUDIT_TICK_SEC);
+}
+
+void fini_dp_audit(void)
+{
+    zlog_debug("Finalizing dataplane audit...");
+    EVENT_OFF(audit.ev_tick);
+    if (audit.entries)
+        XFREE(MTYPE_HH_DP_AUDIT, audit.entries);
+    audit.num_entries = audit.cap_entries = 0;
+    audit.pending = audit.active = false;
+}
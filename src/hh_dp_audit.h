@@ -0,0 +1,33 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef SRC_HH_DP_AUDIT_H_
+#define SRC_HH_DP_AUDIT_H_
+
+#include <stdint.h>
+#include <dplane-rpc/dplane-rpc.h>
+#include "lib/vty.h"
+#include "lib/json.h"
+
+/* Periodic audit of the routes held by dataplane. The routes of each vrf are fetched with a
+ * Get and digested per table and prefix range, as are those in the state snapshot. Only the
+ * ranges whose digests differ are compared route by route and repaired. */
+
+/* initialize / finalize the audit */
+void init_dp_audit(void);
+void fini_dp_audit(void);
+
+/* set the interval between audits (seconds). 0 disables them */
+int dp_audit_set_interval(uint32_t interval_sec);
+
+/* handle a response to an audit Get, partial or not */
+void dp_audit_response(const struct RpcResponse *resp);
+
+/* drop the audit of the current vrf: its Get will not be (reliably) answered */
+void dp_audit_abort(const char *reason);
+
+/* vty: show audit status, write its interval to the running config */
+void hh_vty_show_audit(struct vty *vty);
+int dp_audit_config_write(struct vty *vty);
+struct json_object *hh_json_audit(void);
+
+#endif /* SRC_HH_DP_AUDIT_H_ */
@@ -0,0 +1,154 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "config.h" /* FRR config.h */
+#include "lib/zebra.h"
+#include "lib/libfrr.h"
+
+#include "hh_dp_internal.h"
+#include "hh_dp_budget.h"
+
+/* budgets are set from the main thread and read from the dplane pthread */
+struct hh_budget {
+    const char *name;
+    _Atomic uint32_t max_msgs;
+    _Atomic uint32_t max_usec;
+    uint32_t dflt_max_msgs;
+    uint32_t dflt_max_usec;
+
+    /* pass statistics */
+    _Atomic uint64_t passes;
+    _Atomic uint64_t exhausted;     /* passes that ran out of budget */
+    _Atomic uint64_t msgs;
+    _Atomic uint64_t usec;
+    _Atomic uint64_t usec_max;
+    _Atomic uint64_t usec_last;
+};
+
+#define HH_BUDGET(n, msgs, usec) \
+    { .name = n, .max_msgs = msgs, .max_usec = usec, .dflt_max_msgs = msgs, .dflt_max_usec = usec }
+
+static struct hh_budget budgets[HH_BUDGET_MAX] = {
+    [HH_BUDGET_RX] = HH_BUDGET("rx", 1024, 5000),
+    [HH_BUDGET_TX] = HH_BUDGET("tx", 1024, 5000),
+    [HH_BUDGET_INTAKE] = HH_BUDGET("intake", 0, 5000), /* zebra limits msgs */
+};
+
+int hh_budget_id_from_str(const char *name)
+{
+    for (int id = 0; id < HH_BUDGET_MAX; id++) {
+        if (strmatch(budgets[id].name, name))
+            return id;
+    }
+    return -1;
+}
+
+void hh_budget_begin(struct hh_budget_pass *pass, enum hh_budget_id id)
+{
+    BUG(!pass || id >= HH_BUDGET_MAX);
+    uint32_t max_usec = atomic_load_explicit(&budgets[id].max_usec, memory_order_relaxed);
+
+    pass->id = id;
+    pass->msgs = 0;
+    pass->max_msgs = atomic_load_explicit(&budgets[id].max_msgs, memory_order_relaxed);
+    pass->t_start = hh_monotime_us();
+    pass->t_end = max_usec ? pass->t_start + max_usec : 0;
+}
+
+bool hh_budget_left(const struct hh_budget_pass *pass)
+{
+    if (pass->max_msgs && pass->msgs >= pass->max_msgs)
+        return false;
+    if (pass->t_end && pass->msgs && hh_monotime_us() >= pass->t_end)
+        return false;
+    return true;
+}
+
+void hh_budget_end(struct hh_budget_pass *pass, bool exhausted)
+{
+    BUG(!pass || pass->id >= HH_BUDGET_MAX);
+    struct hh_budget *b = &budgets[pass->id];
+    uint64_t usec = hh_monotime_us() - pass->t_start;
+
+    atomic_fetch_add_explicit(&b->passes, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&b->msgs, pass->msgs, memory_order_relaxed);
+    atomic_fetch_add_explicit(&b->usec, usec, memory_order_relaxed);
+    atomic_store_explicit(&b->usec_last, usec, memory_order_relaxed);
+    if (usec > atomic_load_explicit(&b->usec_max, memory_order_relaxed))
+        atomic_store_explicit(&b->usec_max, usec, memory_order_relaxed);
+    if (exhausted)
+        atomic_fetch_add_explicit(&b->exhausted, 1, memory_order_relaxed);
+}
+
+int hh_budget_set(enum hh_budget_id id, uint32_t max_msgs, uint32_t max_usec)
+{
+    BUG(id >= HH_BUDGET_MAX, -1);
+    atomic_store_explicit(&budgets[id].max_msgs, max_msgs, memory_order_relaxed);
+    atomic_store_explicit(&budgets[id].max_usec, max_usec, memory_order_relaxed);
+    zlog_info("Budget for %s passes set to %u msgs, %u usec", budgets[id].name, max_msgs, max_usec);
+    return 0;
+}
+
+/* vty: show budgets and pass statistics */
+#define GET_BUDGET_VAL(b, name) atomic_load_explicit(&(b)->name, memory_order_relaxed)
+
+/* vty: write the budgets that differ from the defaults to the running config */
+int hh_budget_config_write(struct vty *vty)
+{
+    BUG(!vty, 0);
+    int lines = 0;
+
+    for (int id = 0; id < HH_BUDGET_MAX; id++) {
+        struct hh_budget *b = &budgets[id];
+        uint32_t max_msgs = GET_BUDGET_VAL(b, max_msgs);
+        uint32_t max_usec = GET_BUDGET_VAL(b, max_usec);
+
+        if (max_msgs == b->dflt_max_msgs && max_usec == b->dflt_max_usec)
+            continue;
+        vty_out(vty, "hedgehog budget %s msgs %u usec %u\n", b->name, max_msgs, max_usec);
+        lines++;
+    }
+    return lines;
+}
+void hh_vty_show_budgets(struct vty *vty)
+{
+    BUG(!vty);
+
+    vty_out(vty, " Work loop budgets (0: no limit)\n");
+    vty_out(vty, " %8.8s %10.10s %10.10s %14.14s %14.14s %10.10s %10.10s %10.10s %10.10s\n",
+            "loop", "max-msgs", "max-usec", "passes", "exhausted", "msgs/pass", "usec/pass", "usec-max", "usec-last");
+
+    for (int id = 0; id < HH_BUDGET_MAX; id++) {
+        struct hh_budget *b = &budgets[id];
+        uint64_t passes = GET_BUDGET_VAL(b, passes);
+
+        vty_out(vty, " %8.8s %10u %10u %14"PRIu64" %14"PRIu64" %10"PRIu64" %10"PRIu64" %10"PRIu64" %10"PRIu64"\n",
+                b->name,
+                GET_BUDGET_VAL(b, max_msgs),
+                GET_BUDGET_VAL(b, max_usec),
+                passes,
+                GET_BUDGET_VAL(b, exhausted),
+                passes ? GET_BUDGET_VAL(b, msgs) / passes : 0,
+                passes ? GET_BUDGET_VAL(b, usec) / passes : 0,
+                GET_BUDGET_VAL(b, usec_max),
+                GET_BUDGET_VAL(b, usec_last));
+    }
+}
+struct json_object *hh_json_budgets(void)
+{
+    struct json_object *json = hh_json_new();
+
+    for (int id = 0; id < HH_BUDGET_MAX; id++) {
+        struct hh_budget *b = &budgets[id];
+        struct json_object *jb = json_object_new_object();
+        json_object_int_add(jb, "maxMsgs", GET_BUDGET_VAL(b, max_msgs));
+        json_object_int_add(jb, "maxUsec", GET_BUDGET_VAL(b, max_usec));
+        json_object_int_add(jb, "passes", GET_BUDGET_VAL(b, passes));
+        json_object_int_add(jb, "exhausted", GET_BUDGET_VAL(b, exhausted));
+        json_object_int_add(jb, "msgs", GET_BUDGET_VAL(b, msgs));
+        json_object_int_add(jb, "usec", GET_BUDGET_VAL(b, usec));
+        json_object_int_add(jb, "usecMax", GET_BUDGET_VAL(b, usec_max));
+        json_object_int_add(jb, "usecLast", GET_BUDGET_VAL(b, usec_last));
+        json_object_object_add(json, b->name, jb);
+    }
+    return json;
+}
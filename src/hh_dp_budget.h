@@ -0,0 +1,45 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef SRC_HH_DP_BUDGET_H_
+#define SRC_HH_DP_BUDGET_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "lib/vty.h"
+#include "lib/json.h"
+
+/* Work loops of the plugin in the dplane pthread. Each pass of a loop is limited in
+ * number of messages and time, so that no loop can monopolize the pthread */
+enum hh_budget_id {
+    HH_BUDGET_RX = 0,   /* reception of messages from dataplane */
+    HH_BUDGET_TX,       /* draining of the unsent queue */
+    HH_BUDGET_INTAKE,   /* intake of contexts from zebra */
+    HH_BUDGET_MAX
+};
+
+/* a pass of a work loop */
+struct hh_budget_pass {
+    enum hh_budget_id id;
+    uint32_t msgs;        /* messages processed so far */
+    uint32_t max_msgs;
+    uint64_t t_start;
+    uint64_t t_end;       /* deadline (usec), or 0 if none */
+};
+
+/* start / end a pass of a work loop. Passes that stopped with work left are exhausted */
+void hh_budget_begin(struct hh_budget_pass *pass, enum hh_budget_id id);
+void hh_budget_end(struct hh_budget_pass *pass, bool exhausted);
+
+/* tell if a pass may process one more message */
+bool hh_budget_left(const struct hh_budget_pass *pass);
+
+/* set the budget of a loop. 0 means no limit */
+int hh_budget_set(enum hh_budget_id id, uint32_t max_msgs, uint32_t max_usec);
+int hh_budget_id_from_str(const char *name);
+
+/* vty: show budgets and pass statistics, write budgets to the running config */
+void hh_vty_show_budgets(struct vty *vty);
+int hh_budget_config_write(struct vty *vty);
+struct json_object *hh_json_budgets(void);
+
+#endif /* SRC_HH_DP_BUDGET_H_ */
@@ -0,0 +1,300 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "config.h" /* FRR config.h */
+#include "lib/zebra.h"
+#include "lib/libfrr.h"
+#include "zebra/zebra_dplane.h"
+
+#include "hh_dp_internal.h"
+#include "hh_dp_msg_cache.h" /* MGROUP ZEBRA */
+#include "hh_dp_process.h" /* prov_p */
+#include "hh_dp_bulk.h"
+#include "hh_dp_msg.h" /* dp_msg_hand_off_flush */
+
+/*
+ * Bulk-load mode. During initial convergence, route contexts are not sent one by one
+ * as zebra hands them, but held until zebra goes quiet. They are then sorted by vrf,
+ * table and prefix and streamed in large batches, since dataplane builds its LPM
+ * structures much faster from sorted input. Afterwards, the plugin works incrementally.
+ * Since every route is then held for at least the quiet period, the mode is off unless
+ * enabled with the bulk-load-quiet-ms plugin option, e.g. for large initial tables.
+ */
+
+DEFINE_MTYPE_STATIC(ZEBRA, HH_DP_BULK, "HH Dataplane bulk-load");
+
+#define DP_BULK_QUIET_MSEC_DFLT 0     /* no routes for this long ends the convergence. 0: disabled */
+#define DP_BULK_MAX_HOLD_SEC 120      /* max time a route may be held */
+#define DP_BULK_STREAM_BATCH 2048     /* contexts released per event loop run */
+#define DP_BULK_MIN_CHECK_MSEC 50
+
+enum dp_bulk_mode {
+    BULK_DISABLED = 0,
+    BULK_HOLDING,     /* accumulating contexts */
+    BULK_STREAMING,   /* releasing sorted contexts */
+    BULK_DONE,        /* incremental mode */
+};
+
+static const char *dp_bulk_mode_str(enum dp_bulk_mode mode)
+{
+    switch(mode) {
+        case BULK_DISABLED: return "disabled";
+        case BULK_HOLDING: return "holding";
+        case BULK_STREAMING: return "streaming";
+        case BULK_DONE: return "done";
+        default: return "unknown";
+    }
+}
+
+/* A held context and its sort key */
+struct dp_bulk_entry {
+    uint32_t vrfid;
+    uint32_t tableid;
+    uint8_t family;
+    uint8_t len;
+    uint8_t addr[16];
+    uint64_t seq;      /* arrival order, keeps multiple contexts for a prefix in order */
+    struct zebra_dplane_ctx *ctx;
+};
+
+static struct dp_bulk {
+    enum dp_bulk_mode mode;
+    uint32_t quiet_msec;
+    dp_bulk_send_cb send_cb;
+    struct event *ev_check;
+    struct event *ev_stream;
+
+    /* held contexts */
+    struct dp_bulk_entry *entries;
+    size_t count;
+    size_t capacity;
+    size_t next;            /* next entry to release when streaming */
+
+    /* timestamps (usec) */
+    uint64_t t_start;       /* bulk-load mode start */
+    uint64_t t_first;       /* first route held */
+    uint64_t t_last;        /* last route held */
+    uint64_t t_stream;      /* streaming started */
+    uint64_t t_done;        /* streaming finished */
+} bulk = {
+    .quiet_msec = DP_BULK_QUIET_MSEC_DFLT,
+};
+
+/* set the quiet period that marks the end of initial convergence. 0 disables bulk-load */
+int dp_bulk_set_quiet_msec(const char *value)
+{
+    BUG(!value, -1);
+    char *end;
+    unsigned long msec = strtoul(value, &end, 10);
+    if (*end != '\0' || msec > 60000) {
+        zlog_err("Invalid bulk-load quiet period '%s' (must be 0-60000 msec)", value);
+        return -1;
+    }
+    bulk.quiet_msec = (uint32_t)msec;
+    zlog_debug("Configured bulk-load quiet period to %lu msec", msec);
+    return 0;
+}
+
+/* order held contexts by vrf, table and prefix. Contexts for the same prefix keep their order */
+static int dp_bulk_entry_cmp(const void *x, const void *y)
+{
+    const struct dp_bulk_entry *a = x, *b = y;
+
+    if (a->vrfid != b->vrfid)
+        return a->vrfid < b->vrfid ? -1 : 1;
+    if (a->tableid != b->tableid)
+        return a->tableid < b->tableid ? -1 : 1;
+    if (a->family != b->family)
+        return a->family < b->family ? -1 : 1;
+    int r = memcmp(a->addr, b->addr, sizeof(a->addr));
+    if (r)
+        return r;
+    if (a->len != b->len)
+        return a->len < b->len ? -1 : 1;
+    return a->seq < b->seq ? -1 : (a->seq > b->seq);
+}
+
+/* release held contexts in batches */
+static void dp_bulk_stream(struct event *ev)
+{
+    size_t budget = DP_BULK_STREAM_BATCH;
+
+    while (bulk.next < bulk.count && budget--) {
+        struct zebra_dplane_ctx *ctx = bulk.entries[bulk.next].ctx;
+        bulk.entries[bulk.next++].ctx = NULL;
+        bulk.send_cb(ctx);
+    }
+
+    /* contexts for objects that dataplane kept across a restart are completed right away */
+    dp_msg_hand_off_flush();
+
+    if (bulk.next < bulk.count) {
+        event_add_event(dplane_get_thread_master(), dp_bulk_stream, NULL, 0, &bulk.ev_stream);
+        return;
+    }
+
+    /* done: switch to incremental mode */
+    bulk.t_done = hh_monotime_us();
+    zlog_info("Bulk-load completed: %zu route contexts streamed in %"PRIu64" ms",
+            bulk.count, (bulk.t_done - bulk.t_stream) / 1000);
+    bulk.mode = BULK_DONE;
+    XFREE(MTYPE_HH_DP_BULK, bulk.entries);
+    bulk.capacity = 0;
+}
+
+/* end of initial convergence: sort held contexts and start releasing them */
+static void dp_bulk_start_streaming(void)
+{
+    bulk.t_stream = hh_monotime_us();
+    EVENT_OFF(bulk.ev_check);
+
+    zlog_info("Initial convergence detected: sorting %zu held route contexts...", bulk.count);
+    if (bulk.count)
+        qsort(bulk.entries, bulk.count, sizeof(*bulk.entries), dp_bulk_entry_cmp);
+
+    bulk.mode = BULK_STREAMING;
+    dp_bulk_stream(NULL);
+}
+
+/* periodic check for the end of initial convergence */
+static void dp_bulk_check(struct event *ev)
+{
+    uint64_t now = hh_monotime_us();
+    uint64_t max_hold = (uint64_t)DP_BULK_MAX_HOLD_SEC * 1000000ULL;
+
+    if (bulk.mode != BULK_HOLDING)
+        return;
+
+    /* nothing held for too long: zebra has no routes for us */
+    if (!bulk.count && now - bulk.t_start >= max_hold) {
+        zlog_info("No routes received during bulk-load window. Switching to incremental mode");
+        bulk.mode = BULK_DONE;
+        return;
+    }
+
+    /* quiet for long enough, or holding routes for too long */
+    if (bulk.count && (now - bulk.t_last >= (uint64_t)bulk.quiet_msec * 1000ULL ||
+                       now - bulk.t_first >= max_hold)) {
+        dp_bulk_start_streaming();
+        return;
+    }
+
+    event_add_timer_msec(dplane_get_thread_master(), dp_bulk_check, NULL,
+            MAX(bulk.quiet_msec / 4, DP_BULK_MIN_CHECK_MSEC), &bulk.ev_check);
+}
+
+/* zebra notified a startup stage: convergence starts now */
+void dp_bulk_startup_stage(void)
+{
+    if (bulk.mode == BULK_HOLDING && !bulk.count)
+        bulk.t_start = hh_monotime_us();
+}
+
+/* hold a route context if in bulk-load mode */
+bool dp_bulk_hold(struct zebra_dplane_ctx *ctx)
+{
+    BUG(!ctx, false);
+
+    /* while streaming, hold new contexts too, so that they go after the held ones */
+    if (bulk.mode != BULK_HOLDING && bulk.mode != BULK_STREAMING)
+        return false;
+
+    if (bulk.count == bulk.capacity) {
+        bulk.capacity = bulk.capacity ? bulk.capacity * 2 : 4096;
+        bulk.entries = XREALLOC(MTYPE_HH_DP_BULK, bulk.entries, bulk.capacity * sizeof(*bulk.entries));
+    }
+
+    struct dp_bulk_entry *e = &bulk.entries[bulk.count];
+    const struct prefix *p = dplane_ctx_get_dest(ctx);
+    memset(e, 0, sizeof(*e));
+    e->vrfid = dplane_ctx_get_vrf(ctx);
+    e->tableid = dplane_ctx_get_table(ctx);
+    e->family = p->family;
+    e->len = p->prefixlen;
+    memcpy(e->addr, &p->u.prefix, p->family == AF_INET ? 4 : 16);
+    e->seq = bulk.count;
+    e->ctx = ctx;
+    bulk.count++;
+
+    bulk.t_last = hh_monotime_us();
+    if (!bulk.t_first)
+        bulk.t_first = bulk.t_last;
+
+    return true;
+}
+
+/* vty: show bulk-load status */
+void hh_vty_show_bulk(struct vty *vty)
+{
+    BUG(!vty);
+    uint64_t now = hh_monotime_us();
+
+    vty_out(vty, " Bulk-load mode: %s (quiet period %u ms)\n", dp_bulk_mode_str(bulk.mode), bulk.quiet_msec);
+    if (bulk.mode == BULK_DISABLED)
+        return;
+
+    vty_out(vty, "   route contexts held: %zu, released: %zu\n", bulk.count, bulk.next);
+    if (bulk.t_first)
+        vty_out(vty, "   holding time: %"PRIu64" ms\n",
+                ((bulk.t_stream ? bulk.t_stream : now) - bulk.t_first) / 1000);
+    if (bulk.t_stream)
+        vty_out(vty, "   streaming time: %"PRIu64" ms\n",
+                ((bulk.t_done ? bulk.t_done : now) - bulk.t_stream) / 1000);
+}
+struct json_object *hh_json_bulk(void)
+{
+    struct json_object *json = hh_json_new();
+    uint64_t now = hh_monotime_us();
+
+    json_object_string_add(json, "mode", dp_bulk_mode_str(bulk.mode));
+    json_object_int_add(json, "quietMsec", bulk.quiet_msec);
+    if (bulk.mode == BULK_DISABLED)
+        return json;
+
+    json_object_int_add(json, "held", bulk.count);
+    json_object_int_add(json, "released", bulk.next);
+    if (bulk.t_first)
+        json_object_int_add(json, "holdingUsec", (bulk.t_stream ? bulk.t_stream : now) - bulk.t_first);
+    if (bulk.t_stream)
+        json_object_int_add(json, "streamingUsec", (bulk.t_done ? bulk.t_done : now) - bulk.t_stream);
+    return json;
+}
+
+/* initialize bulk-load mode: if enabled, we start holding routes right away */
+void init_dp_bulk(dp_bulk_send_cb send_cb)
+{
+    BUG(!send_cb);
+    bulk.send_cb = send_cb;
+
+    if (!bulk.quiet_msec) {
+        zlog_info("Bulk-load mode is disabled");
+        bulk.mode = BULK_DISABLED;
+        return;
+    }
+
+    zlog_info("Starting in bulk-load mode (quiet period %u ms)", bulk.quiet_msec);
+    bulk.mode = BULK_HOLDING;
+    bulk.t_start = hh_monotime_us();
+    event_add_timer_msec(dplane_get_thread_master(), dp_bulk_check, NULL,
+            MAX(bulk.quiet_msec / 4, DP_BULK_MIN_CHECK_MSEC), &bulk.ev_check);
+}
+
+/* finalize bulk-load mode: contexts still held are failed back to zebra */
+void fini_dp_bulk(void)
+{
+    EVENT_OFF(bulk.ev_check);
+    EVENT_OFF(bulk.ev_stream);
+
+    if (bulk.next < bulk.count) {
+        zlog_warn("Failing %zu route contexts held for bulk-load", bulk.count - bulk.next);
+        for (; bulk.next < bulk.count; bulk.next++) {
+            dplane_ctx_set_status(bulk.entries[bulk.next].ctx, ZEBRA_DPLANE_REQUEST_FAILURE);
+            dplane_provider_enqueue_out_ctx(prov_p, bulk.entries[bulk.next].ctx);
+            bulk.entries[bulk.next].ctx = NULL;
+        }
+        dplane_provider_work_ready();
+    }
+    if (bulk.entries)
+        XFREE(MTYPE_HH_DP_BULK, bulk.entries);
+    bulk.count = bulk.capacity = bulk.next = 0;
+    bulk.mode = BULK_DONE;
+}
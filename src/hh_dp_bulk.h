@@ -0,0 +1,31 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef SRC_HH_DP_BULK_H_
+#define SRC_HH_DP_BULK_H_
+
+#include <stdbool.h>
+#include "zebra/zebra_dplane.h"
+#include "lib/vty.h"
+#include "lib/json.h"
+
+/* callback to send a route context to dataplane, once released from the bulk load */
+typedef void (*dp_bulk_send_cb)(struct zebra_dplane_ctx *ctx);
+
+/* initialize / finalize bulk-load mode */
+void init_dp_bulk(dp_bulk_send_cb send_cb);
+void fini_dp_bulk(void);
+
+/* set the quiet period (msec) that marks the end of initial convergence. 0 disables bulk loading */
+int dp_bulk_set_quiet_msec(const char *value);
+
+/* zebra notified a startup stage */
+void dp_bulk_startup_stage(void);
+
+/* hold a route context if in bulk-load mode. Returns true if the context was held */
+bool dp_bulk_hold(struct zebra_dplane_ctx *ctx);
+
+/* vty: show bulk-load status */
+void hh_vty_show_bulk(struct vty *vty);
+struct json_object *hh_json_bulk(void);
+
+#endif /* SRC_HH_DP_BULK_H_ */
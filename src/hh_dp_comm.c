@@ -21,18 +21,31 @@
 #include "hh_dp_msg.h"
 #include "hh_dp_msg_cache.h"
 #include "hh_dp_rpc_stats.h"
+#include "hh_dp_state.h"
+#include "hh_dp_journal.h"
+#include "hh_dp_audit.h"
+#include "hh_dp_standby.h"
+#include "hh_dp_conv.h"
+#include "hh_dp_cpu.h"
+#include "hh_dp_shm.h"
+#include "hh_dp_metrics.h"
+#include "hh_dp_usdt.h"
+#include "hh_dp_trace.h"
+#include "hh_dp_budget.h"
 
 /* fw decl */
+struct dp_shard;
 static void dp_connect(struct event *e);
+static void dp_shard_connect(struct dp_shard *sh);
 static void dp_send_keepalive(struct event *e);
-static void wakeon_dp_write_avail(void);
+static void wakeon_dp_write_avail(struct dp_shard *sh);
+static void dp_tx_kick(struct dp_shard *sh);
 
 #define DPLANE_CONNECT_SEC 5 /* default connection-retry timer value */
 #define DPLANE_KEEPALIVE_SEC 5 /* keepalive timer */
 #define NO_SOCK -1 /* sock descriptor initializer */
-
-/* max length of unix sock */
-#define MAX_SUN_PATH sizeof(((struct sockaddr_un*)0)->sun_path)
+#define DP_TX_BATCH 64 /* max datagrams sent with a single syscall */
+#define DP_TX_MAX_GAP_USEC 1000000 /* inter-arrival times are capped to this when averaged */
 
 /* default paths */
 #define DFLT_LOC_DPSOCK_PATH "/var/run/frr/hhplugin.sock"
@@ -43,25 +56,66 @@ _Static_assert ((sizeof(DFLT_REM_DPSOCK_PATH) <= MAX_SUN_PATH), "Path exceeds un
 /* statics */
 static char plugin_sock_path[MAX_SUN_PATH + 1] = DFLT_LOC_DPSOCK_PATH;
 static char dp_sock_path[MAX_SUN_PATH + 1] = DFLT_REM_DPSOCK_PATH;
-static struct event *ev_connect_timer = NULL;
-static struct event *ev_recv = NULL;
-static struct event *ev_send = NULL;
 static struct event *ev_keepalive = NULL;
-static int dp_sock = NO_SOCK;
-static bool dp_sock_connected = false;
 static buff_t *tx_buff;
+static buff_t *tx_batch[DP_TX_BATCH];
 static buff_t *rx_buff;
 static struct fmt_buff FB = {0};
-static bool __dplane_is_ready = false;
 static uint64_t synt = 0;
 
+/* Sockets to dataplane. The RPC stream is sharded over dp_num_shards sockets, by the vrf
+ * and table of the objects, so that dataplane can serve them in parallel. Each shard is
+ * an ordered stream with its own seqn space. Shard 0 uses the configured paths and shard
+ * n those paths suffixed with ".n" */
+static struct dp_shard {
+    uint8_t id;
+    int sock;
+    bool connected;
+    bool ready;                         /* Connect acked */
+    char local_path[MAX_SUN_PATH + 1];
+    char remote_path[MAX_SUN_PATH + 1];
+    struct event *ev_connect_timer;
+    struct event *ev_recv;
+    struct event *ev_send;
+    uint64_t last_tx;                   /* usec of last successful tx */
+    uint64_t last_rx;                   /* usec of last successful rx */
+
+    /* stats */
+    _Atomic uint64_t tx;
+    _Atomic uint64_t tx_failure;
+    _Atomic uint64_t rx;
+    _Atomic uint64_t connects;
+} shards[DP_MAX_SHARDS];
+static uint8_t dp_num_shards = 1;
+
+/* Coalescing of outbound messages. When messages arrive fast enough, they are held for a
+ * short window so that they are sent in batches. The window is capped by a fraction of the
+ * RTT and messages are sent right away when they arrive too sparsely to fill a batch */
+static struct dp_tx_window {
+    _Atomic uint32_t max_usec;  /* max time to hold messages. 0 disables coalescing */
+    _Atomic uint32_t max_msgs;  /* number of messages that triggers a send */
+    uint64_t last_arrival;
+    uint64_t gap_avg;           /* smoothed inter-arrival time (usec) */
+    _Atomic uint64_t srtt;      /* smoothed round-trip time (usec) */
+    struct event *ev_flush;
+
+    /* stats */
+    _Atomic uint64_t flush_idle;    /* messages sent right away */
+    _Atomic uint64_t flush_full;    /* batches sent when full */
+    _Atomic uint64_t flush_timer;   /* batches sent when the window expired */
+    _Atomic uint64_t tx_syscalls;
+    _Atomic uint64_t tx_batched;    /* messages sent with those syscalls */
+} tx_window = {
+    .max_msgs = DP_TX_BATCH,
+};
+
 /* global */
 struct fmt_buff *fb = NULL;
-bool log_dataplane_msg = true;
+bool log_dataplane_msg = false; /* verbose logging: messages are traced anyway */
 bool finalizing = false;
 
 /* tell if a unix path is valid */
-static bool is_valid_unix_path(const char *path)
+bool is_valid_unix_path(const char *path)
 {
     size_t path_len = strlen(path);
     if (!path_len || path_len > MAX_SUN_PATH) {
@@ -97,14 +151,62 @@ int set_dp_sock_remote_path(const char *path)
     return 0;
 }
 
-/* mark state of dataplane: readiness happens when DP replies to Connect successfully */
-void dplane_set_ready(bool ready) {
-    __dplane_is_ready = ready;
+/* set the number of sockets to shard the RPC stream over */
+int set_dp_num_shards(const char *num)
+{
+    BUG(!num, -1);
+    char *end;
+    unsigned long n = strtoul(num, &end, 10);
+
+    if (*end || n < 1 || n > DP_MAX_SHARDS) {
+        zlog_err("Invalid number of dataplane sockets '%s' (must be 1-%u)", num, DP_MAX_SHARDS);
+        return -1;
+    }
+    dp_num_shards = (uint8_t)n;
+    zlog_debug("Configured %u dataplane sockets", dp_num_shards);
+    return 0;
+}
+
+/* number of sockets the RPC stream is sharded over */
+uint8_t dplane_num_shards(void) {
+    return dp_num_shards;
+}
+
+/* shard of an object: all of the objects of a (vrf, table) go over the same socket */
+uint8_t dplane_shard_of(const struct RpcObject *object)
+{
+    BUG(!object, 0);
+    uint32_t vrfid = 0, tableid = 0;
+
+    if (dp_num_shards == 1)
+        return 0;
+
+    switch (object->type) {
+        case IpRoute:
+            vrfid = object->route.vrfid;
+            tableid = object->route.tableid;
+            break;
+        case IfAddress:
+            vrfid = object->ifaddress.vrfid;
+            break;
+        default:
+            break;
+    }
+    uint32_t h = (vrfid * 0x9e3779b1u) ^ (tableid * 0x85ebca77u);
+    h ^= h >> 16;
+    return (uint8_t)(h % dp_num_shards);
+}
+
+/* mark state of a shard: readiness happens when DP replies to its Connect successfully */
+void dplane_set_ready(uint8_t shard, bool ready) {
+    BUG(shard >= DP_MAX_SHARDS);
+    shards[shard].ready = ready;
 }
 
 /* set the synt */
 void dplane_set_synt(uint64_t value) {
     synt = value;
+    dp_journal_set_synt(value);
 }
 
 /* get the synt */
@@ -112,36 +214,67 @@ uint64_t dplane_get_synt(void) {
     return synt;
 }
 
-/* Tell if communication with dataplane has been established */
+/* Tell if communication with dataplane has been established, over all sockets */
 bool dplane_is_ready(void) {
-    return __dplane_is_ready;
+    for (uint8_t i = 0; i < dp_num_shards; i++)
+        if (!shards[i].ready)
+            return false;
+    return true;
 }
 
-/* Tell if dataplane socket is connected */
+/* Tell if dataplane sockets are connected */
 bool dplane_sock_is_connected(void) {
-    return dp_sock_connected;
+    for (uint8_t i = 0; i < dp_num_shards; i++)
+        if (!shards[i].connected)
+            return false;
+    return true;
+}
+
+/* set the paths of the sockets of the shards */
+static int dp_shard_set_paths(void)
+{
+    for (uint8_t i = 0; i < dp_num_shards; i++) {
+        struct dp_shard *sh = &shards[i];
+        int r1, r2;
+
+        if (i == 0) {
+            r1 = snprintf(sh->local_path, sizeof(sh->local_path), "%s", plugin_sock_path);
+            r2 = snprintf(sh->remote_path, sizeof(sh->remote_path), "%s", dp_sock_path);
+        } else {
+            r1 = snprintf(sh->local_path, sizeof(sh->local_path), "%s.%u", plugin_sock_path, i);
+            r2 = snprintf(sh->remote_path, sizeof(sh->remote_path), "%s.%u", dp_sock_path, i);
+        }
+        if (r1 >= (int)MAX_SUN_PATH || r2 >= (int)MAX_SUN_PATH) {
+            zlog_err("Unix socket paths for dataplane socket %u are too long", i);
+            return -1;
+        }
+    }
+    return 0;
 }
 
 /*
  * Close unix socket to dataplane
  */
-static void dp_unix_sock_close(void)
+static void dp_unix_sock_close(struct dp_shard *sh)
 {
-    if (dp_sock != NO_SOCK) {
-        zlog_debug("Closing socket to dataplane...");
-        close(dp_sock);
-        dp_sock = NO_SOCK;
-        dp_sock_connected = false;
-        dplane_set_ready(false);
+    if (sh->sock != NO_SOCK) {
+        zlog_debug("Closing socket %u to dataplane...", sh->id);
+        EVENT_OFF(sh->ev_send);
+        EVENT_OFF(sh->ev_recv);
+        close(sh->sock);
+        sh->sock = NO_SOCK;
+        sh->connected = false;
+        dplane_set_ready(sh->id, false);
+        dp_audit_abort("connection closed");
     }
-    if (unlink(plugin_sock_path) == 0)
-        zlog_debug("Deleted unix path at '%s'", plugin_sock_path);
+    if (sh->local_path[0] && unlink(sh->local_path) == 0)
+        zlog_debug("Deleted unix path at '%s'", sh->local_path);
 }
 
 /*
  * Open a Unix socket and bind it to the specified path.
  */
-static int dp_unix_sock_open(const char *bind_path)
+int dp_unix_sock_open(const char *bind_path)
 {
     BUG(!bind_path, -1);
 
@@ -192,19 +325,19 @@ fail:
     return NO_SOCK;
 }
 
-static void dp_unix_sock_reopen(void)
+static void dp_unix_sock_reopen(struct dp_shard *sh)
 {
-    dp_unix_sock_close();
-    dp_sock = dp_unix_sock_open(plugin_sock_path);
-    if (dp_sock == NO_SOCK) {
-        zlog_err("Fatal: could not create socket to dataplane");
+    dp_unix_sock_close(sh);
+    sh->sock = dp_unix_sock_open(sh->local_path);
+    if (sh->sock == NO_SOCK) {
+        zlog_err("Fatal: could not create socket %u to dataplane", sh->id);
     }
 }
 
 /*
  * Connect unix socket to the specified path
  */
-static int dp_unix_connect(const char *conn_path)
+int dp_unix_sock_connect(int sock, const char *conn_path)
 {
     BUG(!conn_path, -1);
 
@@ -221,22 +354,29 @@ static int dp_unix_connect(const char *conn_path)
 
     /* connect */
     zlog_debug("Connecting unix socket to '%s'...", conn_path);
-    if (connect(dp_sock, (const struct sockaddr *)&dst, sizeof(dst)) < 0) {
+    if (connect(sock, (const struct sockaddr *)&dst, sizeof(dst)) < 0) {
         if (errno == EISCONN)
             return 0;
-        zlog_err("Failed to connect to dataplane: %s", strerror(errno));
-        dp_unix_sock_reopen();
+        zlog_err("Failed to connect to '%s': %s", conn_path, strerror(errno));
         return -1;
     }
     zlog_info("Successfully connected unix sock to '%s'", conn_path);
     return 0;
 }
+static int dp_unix_connect(struct dp_shard *sh)
+{
+    if (dp_unix_sock_connect(sh->sock, sh->remote_path) != 0) {
+        dp_unix_sock_reopen(sh);
+        return -1;
+    }
+    return 0;
+}
 
-/* tells if a msg can be xmited. Connects always can */
-static inline bool can_send_rpc_request(struct RpcMsg *msg)
+/* tells if a msg can be xmited over a shard. Connects always can */
+static inline bool can_send_rpc_request(struct dp_shard *sh, struct RpcMsg *msg)
 {
     BUG(!msg, false);
-    if ((msg->type == Request && msg->request.op == Connect) || dplane_is_ready()) {
+    if ((msg->type == Request && msg->request.op == Connect) || sh->ready) {
         return true;
     } else {
         if (log_dataplane_msg)
@@ -246,135 +386,372 @@ static inline bool can_send_rpc_request(struct RpcMsg *msg)
     }
 }
 
-/*
- * Sending of a single RpcMsg. This function should only return success (0)
- * if the message was successfully sent over the socket.
- */
-static int do_send_rpc_msg(struct RpcMsg *msg)
+/* handle an error sending to dataplane */
+static void dp_sock_send_error(struct dp_shard *sh, int _err)
 {
-    BUG(!msg, -1);
-    BUG(!tx_buff, -1);
+    (_err != EAGAIN) ? rpc_count_tx_failure() : rpc_count_tx_eagain();
+    if (_err != EAGAIN)
+        atomic_fetch_add_explicit(&sh->tx_failure, 1, memory_order_relaxed);
+
+    switch(_err) {
+        case ENOBUFS:
+        case ENOMEM:
+            zlog_err("Temporary error sending msg to dataplane: %s(%d)", strerror(_err), _err);
+        /* fallthrough */
+        case EAGAIN:
+        /* sock is not writable at this point: register callback for later xmit */
+            wakeon_dp_write_avail(sh);
+            return;
+        case EINTR:
+            zlog_warn("Tx to dataplane was interrupted!");
+            return;
+        /* errors that require reconnecting */
+        case EPIPE:
+        case ENOTCONN:
+        case ECONNREFUSED:
+        case ECONNRESET:
+            zlog_err("Connection error sending msg to dataplane: %s(%d)", strerror(_err), _err);
+            sh->connected = false;
+            dplane_set_ready(sh->id, false);
+            if (!sh->ev_connect_timer)
+                dp_shard_connect(sh);
+            return;
+        default:
+            zlog_err("Error sending msg to dataplane: %s(%d)", strerror(_err), _err);
+            return;
+    }
+}
+
+/* encode a message into a tx buffer, if it can be sent */
+static int dp_encode_rpc_msg(struct dp_shard *sh, struct RpcMsg *msg, buff_t *buff)
+{
+    struct hh_cpu_frame cpu;
 
     /* check if we're allowed to send message */
-    if (!can_send_rpc_request(msg))
+    if (!can_send_rpc_request(sh, msg))
         return -1;
 
-    if (log_dataplane_msg && msg->type != Control)
+    if (log_dataplane_msg && msg->type != Control) {
+        hh_cpu_begin(&cpu);
         zlog_debug("Sending %s", fmt_rpc_msg(fb, true, msg));
+        hh_cpu_end(&cpu, HH_CPU_LOG, 1);
+    }
 
     /* encode the message into the tx buffer */
-    buff_clear(tx_buff);
-    int r = encode_msg(tx_buff, msg);
+    hh_cpu_begin(&cpu);
+    buff_clear(buff);
+    int r = encode_msg(buff, msg);
+    hh_cpu_end(&cpu, HH_CPU_ENCODE, 1);
     if (r != E_OK ) {
         rpc_count_encode_failure();
         zlog_err("Fatal: failed to encode RPC message: %s", err2str(r));
         return -1;
     }
+    return 0;
+}
+
+/*
+ * Sending of a single RpcMsg. This function should only return success (0)
+ * if the message was successfully sent over the socket.
+ */
+static int do_send_rpc_msg(struct dp_shard *sh, struct RpcMsg *msg)
+{
+    BUG(!msg, -1);
+    BUG(!tx_buff, -1);
+
+    if (dp_encode_rpc_msg(sh, msg, tx_buff) != 0)
+        return -1;
 
     /* send the buffer: we never block */
-    r = send(dp_sock, tx_buff->storage, tx_buff->w, MSG_DONTWAIT);
+    struct hh_cpu_frame cpu;
+    hh_cpu_begin(&cpu);
+    int r = send(sh->sock, tx_buff->storage, tx_buff->w, MSG_DONTWAIT);
+    hh_cpu_end(&cpu, HH_CPU_SEND, 1);
     if (r == -1) {
-        int _err = errno;
-        (_err != EAGAIN) ? rpc_count_tx_failure() : rpc_count_tx_eagain();
-
-        switch(_err) {
-            case ENOBUFS:
-            case ENOMEM:
-                zlog_err("Temporary error sending msg to dataplane: %s(%d)", strerror(_err), _err);
-            /* fallthrough */
-            case EAGAIN:
-            /* sock is not writable at this point: register callback for later xmit */
-                wakeon_dp_write_avail();
-                return -1;
-            case EINTR:
-                zlog_warn("Tx to dataplane was interrupted!");
-                return -1;
-            /* errors that require reconnecting */
-            case EPIPE:
-            case ENOTCONN:
-            case ECONNREFUSED:
-            case ECONNRESET:
-                zlog_err("Connection error sending msg to dataplane: %s(%d)", strerror(_err), _err);
-                dp_sock_connected = false;
-                dplane_set_ready(false);
-                if (!ev_connect_timer)
-                    dp_connect(NULL);
-                return -1;
-            default:
-                zlog_err("Error sending msg to dataplane: %s(%d)", strerror(_err), _err);
-                return -1;
-        }
+        dp_sock_send_error(sh, errno);
+        return -1;
     } else if ((index_t)r != tx_buff->w) {
         zlog_err("Error sending msg to dataplane: only %u out of %u octets sent", r, tx_buff->w);
         return -1;
     }
     /* success */
+    HH_USDT_PROBE(send, HH_USDT_SEQN(msg), HH_USDT_OP(msg), HH_USDT_OTYPE(msg), r, sh->id, (int)msg->type);
     rpc_count_tx();
+    atomic_fetch_add_explicit(&sh->tx, 1, memory_order_relaxed);
+    sh->last_tx = hh_monotime_us();
     return 0;
 }
 
-/* Drain the unsent queue for xmit */
-void send_pending_rpc_msgs(void)
+/* a message was sent: if it is a request, move it to in-flight list; else, recycle it */
+static void dp_msg_sent(struct dp_msg *m, uint64_t now)
 {
-    /// can connect's make it to this queue?
-    /// if not, we can check here dplane_ready
-    /// this way we don't need to pop a message
-    /// check and then push_back on fail.
+    struct hh_cpu_frame cpu;
 
+    hh_cpu_begin(&cpu);
+    hh_trace_msg(HH_TRACE_TX, m->shard, &m->msg);
+    hh_cpu_end(&cpu, HH_CPU_LOG, 1);
 
-    /* Drain the unsent list (from head) until no more messages, or xmit fails */
-    struct dp_msg *m;
-    while((m = dp_msg_pop_unsent()) != NULL) {
-        if (do_send_rpc_msg(&m->msg) == 0) {
-            /* Tx succeeded: if msg is request, move to in-flight list; else, recycle */
-            if (m->msg.type == Request) {
-                rpc_count_request_sent(m->msg.request.op, m->msg.request.object.type);
-                dp_msg_cache_inflight(m);
-            } else {
-                if (m->msg.type == Control)
-                    rpc_count_ctl_tx();
+    if (m->msg.type == Request) {
+        m->ts_sent = now;
+        rpc_count_request_sent(m->msg.request.op, m->msg.request.object.type);
+        dp_msg_cache_inflight(m);
+    } else {
+        if (m->msg.type == Control)
+            rpc_count_ctl_tx();
 
-                dp_msg_recycle(m);
+        dp_msg_recycle(m);
+    }
+}
+
+/* Drain the unsent queue of a shard for xmit. Messages are sent in batches with sendmmsg() */
+static void dp_shard_send_pending(struct dp_shard *sh)
+{
+    struct dp_msg *batch[DP_TX_BATCH];
+    struct mmsghdr hdrs[DP_TX_BATCH];
+    struct iovec iovs[DP_TX_BATCH];
+    struct hh_budget_pass pass;
+    bool stop = false;
+    uint64_t t_try = hh_monotime_us();
+
+    /* Drain the unsent list (from head) until no more messages, xmit fails or we run out of budget */
+    hh_budget_begin(&pass, HH_BUDGET_TX);
+    while(!stop && hh_budget_left(&pass)) {
+        struct dp_msg *m;
+        int n = 0;
+
+        /* pop and encode a batch */
+        while (n < DP_TX_BATCH && (!pass.max_msgs || pass.msgs + n < pass.max_msgs) &&
+               (m = dp_msg_pop_unsent(sh->id)) != NULL) {
+            if (dp_encode_rpc_msg(sh, &m->msg, tx_batch[n]) != 0) {
+                /* cannot send: put msg back at head of unsent list */
+                dp_msg_unsent_push_back(m);
+                stop = true;
+                break;
             }
-        } else {
-            /* send failed: put msg back at head of unsent list */
-            dp_msg_unsent_push_back(m);
+            if (!m->ts_tx_try)
+                m->ts_tx_try = t_try;
+            iovs[n].iov_base = tx_batch[n]->storage;
+            iovs[n].iov_len = tx_batch[n]->w;
+            memset(&hdrs[n], 0, sizeof(hdrs[n]));
+            hdrs[n].msg_hdr.msg_iov = &iovs[n];
+            hdrs[n].msg_hdr.msg_iovlen = 1;
+            batch[n++] = m;
+        }
+        if (!n)
+            break;
 
-            /* do not attempt to send more */
-            return;
+        /* send the batch: we never block */
+        struct hh_cpu_frame cpu;
+        hh_cpu_begin(&cpu);
+        int sent = sendmmsg(sh->sock, hdrs, (unsigned int)n, MSG_DONTWAIT);
+        int _err = errno;
+        hh_cpu_end(&cpu, HH_CPU_SEND, (uint32_t)MAX(sent, 0));
+        uint64_t now = hh_monotime_us();
+
+        atomic_fetch_add_explicit(&tx_window.tx_syscalls, 1, memory_order_relaxed);
+        for (int i = 0; i < sent; i++) {
+            HH_USDT_PROBE(send, HH_USDT_SEQN(&batch[i]->msg), HH_USDT_OP(&batch[i]->msg),
+                          HH_USDT_OTYPE(&batch[i]->msg), (int)iovs[i].iov_len, sh->id, (int)batch[i]->msg.type);
+            rpc_count_tx();
+            dp_msg_sent(batch[i], now);
+        }
+        if (sent > 0) {
+            atomic_fetch_add_explicit(&tx_window.tx_batched, sent, memory_order_relaxed);
+            atomic_fetch_add_explicit(&sh->tx, sent, memory_order_relaxed);
+            pass.msgs += sent;
+            sh->last_tx = now;
+        }
+
+        /* put back at head of unsent list what was not sent, keeping the order */
+        for (int i = n - 1; i >= MAX(sent, 0); i--)
+            dp_msg_unsent_push_back(batch[i]);
+
+        /* do not attempt to send more if some message could not be sent */
+        if (sent < 0) {
+            dp_sock_send_error(sh, _err);
+            stop = true;
+        } else if (sent < n) {
+            wakeon_dp_write_avail(sh);
+            stop = true;
         }
     }
+
+    /* out of budget: resume when the event loop gets back to us */
+    bool exhausted = !stop && dp_msg_shard_unsent_count(sh->id) != 0;
+    if (exhausted)
+        wakeon_dp_write_avail(sh);
+    hh_budget_end(&pass, exhausted);
+}
+
+/* Drain the unsent queues of all shards */
+void send_pending_rpc_msgs(void)
+{
+    for (uint8_t i = 0; i < dp_num_shards; i++)
+        if (dp_msg_shard_unsent_count(i))
+            dp_shard_send_pending(&shards[i]);
 }
 
 /* write callback */
 static void dp_sock_send_cb(struct event *ev)
 {
-    BUG(ev->ref != &ev_send);
+    struct dp_shard *sh = EVENT_ARG(ev);
+    BUG(ev->ref != &sh->ev_send);
 
     zlog_debug("Attempting to send pending messages...");
-    size_t pend_msg = dp_msg_unsent_count();
+    size_t pend_msg = dp_msg_shard_unsent_count(sh->id);
     if (!pend_msg) {
         zlog_debug("No pending messages to send");
         return;
     }
     zlog_debug("There are %zu pending messages", pend_msg);
 
-    send_pending_rpc_msgs();
+    dp_shard_send_pending(sh);
 
     /* if we did not finish, sched write */
-    pend_msg = dp_msg_unsent_count();
+    pend_msg = dp_msg_shard_unsent_count(sh->id);
     if (pend_msg)
-        wakeon_dp_write_avail();
+        wakeon_dp_write_avail(sh);
+}
+static void wakeon_dp_write_avail(struct dp_shard *sh)
+{
+    if (!sh->ev_send) {
+        zlog_info("Requesting dp-sock %u write availability notification...", sh->id);
+        event_add_write(dplane_get_thread_master(), dp_sock_send_cb, sh, sh->sock, &sh->ev_send);
+        assert(sh->ev_send != NULL);
+    }
+}
+
+
+/* time to hold messages for a batch to fill */
+static uint32_t dp_tx_window_usec(void)
+{
+    uint32_t window = atomic_load_explicit(&tx_window.max_usec, memory_order_relaxed);
+    uint64_t srtt = atomic_load_explicit(&tx_window.srtt, memory_order_relaxed);
+
+    /* waiting longer than half the RTT delays messages for little gain */
+    if (srtt && srtt / 2 < window)
+        window = (uint32_t)(srtt / 2);
+    return window;
+}
+
+/* the coalescing window expired */
+static void dp_tx_flush(struct event *ev)
+{
+    atomic_fetch_add_explicit(&tx_window.flush_timer, 1, memory_order_relaxed);
+    for (uint8_t i = 0; i < dp_num_shards; i++)
+        if (!shards[i].ev_send && dp_msg_shard_unsent_count(i))
+            dp_shard_send_pending(&shards[i]);
+}
+
+/* a message was queued for xmit on a shard: send it now, or hold it for a batch to fill */
+static void dp_tx_kick(struct dp_shard *sh)
+{
+    uint64_t now = hh_monotime_us();
+    uint64_t gap = tx_window.last_arrival ? MIN(now - tx_window.last_arrival, DP_TX_MAX_GAP_USEC) : DP_TX_MAX_GAP_USEC;
+
+    tx_window.last_arrival = now;
+    tx_window.gap_avg = tx_window.gap_avg ? (7 * tx_window.gap_avg + gap) / 8 : gap;
+
+    /* a write notification is pending: the socket is full or the last drain ran out of budget */
+    if (sh->ev_send)
+        return;
+
+    /* coalescing is disabled */
+    uint32_t window = dp_tx_window_usec();
+    if (!window) {
+        dp_shard_send_pending(sh);
+        return;
+    }
+
+    /* batch is full. Batches of other shards keep filling until the window expires */
+    if (dp_msg_shard_unsent_count(sh->id) >= atomic_load_explicit(&tx_window.max_msgs, memory_order_relaxed)) {
+        if (dp_msg_unsent_count() == dp_msg_shard_unsent_count(sh->id))
+            EVENT_OFF(tx_window.ev_flush);
+        atomic_fetch_add_explicit(&tx_window.flush_full, 1, memory_order_relaxed);
+        dp_shard_send_pending(sh);
+        return;
+    }
+
+    /* a batch is being filled */
+    if (tx_window.ev_flush)
+        return;
+
+    /* idle: messages do not arrive fast enough for a batch to fill within the window */
+    if (gap >= window || 2 * tx_window.gap_avg > window) {
+        atomic_fetch_add_explicit(&tx_window.flush_idle, 1, memory_order_relaxed);
+        dp_shard_send_pending(sh);
+        return;
+    }
+
+    struct timeval tv = { .tv_sec = window / 1000000, .tv_usec = window % 1000000 };
+    event_add_timer_tv(dplane_get_thread_master(), dp_tx_flush, NULL, &tv, &tx_window.ev_flush);
 }
-static void wakeon_dp_write_avail(void)
+
+/* account the round-trip time of a request */
+void dp_tx_note_rtt(uint64_t rtt)
+{
+    uint64_t srtt = atomic_load_explicit(&tx_window.srtt, memory_order_relaxed);
+    srtt = srtt ? (7 * srtt + rtt) / 8 : rtt;
+    atomic_store_explicit(&tx_window.srtt, srtt, memory_order_relaxed);
+}
+
+/* configure coalescing of outbound messages */
+int dp_tx_set_window(uint32_t max_usec, uint32_t max_msgs)
 {
-    if (!ev_send) {
-        zlog_info("Requesting dp-sock write availability notification...");
-        event_add_write(dplane_get_thread_master(), dp_sock_send_cb, NULL, dp_sock, &ev_send);
-        assert(ev_send != NULL);
+    if (!max_msgs || max_msgs > DP_TX_BATCH) {
+        zlog_err("Invalid coalescing batch size %u (must be 1-%u)", max_msgs, DP_TX_BATCH);
+        return -1;
     }
+    atomic_store_explicit(&tx_window.max_usec, max_usec, memory_order_relaxed);
+    atomic_store_explicit(&tx_window.max_msgs, max_msgs, memory_order_relaxed);
+    zlog_info("Coalescing of outbound messages set to %u usec, %u msgs", max_usec, max_msgs);
+    return 0;
 }
 
+/* vty: show coalescing of outbound messages */
+#define GET_TXW_COUNT(name) atomic_load_explicit(&tx_window.name, memory_order_relaxed)
+
+/* vty: write the coalescing window, if set, to the running config */
+int dp_tx_window_config_write(struct vty *vty)
+{
+    BUG(!vty, 0);
+    if (!GET_TXW_COUNT(max_usec) && GET_TXW_COUNT(max_msgs) == DP_TX_BATCH)
+        return 0;
+    vty_out(vty, "hedgehog rpc coalesce window %u msgs %u\n", GET_TXW_COUNT(max_usec), GET_TXW_COUNT(max_msgs));
+    return 1;
+}
+void hh_vty_show_tx_window(struct vty *vty)
+{
+    BUG(!vty);
+    uint64_t syscalls = GET_TXW_COUNT(tx_syscalls);
+
+    vty_out(vty, "  ────────────────────────────────────────────── Tx coalescing ───────────────────────────────────────────\n");
+    if (GET_TXW_COUNT(max_usec))
+        vty_out(vty, "   window: max %u usec, %u msgs (current %u usec)\n", GET_TXW_COUNT(max_usec),
+                GET_TXW_COUNT(max_msgs), dp_tx_window_usec());
+    else
+        vty_out(vty, "   window: disabled\n");
+    vty_out(vty, "   smoothed rtt: %"PRIu64" usec\n", GET_TXW_COUNT(srtt));
+    vty_out(vty, "   sent right away: %"PRIu64", batches full: %"PRIu64", batches on timeout: %"PRIu64"\n",
+            GET_TXW_COUNT(flush_idle), GET_TXW_COUNT(flush_full), GET_TXW_COUNT(flush_timer));
+    vty_out(vty, "   tx syscalls: %"PRIu64", msgs per syscall: %.2f\n", syscalls,
+            syscalls ? (double)GET_TXW_COUNT(tx_batched) / syscalls : 0.0);
+}
+struct json_object *hh_json_tx_window(void)
+{
+    struct json_object *json = json_object_new_object();
+
+    json_object_int_add(json, "maxUsec", GET_TXW_COUNT(max_usec));
+    json_object_int_add(json, "maxMsgs", GET_TXW_COUNT(max_msgs));
+    json_object_int_add(json, "currentUsec", GET_TXW_COUNT(max_usec) ? dp_tx_window_usec() : 0);
+    json_object_int_add(json, "srttUsec", GET_TXW_COUNT(srtt));
+    json_object_int_add(json, "flushIdle", GET_TXW_COUNT(flush_idle));
+    json_object_int_add(json, "flushFull", GET_TXW_COUNT(flush_full));
+    json_object_int_add(json, "flushTimer", GET_TXW_COUNT(flush_timer));
+    json_object_int_add(json, "txSyscalls", GET_TXW_COUNT(tx_syscalls));
+    json_object_int_add(json, "txBatched", GET_TXW_COUNT(tx_batched));
+    return json;
+}
 
 /* Main function to send an RPC message. The dp_msg is not sent straight but queued in the
  * unsent queue (to preserve ordering) and any prior pending messages are sent first, by
@@ -384,12 +761,13 @@ static void wakeon_dp_write_avail(void)
 int send_rpc_msg(struct dp_msg *dp_msg)
 {
     BUG(!dp_msg, -1);
+    BUG(dp_msg->shard >= dp_num_shards, -1);
+    struct dp_shard *sh = &shards[dp_msg->shard];
 
     /* If we get a message for xmit and is a Connect, let it overtake all prior cached requests */
     if (dp_msg->msg.type == Request && dp_msg->msg.request.op == Connect) {
-        if (do_send_rpc_msg(&dp_msg->msg) == 0) {
-            rpc_count_request_sent(dp_msg->msg.request.op, dp_msg->msg.request.object.type);
-            dp_msg_cache_inflight(dp_msg);
+        if (do_send_rpc_msg(sh, &dp_msg->msg) == 0) {
+            dp_msg_sent(dp_msg, sh->last_tx);
             return 0;
         } else {
             zlog_err("Failed to send Connect request");
@@ -402,11 +780,17 @@ int send_rpc_msg(struct dp_msg *dp_msg)
             return -1;
         }
     } else {
+        HH_USDT_PROBE(enqueue, dp_msg->ctx, HH_USDT_SEQN(&dp_msg->msg), HH_USDT_OP(&dp_msg->msg),
+                      HH_USDT_OTYPE(&dp_msg->msg), dp_msg->shard);
+
+        /* copy requests to the standby dataplane, if any */
+        dp_standby_mirror(dp_msg);
+
         /* cache at tail of unsent list */
         dp_msg_cache_unsent(dp_msg);
 
-        /* send messages in the unsent list */
-        send_pending_rpc_msgs();
+        /* send messages in the unsent list, now or when a batch fills up */
+        dp_tx_kick(sh);
 
         /* Success does not necessarily imply that a message has been sent, but that the sending
          * logic takes care of sending it when possible */
@@ -417,14 +801,17 @@ int send_rpc_msg(struct dp_msg *dp_msg)
 /*
  * Actual recv on Unix sock
  */
-static int sock_recv(buff_t *buff)
+static int sock_recv(struct dp_shard *sh, buff_t *buff)
 {
     buff_clear(buff);
 
      /* plugin always does non-blocking rx's */
-     int r = recv(dp_sock, buff->storage, buff->capacity, MSG_DONTWAIT);
+     struct hh_cpu_frame cpu;
+     hh_cpu_begin(&cpu);
+     int r = recv(sh->sock, buff->storage, buff->capacity, MSG_DONTWAIT);
+     int _err = errno;
+     hh_cpu_end(&cpu, HH_CPU_RECV, r > 0);
      if (r == -1) {
-         int _err = errno;
          (_err != EAGAIN) ? rpc_count_rx_failure() : rpc_count_rx_eagain();
          switch(_err) {
              case EAGAIN:
@@ -440,7 +827,10 @@ static int sock_recv(buff_t *buff)
          }
      }
      buff->w = (index_t)r;
+     HH_USDT_PROBE(recv, r, sh->id);
      rpc_count_rx();
+     atomic_fetch_add_explicit(&sh->rx, 1, memory_order_relaxed);
+     sh->last_rx = hh_monotime_us();
      return r;
 }
 
@@ -451,78 +841,242 @@ static int sock_recv(buff_t *buff)
 static void dp_rpc_recv(struct event *ev)
 {
     BUG(!ev);
-    BUG(ev->ref != &ev_recv);
-    int r;
+    struct dp_shard *sh = EVENT_ARG(ev);
+    BUG(ev->ref != &sh->ev_recv);
 
     /* sched next recv */
-    event_add_read(ev->master, dp_rpc_recv, NULL, dp_sock, &ev_recv);
+    event_add_read(ev->master, dp_rpc_recv, sh, sh->sock, &sh->ev_recv);
+
+    /* Receive over sock on rx buff. If we run out of budget, the read event
+     * scheduled above resumes reception after other events are served */
+    struct hh_budget_pass pass;
+    bool exhausted = false;
 
-    /* Receive over sock on rx buff */
-    while((r = sock_recv(rx_buff)) > 0) {
+    hh_budget_begin(&pass, HH_BUDGET_RX);
+    while(sock_recv(sh, rx_buff) > 0) {
         struct RpcMsg msg = {0};
+        struct hh_cpu_frame cpu;
+        pass.msgs++;
 
         /* decode message */
+        hh_cpu_begin(&cpu);
         int r = decode_msg(rx_buff, &msg);
+        hh_cpu_end(&cpu, HH_CPU_DECODE, 1);
         if (r != E_OK) {
             rpc_count_decode_failure();
+            dp_state_invalidate("undecodable message");
             // TODO: this is unrecoverable ... ?
             zlog_err("Error decoding msg from dataplane: %s", err2str(r));
-            return;
+            break;
         }
         /* handle message */
-        handle_rpc_msg(&msg);
+        hh_cpu_begin(&cpu);
+        handle_rpc_msg(sh->id, &msg);
+        hh_cpu_end(&cpu, HH_CPU_HANDLE, 1);
+
+        if (!hh_budget_left(&pass)) {
+            exhausted = true;
+            break;
+        }
     }
+
+    /* return the contexts completed in this pass to zebra at once */
+    dp_msg_hand_off_flush();
+    dp_conv_check_idle();
+    hh_budget_end(&pass, exhausted);
 }
 
 /*
- * Connect to dataplane over unix socket. On failure, schedule another connection
+ * Connect a shard to dataplane over unix socket. On failure, schedule another connection
  * attempt after HH_DPLANE_CONNECT_SEC seconds.  On success, send an RPC request "Connect"
  * with our versioning information and schedule receiving from socket. Upon receiving the
  * response to the connect, if successful, sending of RPC messages should be allowed.
  */
-static void dp_connect(struct event *e)
+static void dp_shard_connect(struct dp_shard *sh)
 {
     struct event_loop *ev_loop = dplane_get_thread_master();
-    if (dp_sock == NO_SOCK) {
+    if (sh->sock == NO_SOCK) {
         zlog_err("Will not attempt to connect to dataplane: have no socket");
         return;
     }
 
-    zlog_debug("Attempting to connect to dataplane at '%s'....", dp_sock_path);
-    int r = dp_unix_connect(dp_sock_path);
+    zlog_debug("Attempting to connect to dataplane at '%s'....", sh->remote_path);
+    int r = dp_unix_connect(sh);
     if (r != 0) {
-        event_add_timer(ev_loop, dp_connect, NULL, DPLANE_CONNECT_SEC, &ev_connect_timer);
+        event_add_timer(ev_loop, dp_connect, sh, DPLANE_CONNECT_SEC, &sh->ev_connect_timer);
     } else {
-        ev_connect_timer = NULL;
-        dp_sock_connected = true;
-        send_rpc_request_connect(); /* always send connect again */
+        EVENT_OFF(sh->ev_connect_timer);
+        sh->connected = true;
+        atomic_fetch_add_explicit(&sh->connects, 1, memory_order_relaxed);
+        send_rpc_request_connect(sh->id); /* always send connect again */
 
         /* sched recv */
-        event_add_read(ev_loop, dp_rpc_recv, NULL, dp_sock, &ev_recv);
+        event_add_read(ev_loop, dp_rpc_recv, sh, sh->sock, &sh->ev_recv);
     }
 }
+static void dp_connect(struct event *e)
+{
+    dp_shard_connect(EVENT_ARG(e));
+}
 
-/* send keepalives if we're connected */
+/* send keepalives if we're connected and the channel has been idle in either direction for
+ * a keepalive interval. Traffic in both directions proves that the peers are alive. Each
+ * shard is probed on its own */
 static void dp_send_keepalive(struct event *e) {
     struct event_loop *ev_loop = dplane_get_thread_master();
+    uint64_t interval = DPLANE_KEEPALIVE_SEC * 1000000ULL;
+    uint64_t now = hh_monotime_us();
+    uint64_t next = interval;
+
+    for (uint8_t i = 0; i < dp_num_shards; i++) {
+        struct dp_shard *sh = &shards[i];
+
+        if (sh->connected && sh->ready) {
+            if (now - sh->last_tx >= interval || now - sh->last_rx >= interval) {
+                send_rpc_control(i, 0);
+                now = hh_monotime_us();
+            } else {
+                rpc_count_ctl_suppressed();
+            }
+        }
 
-    if (dplane_sock_is_connected() && dplane_is_ready()) {
-        send_rpc_control(0);
+        /* check again when the channel may have been idle for an interval */
+        uint64_t since = now - MIN(sh->last_tx, sh->last_rx);
+        next = MIN(next, since < interval ? interval - since : interval);
     }
-    event_add_timer(ev_loop, dp_send_keepalive, NULL, DPLANE_KEEPALIVE_SEC, &ev_keepalive);
+    event_add_timer_msec(ev_loop, dp_send_keepalive, NULL, MAX(next / 1000, 100), &ev_keepalive);
+}
+
+/* Fail over to the standby dataplane. The requests it processed are completed and the
+ * rest are resent to it, after a Connect with its synt. The former primary becomes the standby */
+int dplane_failover(void)
+{
+    struct dp_standby_acks acks = {0};
+    uint64_t synt;
+
+    if (dp_standby_takeover(dp_sock_path, sizeof(dp_sock_path), &synt, &acks) != 0)
+        return -1;
+
+    zlog_info("Failing over to dataplane at '%s' (synt %"PRIu64", processed up to #%"PRIu64")",
+            dp_sock_path, synt, acks.acked);
+    if (dp_shard_set_paths() != 0) {
+        dp_standby_acks_release(&acks);
+        return -1;
+    }
+    for (uint8_t i = 0; i < dp_num_shards; i++) {
+        EVENT_OFF(shards[i].ev_connect_timer);
+        dp_unix_sock_reopen(&shards[i]);
+    }
+    dplane_set_synt(synt);
+    dp_msg_failover(&acks);
+    dp_standby_acks_release(&acks);
+    for (uint8_t i = 0; i < dp_num_shards; i++)
+        dp_shard_connect(&shards[i]);
+    return 0;
+}
+
+static void dplane_failover_ev(struct event *e)
+{
+    dplane_failover();
+}
+
+/* request a failover from another thread */
+void dplane_request_failover(void)
+{
+    event_add_event(dplane_get_thread_master(), dplane_failover_ev, NULL, 0, NULL);
+}
+
+/* vty: show the state of the dataplane sockets */
+void hh_vty_show_shards(struct vty *vty)
+{
+    BUG(!vty);
+
+    vty_out(vty, "  ────────────────────────────────────────────── Sockets ───────────────────────────────────────────────\n");
+    vty_out(vty, " %5.5s %-40.40s %9.9s %5.5s %10.10s %10.10s %10.10s %10.10s %8.8s\n", "shard", "remote path",
+            "connected", "ready", "unsent", "in-flight", "tx", "rx", "connects");
+    for (uint8_t i = 0; i < dp_num_shards; i++) {
+        struct dp_shard *sh = &shards[i];
+        vty_out(vty, " %5u %-40.40s %9.9s %5.5s %10zu %10zu %10"PRIu64" %10"PRIu64" %8"PRIu64"\n", i,
+                sh->remote_path, sh->connected ? "yes" : "no", sh->ready ? "yes" : "no",
+                dp_msg_shard_unsent_count(i), dp_msg_shard_in_flight_count(i),
+                atomic_load_explicit(&sh->tx, memory_order_relaxed),
+                atomic_load_explicit(&sh->rx, memory_order_relaxed),
+                atomic_load_explicit(&sh->connects, memory_order_relaxed));
+    }
+}
+/* metrics: connection state and traffic of the dataplane sockets */
+void dp_shards_metrics(struct hh_metrics_buf *b)
+{
+    BUG(!b);
+
+    hh_metrics_family(b, "hh_dataplane_connected", "gauge", "Whether all dataplane sockets are connected.");
+    hh_metrics_printf(b, "hh_dataplane_connected %d\n", dplane_sock_is_connected() ? 1 : 0);
+    hh_metrics_family(b, "hh_dataplane_ready", "gauge", "Whether dataplane is configured and ready.");
+    hh_metrics_printf(b, "hh_dataplane_ready %d\n", dplane_is_ready() ? 1 : 0);
+
+    hh_metrics_family(b, "hh_shard_connected", "gauge", "Whether the socket of a shard is connected.");
+    for (uint8_t i = 0; i < dp_num_shards; i++)
+        hh_metrics_printf(b, "hh_shard_connected{shard=\"%u\"} %d\n", i, shards[i].connected ? 1 : 0);
+    hh_metrics_family(b, "hh_shard_tx", "counter", "Messages sent over the socket of a shard.");
+    for (uint8_t i = 0; i < dp_num_shards; i++)
+        hh_metrics_printf(b, "hh_shard_tx_total{shard=\"%u\"} %"PRIu64"\n", i,
+                          atomic_load_explicit(&shards[i].tx, memory_order_relaxed));
+    hh_metrics_family(b, "hh_shard_rx", "counter", "Messages received over the socket of a shard.");
+    for (uint8_t i = 0; i < dp_num_shards; i++)
+        hh_metrics_printf(b, "hh_shard_rx_total{shard=\"%u\"} %"PRIu64"\n", i,
+                          atomic_load_explicit(&shards[i].rx, memory_order_relaxed));
+    hh_metrics_family(b, "hh_shard_connects", "counter", "Connections of the socket of a shard.");
+    for (uint8_t i = 0; i < dp_num_shards; i++)
+        hh_metrics_printf(b, "hh_shard_connects_total{shard=\"%u\"} %"PRIu64"\n", i,
+                          atomic_load_explicit(&shards[i].connects, memory_order_relaxed));
+}
+
+struct json_object *hh_json_shards(void)
+{
+    struct json_object *json = json_object_new_array();
+
+    for (uint8_t i = 0; i < dp_num_shards; i++) {
+        struct dp_shard *sh = &shards[i];
+        struct json_object *jsh = json_object_new_object();
+        json_object_int_add(jsh, "shard", i);
+        json_object_string_add(jsh, "remotePath", sh->remote_path);
+        json_object_boolean_add(jsh, "connected", sh->connected);
+        json_object_boolean_add(jsh, "ready", sh->ready);
+        json_object_int_add(jsh, "unsent", dp_msg_shard_unsent_count(i));
+        json_object_int_add(jsh, "inFlight", dp_msg_shard_in_flight_count(i));
+        json_object_int_add(jsh, "tx", atomic_load_explicit(&sh->tx, memory_order_relaxed));
+        json_object_int_add(jsh, "rx", atomic_load_explicit(&sh->rx, memory_order_relaxed));
+        json_object_int_add(jsh, "connects", atomic_load_explicit(&sh->connects, memory_order_relaxed));
+        json_object_array_add(json, jsh);
+    }
+    return json;
 }
 
 /* Finalize RPC to dataplane */
 void fini_dplane_rpc(void)
 {
-    /* close Unix sock */
-    dp_unix_sock_close();
+    /* close Unix socks */
+    EVENT_OFF(tx_window.ev_flush);
+    EVENT_OFF(ev_keepalive);
+    for (uint8_t i = 0; i < dp_num_shards; i++) {
+        EVENT_OFF(shards[i].ev_connect_timer);
+        dp_unix_sock_close(&shards[i]);
+    }
+
+    /* close standby channel, whose messages go back to the cache */
+    fini_dp_standby();
 
     /* destroy rx / tx buffers */
     if (tx_buff) {
         buff_free(tx_buff);
         tx_buff = NULL;
     }
+    for (int i = 0; i < DP_TX_BATCH; i++) {
+        if (tx_batch[i]) {
+            buff_free(tx_batch[i]);
+            tx_batch[i] = NULL;
+        }
+    }
     if (rx_buff) {
         buff_free(rx_buff);
         rx_buff = NULL;
@@ -531,6 +1085,13 @@ void fini_dplane_rpc(void)
     /* finalize message cache */
     fini_dp_msg_cache();
 
+    /* finalize audit and state snapshot */
+    fini_dp_audit();
+    fini_dp_conv();
+    fini_dp_state();
+    fini_rpc_stats();
+    fini_dp_stats_shm();
+
     /* finalize format buffer */
     if (fb) {
         fini_fmt_buff(fb);
@@ -550,7 +1111,10 @@ static int init_rpc_buffers(void)
 
     tx_buff = buff_new(0);
     rx_buff = buff_new(0);
-    if (!tx_buff || !rx_buff) {
+    bool batch_ok = true;
+    for (int i = 0; i < DP_TX_BATCH; i++)
+        batch_ok = (tx_batch[i] = buff_new(0)) != NULL && batch_ok;
+    if (!tx_buff || !rx_buff || !batch_ok) {
         fini_dplane_rpc();
         zlog_err("Failed to initialize RPC rx/tx buffers");
         return -1;
@@ -571,10 +1135,18 @@ int init_dplane_rpc(void)
     }
     fb = &FB;
 
-    /* open unix socket and bind it */
-    dp_sock = dp_unix_sock_open(plugin_sock_path);
-    if (dp_sock == NO_SOCK)
+    /* open unix sockets and bind them */
+    for (uint8_t i = 0; i < DP_MAX_SHARDS; i++) {
+        shards[i].id = i;
+        shards[i].sock = NO_SOCK;
+    }
+    if (dp_shard_set_paths() != 0)
         goto fail;
+    for (uint8_t i = 0; i < dp_num_shards; i++) {
+        shards[i].sock = dp_unix_sock_open(shards[i].local_path);
+        if (shards[i].sock == NO_SOCK)
+            goto fail;
+    }
 
     /* allocate Tx/Rx buffers for RPC encoding/decoding */
     if (init_rpc_buffers() != 0)
@@ -583,9 +1155,26 @@ int init_dplane_rpc(void)
     /* initialize msg cache */
     init_dp_msg_cache();
 
+    /* initialize state snapshot. If objects were restored, Connect with the synt
+     * of the dataplane that holds them, to learn if it still does */
+    dplane_set_synt(init_dp_state());
+
+    /* audit routes in dataplane periodically */
+    init_dp_audit();
+    init_dp_conv();
+
+    /* sample stats for rates, and publish them for local collectors. The page is optional */
+    init_rpc_stats();
+    init_dp_stats_shm();
+
+    /* open channel to the standby dataplane, if configured */
+    if (init_dp_standby(plugin_sock_path) != 0)
+        goto fail;
+
     /* attempt connection to DP. This step in the initialization can fail
-     * if the dataplane has not yet opened the unix socket for communication. */
-    dp_connect(NULL);
+     * if the dataplane has not yet opened the unix sockets for communication. */
+    for (uint8_t i = 0; i < dp_num_shards; i++)
+        dp_shard_connect(&shards[i]);
 
     /* start keepalive probing */
     dp_send_keepalive(NULL);
@@ -596,7 +1185,8 @@ int init_dplane_rpc(void)
     return 0;
 
 fail:
-    dp_unix_sock_close();
+    for (uint8_t i = 0; i < dp_num_shards; i++)
+        dp_unix_sock_close(&shards[i]);
     fini_fmt_buff(fb);
     fb = NULL;
     return -1;
@@ -4,26 +4,45 @@
 #define SRC_HH_DP_COMM_H_
 
 #include <stdbool.h>
+#include <sys/un.h>
 #include <dplane-rpc/dplane-rpc.h>
 #include "hh_dp_msg_cache.h"
+#include "lib/vty.h"
+#include "lib/json.h"
 
 extern bool log_dataplane_msg;
 extern bool finalizing;
 
+/* max length of unix sock */
+#define MAX_SUN_PATH sizeof(((struct sockaddr_un*)0)->sun_path)
+
+/* unix socket helpers: validate a path, open a socket bound to a path, connect it */
+bool is_valid_unix_path(const char *path);
+int dp_unix_sock_open(const char *bind_path);
+int dp_unix_sock_connect(int sock, const char *conn_path);
+
 /* set dp unix sock local path */
 int set_dp_sock_local_path(const char *path);
 
 /* set dp unix sock remote path */
 int set_dp_sock_remote_path(const char *path);
 
+/* Set the number of sockets to shard the RPC stream over (1-DP_MAX_SHARDS). Socket n > 0
+ * uses the local and remote paths suffixed with ".n" */
+int set_dp_num_shards(const char *num);
+uint8_t dplane_num_shards(void);
+
+/* shard of an object, by its (vrfid, tableid) */
+uint8_t dplane_shard_of(const struct RpcObject *object);
+
 /* initialize RPC with dataplane */
 int init_dplane_rpc(void);
 
 /* Finalize RPC with dataplane */
 void fini_dplane_rpc(void);
 
-/* set the value of dataplane status */
-void dplane_set_ready(bool ready);
+/* set the value of dataplane status, for a shard */
+void dplane_set_ready(uint8_t shard, bool ready);
 
 /* set the synt */
 void dplane_set_synt(uint64_t value);
@@ -31,12 +50,22 @@ void dplane_set_synt(uint64_t value);
 /* get the synt */
 uint64_t dplane_get_synt(void);
 
-/* get the value of dataplane status */
+/* get the value of dataplane status: ready if all shards are */
 bool dplane_is_ready(void);
 
-/* Tell if dataplane socket is connected */
+/* Tell if dataplane sockets are connected */
 bool dplane_sock_is_connected(void);
 
+/* vty: show the state of the dataplane sockets */
+void hh_vty_show_shards(struct vty *vty);
+struct json_object *hh_json_shards(void);
+struct hh_metrics_buf;
+void dp_shards_metrics(struct hh_metrics_buf *b);
+
+/* fail over to the standby dataplane (dplane thread) or request it (any thread) */
+int dplane_failover(void);
+void dplane_request_failover(void);
+
 /* main function to send an RPC message to dataplane. RPC messages come
  * wrapped in a struct dp_msg, which may contain a pointer to a zebra_dplane_ctx
  * object. */
@@ -45,4 +74,12 @@ int send_rpc_msg(struct dp_msg *dp_msg);
 /* send rpc messages awaiting to be sent */
 void send_pending_rpc_msgs(void);
 
+/* coalescing of outbound messages: hold them for up to max_usec (0 disables it)
+ * or until max_msgs are queued */
+int dp_tx_set_window(uint32_t max_usec, uint32_t max_msgs);
+void dp_tx_note_rtt(uint64_t rtt);
+void hh_vty_show_tx_window(struct vty *vty);
+int dp_tx_window_config_write(struct vty *vty);
+struct json_object *hh_json_tx_window(void);
+
 #endif /* SRC_HH_DP_COMM_H_ */
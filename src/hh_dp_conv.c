@@ -0,0 +1,284 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "config.h" /* FRR config.h */
+#include <stdatomic.h>
+#include "lib/zebra.h"
+#include "lib/libfrr.h"
+#include "lib/typesafe.h"
+#include "zebra/zebra_dplane.h" /* dplane_get_thread_master() */
+#include <dplane-rpc/dplane-rpc.h>
+
+#include "hh_dp_internal.h"
+#include "hh_dp_msg_cache.h" /* MGROUP ZEBRA */
+#include "hh_dp_rules.h" /* hh_rtype_str */
+#include "hh_dp_conv.h"
+
+DEFINE_MTYPE_STATIC(ZEBRA, HH_DP_CONV, "HH Dataplane convergence");
+
+#define DP_CONV_BURSTS 16
+#define DP_CONV_SNAP_SEC 1      /* the vty is shown snapshots of the times taken this often */
+#define DP_CONV_SNAP_CELLS 1024 /* max vrf / route type pairs in a snapshot */
+
+/* stages of a request */
+enum dp_conv_stage {
+    DP_CONV_QUEUE = 0,  /* intake to first send attempt: waiting in unsent */
+    DP_CONV_SOCK,       /* first send attempt to sent: socket not writable, resends */
+    DP_CONV_DP,         /* sent to acked: dataplane processing */
+    DP_CONV_STAGES,
+};
+
+struct dp_conv_cell {
+    uint64_t count;
+    uint64_t sum[DP_CONV_STAGES];
+    uint64_t max;       /* intake to acked */
+};
+
+PREDECL_RBTREE_UNIQ(dp_conv_tree);
+
+/* the times of the routes of a vrf, per route type */
+struct dp_conv_vrf {
+    VrfId vrfid;
+    struct dp_conv_cell cells[HH_RTYPE_MAX];
+    struct dp_conv_tree_item link;
+};
+
+static int dp_conv_vrf_cmp(const struct dp_conv_vrf *a, const struct dp_conv_vrf *b)
+{
+    if (a->vrfid != b->vrfid)
+        return a->vrfid < b->vrfid ? -1 : 1;
+    return 0;
+}
+
+DECLARE_RBTREE_UNIQ(dp_conv_tree, struct dp_conv_vrf, link, dp_conv_vrf_cmp);
+
+struct dp_conv_burst {
+    uint64_t t_start;   /* first intake */
+    uint64_t usec;      /* first intake to last ack */
+    uint64_t size;      /* requests taken in */
+    uint64_t routes;    /* of which, route requests */
+};
+
+/* Snapshot of the non-empty cells, in vrf order. The tree belongs to the dplane pthread:
+ * it publishes snapshots, alternating between two, so that the vty never walks it */
+struct dp_conv_snap {
+    uint32_t num_cells;
+    bool truncated;
+    struct {
+        VrfId vrfid;
+        unsigned int rtype;
+        struct dp_conv_cell cell;
+    } cells[DP_CONV_SNAP_CELLS];
+};
+
+static struct dp_conv {
+    struct dp_conv_tree_head vrfs;
+    struct dp_conv_snap snaps[2];
+    _Atomic unsigned int snap;      /* index of the snapshot published */
+    struct event *ev_snap;
+
+    /* current burst and those past, in a ring */
+    struct dp_conv_burst cur;
+    bool active;
+    struct dp_conv_burst bursts[DP_CONV_BURSTS];
+    uint64_t num_bursts;
+    uint64_t max_usec;
+    uint64_t max_size;
+} conv;
+
+/* a request was created for a zebra context */
+void dp_conv_intake(struct dp_msg *m)
+{
+    BUG(!m);
+    m->ts_intake = hh_monotime_us();
+
+    if (!conv.active) {
+        memset(&conv.cur, 0, sizeof(conv.cur));
+        conv.cur.t_start = m->ts_intake;
+        conv.active = true;
+    }
+    conv.cur.size++;
+    if (m->msg.request.object.type == IpRoute)
+        conv.cur.routes++;
+}
+
+static struct dp_conv_vrf *dp_conv_vrf_get(VrfId vrfid)
+{
+    struct dp_conv_vrf key = { .vrfid = vrfid };
+    struct dp_conv_vrf *v = dp_conv_tree_find(&conv.vrfs, &key);
+    if (!v) {
+        v = XCALLOC(MTYPE_HH_DP_CONV, sizeof(*v));
+        v->vrfid = vrfid;
+        dp_conv_tree_add(&conv.vrfs, v);
+    }
+    return v;
+}
+
+/* a request was acked by dataplane */
+void dp_conv_complete(const struct dp_msg *m, uint64_t now)
+{
+    BUG(!m);
+    const struct RpcRequest *req = &m->msg.request;
+
+    /* only routes from zebra that made it to the socket */
+    if (req->object.type != IpRoute || !m->ts_intake || !m->ts_tx_try || !m->ts_sent)
+        return;
+
+    const struct ip_route *route = &req->object.route;
+    unsigned int rtype = route->type < HH_RTYPE_MAX ? route->type : Other;
+    struct dp_conv_cell *c = &dp_conv_vrf_get(route->vrfid)->cells[rtype];
+    uint64_t total = now - m->ts_intake;
+
+    c->count++;
+    c->sum[DP_CONV_QUEUE] += m->ts_tx_try - m->ts_intake;
+    c->sum[DP_CONV_SOCK] += m->ts_sent - m->ts_tx_try;
+    c->sum[DP_CONV_DP] += now - m->ts_sent;
+    c->max = MAX(c->max, total);
+}
+
+/* check if the current burst is over: nothing left unsent or in flight */
+void dp_conv_check_idle(void)
+{
+    if (!conv.active || dp_msg_unsent_count() || dp_msg_in_flight_count())
+        return;
+
+    conv.cur.usec = hh_monotime_us() - conv.cur.t_start;
+    conv.bursts[conv.num_bursts % DP_CONV_BURSTS] = conv.cur;
+    conv.num_bursts++;
+    conv.max_usec = MAX(conv.max_usec, conv.cur.usec);
+    conv.max_size = MAX(conv.max_size, conv.cur.size);
+    conv.active = false;
+}
+
+/* publish a snapshot of the cells, in the snapshot not being read */
+static void dp_conv_snapshot(struct event *ev)
+{
+    unsigned int next = !atomic_load_explicit(&conv.snap, memory_order_relaxed);
+    struct dp_conv_snap *snap = &conv.snaps[next];
+    struct dp_conv_vrf *v;
+
+    event_add_timer(dplane_get_thread_master(), dp_conv_snapshot, NULL, DP_CONV_SNAP_SEC, &conv.ev_snap);
+
+    snap->num_cells = 0;
+    snap->truncated = false;
+    frr_each (dp_conv_tree, &conv.vrfs, v) {
+        for (unsigned int t = 0; t < HH_RTYPE_MAX; t++) {
+            if (!v->cells[t].count)
+                continue;
+            if (snap->num_cells == DP_CONV_SNAP_CELLS) {
+                snap->truncated = true;
+                break;
+            }
+            snap->cells[snap->num_cells].vrfid = v->vrfid;
+            snap->cells[snap->num_cells].rtype = t;
+            snap->cells[snap->num_cells].cell = v->cells[t];
+            snap->num_cells++;
+        }
+    }
+    atomic_store_explicit(&conv.snap, next, memory_order_release);
+}
+static inline const struct dp_conv_snap *dp_conv_snap_get(void)
+{
+    return &conv.snaps[atomic_load_explicit(&conv.snap, memory_order_acquire)];
+}
+
+/* vty: show convergence times */
+void hh_vty_show_convergence(struct vty *vty)
+{
+    BUG(!vty);
+    const struct dp_conv_snap *snap = dp_conv_snap_get();
+    uint64_t now = hh_monotime_us();
+
+    vty_out(vty, "  ─────────────────────────────────── Route convergence (usec, averages) ──────────────────────────────────\n");
+    vty_out(vty, "\n%10.10s %-10.10s %12.12s %10.10s %10.10s %10.10s %10.10s %10.10s\n", "vrf", "type",
+            "routes", "queued", "socket", "dataplane", "total", "max");
+    for (uint32_t i = 0; i < snap->num_cells; i++) {
+        const struct dp_conv_cell *c = &snap->cells[i].cell;
+        if (!c->count)
+            continue;
+        uint64_t q = c->sum[DP_CONV_QUEUE] / c->count;
+        uint64_t s = c->sum[DP_CONV_SOCK] / c->count;
+        uint64_t d = c->sum[DP_CONV_DP] / c->count;
+        vty_out(vty, "%10u %-10.10s %12"PRIu64" %10"PRIu64" %10"PRIu64" %10"PRIu64" %10"PRIu64" %10"PRIu64"\n",
+                snap->cells[i].vrfid, hh_rtype_str(snap->cells[i].rtype), c->count, q, s, d, q + s + d, c->max);
+    }
+    if (snap->truncated)
+        vty_out(vty, "%10.10s (only the first %u shown)\n", "...", DP_CONV_SNAP_CELLS);
+
+    vty_out(vty, "\n Bursts: %"PRIu64", longest: %"PRIu64" usec, largest: %"PRIu64" requests\n",
+            conv.num_bursts, conv.max_usec, conv.max_size);
+    if (conv.active)
+        vty_out(vty, "   in progress: %"PRIu64" requests (%"PRIu64" routes), for %"PRIu64" usec\n",
+                conv.cur.size, conv.cur.routes, now - conv.cur.t_start);
+    if (conv.num_bursts) {
+        vty_out(vty, "\n%12.12s %12.12s %12.12s %14.14s\n", "started(s)", "requests", "routes", "converged(us)");
+        uint64_t n = MIN(conv.num_bursts, DP_CONV_BURSTS);
+        for (uint64_t i = 0; i < n; i++) {
+            struct dp_conv_burst *b = &conv.bursts[(conv.num_bursts - 1 - i) % DP_CONV_BURSTS];
+            vty_out(vty, "%8"PRIu64" ago %12"PRIu64" %12"PRIu64" %14"PRIu64"\n",
+                    (now - b->t_start) / 1000000, b->size, b->routes, b->usec);
+        }
+    }
+    vty_out(vty, "\n");
+}
+struct json_object *hh_json_convergence(void)
+{
+    struct json_object *json = hh_json_new();
+    struct json_object *jcells = json_object_new_array();
+    struct json_object *jbursts = json_object_new_array();
+    const struct dp_conv_snap *snap = dp_conv_snap_get();
+
+    for (uint32_t i = 0; i < snap->num_cells; i++) {
+        const struct dp_conv_cell *c = &snap->cells[i].cell;
+        struct json_object *jc = json_object_new_object();
+        json_object_int_add(jc, "vrf", snap->cells[i].vrfid);
+        json_object_string_add(jc, "type", hh_rtype_str(snap->cells[i].rtype));
+        json_object_int_add(jc, "routes", c->count);
+        json_object_int_add(jc, "queuedUsecSum", c->sum[DP_CONV_QUEUE]);
+        json_object_int_add(jc, "socketUsecSum", c->sum[DP_CONV_SOCK]);
+        json_object_int_add(jc, "dataplaneUsecSum", c->sum[DP_CONV_DP]);
+        json_object_int_add(jc, "maxUsec", c->max);
+        json_object_array_add(jcells, jc);
+    }
+    json_object_object_add(json, "routes", jcells);
+    json_object_boolean_add(json, "truncated", snap->truncated);
+
+    json_object_int_add(json, "bursts", conv.num_bursts);
+    json_object_int_add(json, "longestUsec", conv.max_usec);
+    json_object_int_add(json, "largest", conv.max_size);
+    if (conv.active) {
+        struct json_object *jcur = json_object_new_object();
+        json_object_int_add(jcur, "startUsec", conv.cur.t_start);
+        json_object_int_add(jcur, "requests", conv.cur.size);
+        json_object_int_add(jcur, "routes", conv.cur.routes);
+        json_object_object_add(json, "inProgress", jcur);
+    }
+    uint64_t n = MIN(conv.num_bursts, DP_CONV_BURSTS);
+    for (uint64_t i = 0; i < n; i++) {
+        struct dp_conv_burst *b = &conv.bursts[(conv.num_bursts - 1 - i) % DP_CONV_BURSTS];
+        struct json_object *jb = json_object_new_object();
+        json_object_int_add(jb, "startUsec", b->t_start);
+        json_object_int_add(jb, "requests", b->size);
+        json_object_int_add(jb, "routes", b->routes);
+        json_object_int_add(jb, "convergedUsec", b->usec);
+        json_object_array_add(jbursts, jb);
+    }
+    json_object_object_add(json, "lastBursts", jbursts);
+    return json;
+}
+
+void init_dp_conv(void)
+{
+    dp_conv_tree_init(&conv.vrfs);
+    event_add_timer(dplane_get_thread_master(), dp_conv_snapshot, NULL, DP_CONV_SNAP_SEC, &conv.ev_snap);
+}
+
+void fini_dp_conv(void)
+{
+    struct dp_conv_vrf *v;
+
+    EVENT_OFF(conv.ev_snap);
+    while ((v = dp_conv_tree_pop(&conv.vrfs)) != NULL)
+        XFREE(MTYPE_HH_DP_CONV, v);
+    dp_conv_tree_fini(&conv.vrfs);
+    conv.active = false;
+}
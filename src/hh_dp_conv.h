@@ -0,0 +1,33 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef SRC_HH_DP_CONV_H_
+#define SRC_HH_DP_CONV_H_
+
+#include <stdint.h>
+#include "lib/vty.h"
+#include "lib/json.h"
+#include "hh_dp_msg_cache.h"
+
+/* Convergence tracker. Route requests are timestamped when the plugin takes them in, when
+ * first tried on the socket and when sent. On their ack, the time spent in each stage is
+ * aggregated per vrf and route type. Activity is grouped in bursts, which end when no
+ * request is left unsent or in flight. */
+
+/* initialize / finalize the tracker */
+void init_dp_conv(void);
+void fini_dp_conv(void);
+
+/* a request was created for a zebra context */
+void dp_conv_intake(struct dp_msg *m);
+
+/* a request was acked by dataplane */
+void dp_conv_complete(const struct dp_msg *m, uint64_t now);
+
+/* check if the current burst is over. To be called after handling a batch of responses */
+void dp_conv_check_idle(void);
+
+/* vty: show convergence times */
+void hh_vty_show_convergence(struct vty *vty);
+struct json_object *hh_json_convergence(void);
+
+#endif /* SRC_HH_DP_CONV_H_ */
@@ -0,0 +1,155 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "config.h" /* FRR config.h */
+#include "lib/zebra.h"
+#include "lib/libfrr.h"
+
+#include "hh_dp_internal.h"
+#include "hh_dp_cpu.h"
+
+_Atomic bool hh_cpu_on = false;
+
+/* innermost frame being timed. Frames are only used in the dplane pthread */
+static struct hh_cpu_frame *hh_cpu_top;
+
+static struct hh_cpu_stats {
+    _Atomic uint64_t ticks;
+    _Atomic uint64_t calls;
+    _Atomic uint64_t msgs;
+} cpu_stats[HH_CPU_STAGES];
+
+/* reference to convert ticks to time: ticks and monotonic time when accounting started */
+static struct {
+    _Atomic uint64_t ticks;
+    _Atomic uint64_t usec;
+} cpu_ref;
+
+static const char *const hh_cpu_stage_names[HH_CPU_STAGES] = {
+    [HH_CPU_CLASSIFY] = "classify",
+    [HH_CPU_ENCODE] = "encode",
+    [HH_CPU_SEND] = "send",
+    [HH_CPU_RECV] = "recv",
+    [HH_CPU_DECODE] = "decode",
+    [HH_CPU_HANDLE] = "handle",
+    [HH_CPU_LOG] = "log",
+};
+
+void hh_cpu_push(struct hh_cpu_frame *f)
+{
+    f->child = 0;
+    f->up = hh_cpu_top;
+    hh_cpu_top = f;
+    f->t0 = hh_cpu_now();
+}
+
+void hh_cpu_pop(struct hh_cpu_frame *f, enum hh_cpu_stage stage, uint32_t msgs)
+{
+    uint64_t elapsed = hh_cpu_now() - f->t0;
+
+    /* frames ended out of order: drop the stack rather than leave it dangling */
+    if (unlikely(hh_cpu_top != f)) {
+        hh_cpu_top = NULL;
+        BUG(hh_cpu_top != f);
+    }
+    hh_cpu_top = f->up;
+    if (f->up)
+        f->up->child += elapsed;
+    elapsed = elapsed > f->child ? elapsed - f->child : 0;
+
+    struct hh_cpu_stats *s = &cpu_stats[stage];
+    atomic_fetch_add_explicit(&s->ticks, elapsed, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s->calls, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s->msgs, msgs, memory_order_relaxed);
+}
+
+/* reset the stats. Called from the main thread */
+void hh_cpu_clear(void)
+{
+    for (unsigned int i = 0; i < HH_CPU_STAGES; i++) {
+        atomic_store_explicit(&cpu_stats[i].ticks, 0, memory_order_relaxed);
+        atomic_store_explicit(&cpu_stats[i].calls, 0, memory_order_relaxed);
+        atomic_store_explicit(&cpu_stats[i].msgs, 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&cpu_ref.ticks, hh_cpu_now(), memory_order_relaxed);
+    atomic_store_explicit(&cpu_ref.usec, hh_monotime_us(), memory_order_relaxed);
+}
+
+/* switch accounting on / off. Called from the main thread */
+void hh_cpu_enable(bool enable)
+{
+    if (enable && !atomic_load_explicit(&hh_cpu_on, memory_order_relaxed))
+        hh_cpu_clear();
+    atomic_store_explicit(&hh_cpu_on, enable, memory_order_relaxed);
+    zlog_info("CPU accounting of plugin stages is now %s", enable ? "enabled" : "disabled");
+}
+
+/* ticks per usec */
+static double hh_cpu_rate(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    /* calibrate the TSC against the time elapsed since accounting started */
+    uint64_t ticks = hh_cpu_now() - atomic_load_explicit(&cpu_ref.ticks, memory_order_relaxed);
+    uint64_t usec = hh_monotime_us() - atomic_load_explicit(&cpu_ref.usec, memory_order_relaxed);
+    return usec ? (double)ticks / (double)usec : 0;
+#else
+    return 1000.0;
+#endif
+}
+
+/* vty: show cpu cost per stage */
+void hh_vty_show_cpu(struct vty *vty)
+{
+    BUG(!vty);
+    uint64_t ticks[HH_CPU_STAGES], calls[HH_CPU_STAGES], msgs[HH_CPU_STAGES];
+    uint64_t total = 0;
+    double rate = hh_cpu_rate();
+
+    for (unsigned int i = 0; i < HH_CPU_STAGES; i++) {
+        ticks[i] = atomic_load_explicit(&cpu_stats[i].ticks, memory_order_relaxed);
+        calls[i] = atomic_load_explicit(&cpu_stats[i].calls, memory_order_relaxed);
+        msgs[i] = atomic_load_explicit(&cpu_stats[i].msgs, memory_order_relaxed);
+        total += ticks[i];
+    }
+
+    vty_out(vty, " CPU accounting: %s", atomic_load_explicit(&hh_cpu_on, memory_order_relaxed) ? "enabled" : "disabled");
+#if defined(__x86_64__) || defined(__i386__)
+    vty_out(vty, " (TSC, %.1f cycles/usec)\n", rate);
+#else
+    vty_out(vty, " (thread cpu time)\n");
+#endif
+    if (!rate)
+        return;
+
+    vty_out(vty, "  ───────────────────────────────────────── CPU cost per stage ─────────────────────────────────────────────\n");
+    vty_out(vty, "\n%10.10s %12.12s %12.12s %12.12s %10.10s %10.10s %7.7s\n", "stage", "calls", "msgs",
+            "total(us)", "ns/call", "ns/msg", "share");
+    for (unsigned int i = 0; i < HH_CPU_STAGES; i++) {
+        double ns = (double)ticks[i] * 1000.0 / rate;
+        vty_out(vty, "%10.10s %12"PRIu64" %12"PRIu64" %12.0f %10.0f %10.0f %6.1f%%\n", hh_cpu_stage_names[i],
+                calls[i], msgs[i], ns / 1000.0,
+                calls[i] ? ns / (double)calls[i] : 0.0,
+                msgs[i] ? ns / (double)msgs[i] : 0.0,
+                total ? 100.0 * (double)ticks[i] / (double)total : 0.0);
+    }
+    vty_out(vty, "%10.10s %12s %12s %12.0f\n\n", "total", "", "", (double)total / rate);
+}
+struct json_object *hh_json_cpu(void)
+{
+    struct json_object *json = hh_json_new();
+    double rate = hh_cpu_rate();
+
+    json_object_boolean_add(json, "enabled", atomic_load_explicit(&hh_cpu_on, memory_order_relaxed));
+    json_object_int_add(json, "sinceUsec", atomic_load_explicit(&cpu_ref.usec, memory_order_relaxed));
+    if (!rate)
+        return json;
+
+    for (unsigned int i = 0; i < HH_CPU_STAGES; i++) {
+        uint64_t ticks = atomic_load_explicit(&cpu_stats[i].ticks, memory_order_relaxed);
+        struct json_object *js = json_object_new_object();
+        json_object_int_add(js, "calls", atomic_load_explicit(&cpu_stats[i].calls, memory_order_relaxed));
+        json_object_int_add(js, "msgs", atomic_load_explicit(&cpu_stats[i].msgs, memory_order_relaxed));
+        json_object_int_add(js, "nsec", (uint64_t)((double)ticks * 1000.0 / rate));
+        json_object_object_add(json, hh_cpu_stage_names[i], js);
+    }
+    return json;
+}
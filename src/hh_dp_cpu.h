@@ -0,0 +1,71 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef SRC_HH_DP_CPU_H_
+#define SRC_HH_DP_CPU_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include "lib/vty.h"
+#include "lib/json.h"
+
+/* CPU cost of the stages of the plugin hot path, in the dplane pthread. Stages are timed
+ * with frames that nest: the time of a stage excludes that of the stages run within it
+ * (e.g. logging while encoding). When accounting is off, a frame costs a relaxed load */
+enum hh_cpu_stage {
+    HH_CPU_CLASSIFY = 0,    /* processing of contexts from zebra into requests */
+    HH_CPU_ENCODE,          /* encoding of messages */
+    HH_CPU_SEND,            /* send() / sendmmsg() */
+    HH_CPU_RECV,            /* recv() */
+    HH_CPU_DECODE,          /* decoding of messages */
+    HH_CPU_HANDLE,          /* handling of messages from dataplane */
+    HH_CPU_LOG,             /* tracing and logging of messages */
+    HH_CPU_STAGES
+};
+
+struct hh_cpu_frame {
+    uint64_t t0;        /* 0 if the frame is not accounted */
+    uint64_t child;     /* time spent in nested frames */
+    struct hh_cpu_frame *up;
+};
+
+extern _Atomic bool hh_cpu_on;
+
+/* current time in clock ticks: TSC cycles where available, else thread cpu time (nsec) */
+static inline uint64_t hh_cpu_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+void hh_cpu_push(struct hh_cpu_frame *f);
+void hh_cpu_pop(struct hh_cpu_frame *f, enum hh_cpu_stage stage, uint32_t msgs);
+
+/* start / end timing a stage that processed msgs messages. Frames must end in reverse order */
+static inline void hh_cpu_begin(struct hh_cpu_frame *f)
+{
+    f->t0 = 0;
+    if (__builtin_expect(atomic_load_explicit(&hh_cpu_on, memory_order_relaxed), 0))
+        hh_cpu_push(f);
+}
+static inline void hh_cpu_end(struct hh_cpu_frame *f, enum hh_cpu_stage stage, uint32_t msgs)
+{
+    if (__builtin_expect(f->t0 != 0, 0))
+        hh_cpu_pop(f, stage, msgs);
+}
+
+/* switch accounting on / off, reset it */
+void hh_cpu_enable(bool enable);
+void hh_cpu_clear(void);
+
+/* vty: show cpu cost per stage */
+void hh_vty_show_cpu(struct vty *vty);
+struct json_object *hh_json_cpu(void);
+
+#endif /* SRC_HH_DP_CPU_H_ */
@@ -3,7 +3,10 @@
 #ifndef SRC_HH_DP_INTERNAL_H_
 #define SRC_HH_DP_INTERNAL_H_
 
+#include <time.h>
+#include <stdint.h>
 #include "lib/zlog.h"
+#include "lib/json.h"
 #include "hh_dp_config.h"
 
 #ifndef unlikely
@@ -26,6 +29,23 @@
         }                                                     \
     } while (0)
 
+/* monotonic time in microseconds */
+static inline uint64_t hh_monotime_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+/* json object of a show command, stamped with the monotonic time it was taken at,
+ * so that collectors polling counters can compute deltas and rates exactly */
+static inline struct json_object *hh_json_new(void)
+{
+    struct json_object *json = json_object_new_object();
+    json_object_int_add(json, "timestampUsec", hh_monotime_us());
+    return json;
+}
+
 /* format buffer */
 extern struct fmt_buff *fb;
 
@@ -0,0 +1,342 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "config.h" /* FRR config.h */
+#include "lib/zebra.h"
+#include "lib/libfrr.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "hh_dp_internal.h"
+#include "hh_dp_msg_cache.h" /* MGROUP ZEBRA */
+#include "hh_dp_journal.h"
+
+/*
+ * Warm-restart journal. The file is a header followed by an array of fixed-size slots,
+ * each holding an object by value. It is updated in place through a shared mapping: the
+ * kernel writes it back, so it survives the process without any syncing on our side.
+ */
+
+DEFINE_MTYPE_STATIC(ZEBRA, HH_DP_JOURNAL, "HH Dataplane journal");
+
+#define DP_JOURNAL_MAGIC 0x4848444a  /* "HHDJ" */
+#define DP_JOURNAL_VERSION 1
+#define DP_JOURNAL_INIT_SLOTS 4096
+#define DFLT_DP_JOURNAL_PATH "/var/run/frr/hhplugin.journal"
+
+struct dp_journal_hdr {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_size;     /* changes if RpcObject does */
+    uint32_t valid;
+    uint64_t synt;
+    uint32_t num_slots;
+    uint32_t hiwat;         /* slots above this were never used */
+};
+
+struct dp_journal_slot {
+    uint32_t used;
+    uint32_t pad;
+    struct RpcObject object;
+};
+
+static struct dp_journal {
+    char path[PATH_MAX];
+    int fd;
+    size_t size;
+    struct dp_journal_hdr *hdr;
+    struct dp_journal_slot *slots;   /* slot n is slots[n - 1] */
+    bool loaded;                     /* opened a journal left by a prior run */
+
+    /* free slots below hiwat */
+    uint32_t *free;
+    uint32_t num_free;
+    uint32_t cap_free;
+    uint32_t num_used;
+} journal = {
+    .path = DFLT_DP_JOURNAL_PATH,
+    .fd = -1,
+};
+
+static inline size_t dp_journal_size(uint32_t num_slots)
+{
+    return sizeof(struct dp_journal_hdr) + (size_t)num_slots * sizeof(struct dp_journal_slot);
+}
+
+/* set the path of the journal file */
+int dp_journal_set_path(const char *path)
+{
+    BUG(!path, -1);
+    if (strlen(path) >= sizeof(journal.path)) {
+        zlog_err("Invalid journal path %s: too long", path);
+        return -1;
+    }
+    strlcpy(journal.path, path, sizeof(journal.path));
+    zlog_debug("Configured dataplane journal path to '%s'", journal.path[0] ? journal.path : "(disabled)");
+    return 0;
+}
+
+/* map the journal file, of the given size */
+static int dp_journal_map(size_t size)
+{
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, journal.fd, 0);
+    if (addr == MAP_FAILED) {
+        zlog_err("Failed to map dataplane journal: %s", strerror(errno));
+        return -1;
+    }
+    journal.size = size;
+    journal.hdr = addr;
+    journal.slots = (struct dp_journal_slot *)(journal.hdr + 1);
+    return 0;
+}
+
+static void dp_journal_unmap(void)
+{
+    if (journal.hdr)
+        munmap(journal.hdr, journal.size);
+    journal.hdr = NULL;
+    journal.slots = NULL;
+    journal.size = 0;
+}
+
+/* grow the journal file */
+static int dp_journal_grow(void)
+{
+    uint32_t num_slots = journal.hdr->num_slots * 2;
+    size_t size = dp_journal_size(num_slots);
+
+    if (ftruncate(journal.fd, size) < 0) {
+        zlog_err("Failed to grow dataplane journal to %u slots: %s", num_slots, strerror(errno));
+        return -1;
+    }
+    dp_journal_unmap();
+    if (dp_journal_map(size) < 0)
+        return -1;
+    journal.hdr->num_slots = num_slots;
+    return 0;
+}
+
+/* start an empty journal */
+static int dp_journal_format(void)
+{
+    size_t size = dp_journal_size(DP_JOURNAL_INIT_SLOTS);
+
+    dp_journal_unmap();
+    if (ftruncate(journal.fd, 0) < 0 || ftruncate(journal.fd, size) < 0) {
+        zlog_err("Failed to size dataplane journal: %s", strerror(errno));
+        return -1;
+    }
+    if (dp_journal_map(size) < 0)
+        return -1;
+
+    journal.hdr->magic = DP_JOURNAL_MAGIC;
+    journal.hdr->version = DP_JOURNAL_VERSION;
+    journal.hdr->slot_size = sizeof(struct dp_journal_slot);
+    journal.hdr->num_slots = DP_JOURNAL_INIT_SLOTS;
+    journal.hdr->hiwat = 0;
+    journal.hdr->synt = 0;
+    journal.hdr->valid = 1;
+    journal.num_free = journal.num_used = 0;
+    return 0;
+}
+
+/* tell if the file holds a journal that we can use */
+static bool dp_journal_check(size_t file_size)
+{
+    struct dp_journal_hdr *hdr = journal.hdr;
+
+    if (hdr->magic != DP_JOURNAL_MAGIC || hdr->version != DP_JOURNAL_VERSION) {
+        zlog_warn("Dataplane journal has an unknown format");
+        return false;
+    }
+    if (hdr->slot_size != sizeof(struct dp_journal_slot)) {
+        zlog_warn("Dataplane journal was written by an incompatible plugin (slot size %u != %zu)",
+                hdr->slot_size, sizeof(struct dp_journal_slot));
+        return false;
+    }
+    if (dp_journal_size(hdr->num_slots) != file_size || hdr->hiwat > hdr->num_slots) {
+        zlog_warn("Dataplane journal is truncated or corrupt");
+        return false;
+    }
+    return true;
+}
+
+/* open the journal, or create it */
+int init_dp_journal(void)
+{
+    struct stat st;
+
+    if (!journal.path[0]) {
+        zlog_info("Dataplane journal is disabled");
+        return 0;
+    }
+
+    journal.fd = open(journal.path, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (journal.fd < 0 || fstat(journal.fd, &st) < 0) {
+        zlog_err("Failed to open dataplane journal at '%s': %s", journal.path, strerror(errno));
+        goto fail;
+    }
+
+    journal.loaded = false;
+    if ((size_t)st.st_size >= dp_journal_size(0)) {
+        if (dp_journal_map(st.st_size) < 0)
+            goto fail;
+        journal.loaded = dp_journal_check(st.st_size);
+    }
+    if (!journal.loaded && dp_journal_format() < 0)
+        goto fail;
+
+    zlog_info("Opened dataplane journal at '%s' (%u slots)", journal.path, journal.hdr->num_slots);
+    return 0;
+
+fail:
+    fini_dp_journal();
+    return -1;
+}
+
+/* close the journal. Its contents are kept for the next run */
+void fini_dp_journal(void)
+{
+    dp_journal_unmap();
+    if (journal.fd >= 0)
+        close(journal.fd);
+    journal.fd = -1;
+    if (journal.free)
+        XFREE(MTYPE_HH_DP_JOURNAL, journal.free);
+    journal.num_free = journal.cap_free = journal.num_used = 0;
+}
+
+static void dp_journal_free_push(uint32_t slot)
+{
+    if (journal.num_free == journal.cap_free) {
+        journal.cap_free = journal.cap_free ? journal.cap_free * 2 : 1024;
+        journal.free = XREALLOC(MTYPE_HH_DP_JOURNAL, journal.free, journal.cap_free * sizeof(uint32_t));
+    }
+    journal.free[journal.num_free++] = slot;
+}
+
+/* load the objects left by a prior run */
+uint64_t dp_journal_load(void (*cb)(const struct RpcObject *object, uint32_t slot))
+{
+    BUG(!cb, 0);
+    if (!journal.hdr || !journal.loaded)
+        return 0;
+
+    journal.loaded = false;
+    if (!journal.hdr->valid || !journal.hdr->synt) {
+        zlog_info("Dataplane journal has no usable state");
+        dp_journal_clear();
+        return 0;
+    }
+
+    for (uint32_t slot = 1; slot <= journal.hdr->hiwat; slot++) {
+        struct dp_journal_slot *s = &journal.slots[slot - 1];
+        if (s->used) {
+            cb(&s->object, slot);
+            journal.num_used++;
+        } else {
+            dp_journal_free_push(slot);
+        }
+    }
+    zlog_info("Loaded %u objects from dataplane journal (synt %"PRIu64")", journal.num_used, journal.hdr->synt);
+    return journal.hdr->synt;
+}
+
+/* store an object */
+uint32_t dp_journal_put(uint32_t slot, const struct RpcObject *object)
+{
+    BUG(!object, 0);
+    if (!journal.hdr)
+        return 0;
+
+    if (!slot) {
+        if (journal.num_free) {
+            slot = journal.free[--journal.num_free];
+        } else {
+            if (journal.hdr->hiwat == journal.hdr->num_slots && dp_journal_grow() < 0) {
+                dp_journal_set_valid(false);
+                return 0;
+            }
+            slot = ++journal.hdr->hiwat;
+        }
+        journal.num_used++;
+    }
+    struct dp_journal_slot *s = &journal.slots[slot - 1];
+    s->object = *object;
+    s->used = 1;
+    return slot;
+}
+
+/* free a slot */
+void dp_journal_del(uint32_t slot)
+{
+    if (!journal.hdr || !slot || slot > journal.hdr->hiwat)
+        return;
+
+    struct dp_journal_slot *s = &journal.slots[slot - 1];
+    if (s->used) {
+        s->used = 0;
+        journal.num_used--;
+        dp_journal_free_push(slot);
+    }
+}
+
+/* drop all objects, keeping the synt */
+void dp_journal_clear(void)
+{
+    if (!journal.hdr)
+        return;
+
+    uint64_t synt = journal.hdr->synt;
+    if (dp_journal_format() < 0) {
+        fini_dp_journal();
+        return;
+    }
+    journal.hdr->synt = synt;
+}
+
+void dp_journal_set_valid(bool valid)
+{
+    if (journal.hdr)
+        journal.hdr->valid = valid;
+}
+
+void dp_journal_set_synt(uint64_t synt)
+{
+    if (journal.hdr)
+        journal.hdr->synt = synt;
+}
+
+/* vty: show journal status */
+void hh_vty_show_journal(struct vty *vty)
+{
+    BUG(!vty);
+
+    if (!journal.hdr) {
+        vty_out(vty, " Dataplane journal: %s\n", journal.path[0] ? "not open" : "disabled");
+        return;
+    }
+    vty_out(vty, " Dataplane journal: '%s' (%s)\n", journal.path, journal.hdr->valid ? "valid" : "invalid");
+    vty_out(vty, "   synt: %"PRIu64"\n", journal.hdr->synt);
+    vty_out(vty, "   objects: %u, slots: %u (%u free), size: %zu KB\n", journal.num_used,
+            journal.hdr->num_slots, journal.hdr->num_slots - journal.num_used, journal.size / 1024);
+}
+struct json_object *hh_json_journal(void)
+{
+    struct json_object *json = json_object_new_object();
+
+    json_object_string_add(json, "state", journal.hdr ? "open" : journal.path[0] ? "not open" : "disabled");
+    if (!journal.hdr)
+        return json;
+    json_object_string_add(json, "path", journal.path);
+    json_object_boolean_add(json, "valid", journal.hdr->valid);
+    json_object_int_add(json, "synt", journal.hdr->synt);
+    json_object_int_add(json, "objects", journal.num_used);
+    json_object_int_add(json, "slots", journal.hdr->num_slots);
+    json_object_int_add(json, "bytes", journal.size);
+    return json;
+}
@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef SRC_HH_DP_JOURNAL_H_
+#define SRC_HH_DP_JOURNAL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <dplane-rpc/dplane-rpc.h>
+#include "lib/vty.h"
+#include "lib/json.h"
+
+/* Persistent journal of the objects acknowledged by dataplane, together with the synt of
+ * the dataplane instance that holds them. It is a memory-mapped file, so that it survives
+ * zebra restarts. Objects are kept in slots; slot numbers start at 1 and 0 means none. */
+
+/* set the path of the journal file. An empty path disables the journal */
+int dp_journal_set_path(const char *path);
+
+/* open / close the journal. Closing it keeps its contents */
+int init_dp_journal(void);
+void fini_dp_journal(void);
+
+/* load the objects in a journal left by a prior run. Returns the synt they belong
+ * to, or 0 if there are none or they can't be trusted */
+uint64_t dp_journal_load(void (*cb)(const struct RpcObject *object, uint32_t slot));
+
+/* store an object in a slot (or a new slot if 0) and return the slot used */
+uint32_t dp_journal_put(uint32_t slot, const struct RpcObject *object);
+
+/* free a slot */
+void dp_journal_del(uint32_t slot);
+
+/* drop all objects */
+void dp_journal_clear(void);
+
+/* mark the contents of the journal as trustable or not */
+void dp_journal_set_valid(bool valid);
+
+/* record the synt of dataplane */
+void dp_journal_set_synt(uint64_t synt);
+
+/* vty: show journal status */
+void hh_vty_show_journal(struct vty *vty);
+struct json_object *hh_json_journal(void);
+
+#endif /* SRC_HH_DP_JOURNAL_H_ */
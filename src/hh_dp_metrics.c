@@ -0,0 +1,259 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "config.h" /* FRR config.h */
+#include "lib/zebra.h"
+#include "lib/libfrr.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "hh_dp_internal.h"
+#include "hh_dp_msg_cache.h" /* MGROUP ZEBRA */
+#include "hh_dp_comm.h"
+#include "hh_dp_rpc_stats.h"
+#include "hh_dp_metrics.h"
+
+DEFINE_MTYPE_STATIC(ZEBRA, HH_DP_METRICS, "HH Dataplane metrics");
+
+#define HH_METRICS_CACHE_MSEC 1000     /* lifetime of the text generated */
+#define HH_METRICS_MAX_CLIENTS 8
+#define HH_METRICS_TIMEOUT_SEC 5       /* to send a request and read the response */
+#define NO_SOCK -1
+#define HH_METRICS_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+struct hh_metrics_client {
+    int fd;
+    struct event *ev_read;
+    struct event *ev_write;
+    struct event *ev_timeout;
+    struct hh_metrics_buf out;  /* response, and how much of it was sent */
+    size_t sent;
+};
+
+static struct dp_metrics {
+    char path[MAX_SUN_PATH];
+    struct event_loop *master;
+    int sock;
+    struct event *ev_accept;
+    struct hh_metrics_client clients[HH_METRICS_MAX_CLIENTS];
+
+    /* text cached, and when it was generated */
+    struct hh_metrics_buf text;
+    uint64_t t_text;
+    uint64_t scrapes;
+    uint64_t generations;
+} metrics = {
+    .sock = NO_SOCK,
+};
+
+static void hh_metrics_reserve(struct hh_metrics_buf *b, size_t len)
+{
+    if (b->len + len < b->cap)
+        return;
+    while (b->cap <= b->len + len)
+        b->cap = b->cap ? b->cap * 2 : 16384;
+    b->data = XREALLOC(MTYPE_HH_DP_METRICS, b->data, b->cap);
+}
+
+void hh_metrics_printf(struct hh_metrics_buf *b, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    int len = vsnprintf(b->data ? b->data + b->len : NULL, b->data ? b->cap - b->len : 0, fmt, ap);
+    va_end(ap);
+    if (len < 0)
+        return;
+    if (!b->data || b->len + len >= b->cap) {
+        hh_metrics_reserve(b, len);
+        va_start(ap, fmt);
+        vsnprintf(b->data + b->len, b->cap - b->len, fmt, ap);
+        va_end(ap);
+    }
+    b->len += len;
+}
+
+void hh_metrics_family(struct hh_metrics_buf *b, const char *name, const char *type, const char *help)
+{
+    hh_metrics_printf(b, "# TYPE %s %s\n# HELP %s %s\n", name, type, name, help);
+}
+
+static void hh_metrics_buf_free(struct hh_metrics_buf *b)
+{
+    if (b->data)
+        XFREE(MTYPE_HH_DP_METRICS, b->data);
+    b->len = b->cap = 0;
+}
+
+/* the metrics text, regenerated if older than HH_METRICS_CACHE_MSEC */
+static const struct hh_metrics_buf *hh_metrics_text(void)
+{
+    uint64_t now = hh_monotime_us();
+
+    metrics.scrapes++;
+    if (metrics.text.len && now - metrics.t_text < HH_METRICS_CACHE_MSEC * 1000)
+        return &metrics.text;
+
+    metrics.text.len = 0;
+    dp_shards_metrics(&metrics.text);
+    rpc_stats_metrics(&metrics.text);
+    dp_msg_cache_metrics(&metrics.text);
+    hh_metrics_family(&metrics.text, "hh_metrics_scrapes", "counter", "Scrapes served by the exporter.");
+    hh_metrics_printf(&metrics.text, "hh_metrics_scrapes_total %"PRIu64"\n", metrics.scrapes);
+    hh_metrics_family(&metrics.text, "hh_metrics_generations", "counter", "Times the metrics text was generated.");
+    hh_metrics_printf(&metrics.text, "hh_metrics_generations_total %"PRIu64"\n", ++metrics.generations);
+    hh_metrics_printf(&metrics.text, "# EOF\n");
+    metrics.t_text = now;
+    return &metrics.text;
+}
+
+static void hh_metrics_client_close(struct hh_metrics_client *c)
+{
+    EVENT_OFF(c->ev_read);
+    EVENT_OFF(c->ev_write);
+    EVENT_OFF(c->ev_timeout);
+    if (c->fd >= 0)
+        close(c->fd);
+    c->fd = NO_SOCK;
+    c->out.len = 0;
+    c->sent = 0;
+}
+
+static void hh_metrics_client_timeout(struct event *ev)
+{
+    hh_metrics_client_close(EVENT_ARG(ev));
+}
+
+static void hh_metrics_client_write(struct event *ev)
+{
+    struct hh_metrics_client *c = EVENT_ARG(ev);
+
+    while (c->sent < c->out.len) {
+        ssize_t n = send(c->fd, c->out.data + c->sent, c->out.len - c->sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            event_add_write(metrics.master, hh_metrics_client_write, c, c->fd, &c->ev_write);
+            return;
+        }
+        if (n <= 0)
+            break;
+        c->sent += n;
+    }
+    hh_metrics_client_close(c);
+}
+
+/* the client sent its request: answer with the metrics. An HTTP request gets HTTP headers */
+static void hh_metrics_client_read(struct event *ev)
+{
+    struct hh_metrics_client *c = EVENT_ARG(ev);
+    char req[1024];
+
+    ssize_t n = recv(c->fd, req, sizeof(req), MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        event_add_read(metrics.master, hh_metrics_client_read, c, c->fd, &c->ev_read);
+        return;
+    }
+    if (n <= 0) {
+        hh_metrics_client_close(c);
+        return;
+    }
+
+    const struct hh_metrics_buf *text = hh_metrics_text();
+    c->out.len = 0;
+    if (n >= 4 && !memcmp(req, "GET ", 4))
+        hh_metrics_printf(&c->out, "HTTP/1.0 200 OK\r\nContent-Type: " HH_METRICS_CONTENT_TYPE "\r\n"
+                          "Content-Length: %zu\r\nConnection: close\r\n\r\n", text->len);
+    hh_metrics_reserve(&c->out, text->len);
+    memcpy(c->out.data + c->out.len, text->data, text->len);
+    c->out.len += text->len;
+    c->sent = 0;
+    hh_metrics_client_write(ev);
+}
+
+static void hh_metrics_accept(struct event *ev)
+{
+    event_add_read(metrics.master, hh_metrics_accept, NULL, metrics.sock, &metrics.ev_accept);
+
+    int fd = accept4(metrics.sock, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            zlog_warn("Metrics exporter failed to accept connection: %s", strerror(errno));
+        return;
+    }
+
+    for (int i = 0; i < HH_METRICS_MAX_CLIENTS; i++) {
+        struct hh_metrics_client *c = &metrics.clients[i];
+        if (c->fd != NO_SOCK)
+            continue;
+        c->fd = fd;
+        event_add_read(metrics.master, hh_metrics_client_read, c, fd, &c->ev_read);
+        event_add_timer(metrics.master, hh_metrics_client_timeout, c, HH_METRICS_TIMEOUT_SEC, &c->ev_timeout);
+        return;
+    }
+    zlog_debug("Metrics exporter busy: dropping connection");
+    close(fd);
+}
+
+/* set the path of the exporter socket */
+int dp_metrics_set_path(const char *path)
+{
+    BUG(!path, -1);
+    if (!is_valid_unix_path(path))
+        return -1;
+    strlcpy(metrics.path, path, sizeof(metrics.path));
+    zlog_debug("Configured metrics socket path to '%s'", metrics.path);
+    return 0;
+}
+
+/* start the exporter. Failing to is not fatal: it is optional */
+int init_dp_metrics(struct event_loop *master)
+{
+    BUG(!master, -1);
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    for (int i = 0; i < HH_METRICS_MAX_CLIENTS; i++)
+        metrics.clients[i].fd = NO_SOCK;
+    if (!metrics.path[0])
+        return 0;
+
+    metrics.master = master;
+    metrics.sock = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (metrics.sock < 0) {
+        zlog_err("Failed to open metrics socket: %s", strerror(errno));
+        metrics.sock = NO_SOCK;
+        return -1;
+    }
+    strlcpy(addr.sun_path, metrics.path, sizeof(addr.sun_path));
+    unlink(addr.sun_path);
+    if (bind(metrics.sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(metrics.sock, 16) < 0) {
+        zlog_err("Failed to listen on metrics socket '%s': %s", metrics.path, strerror(errno));
+        close(metrics.sock);
+        metrics.sock = NO_SOCK;
+        return -1;
+    }
+    chmod(metrics.path, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+
+    event_add_read(metrics.master, hh_metrics_accept, NULL, metrics.sock, &metrics.ev_accept);
+    zlog_info("Serving metrics at '%s'", metrics.path);
+    return 0;
+}
+
+void fini_dp_metrics(void)
+{
+    for (int i = 0; i < HH_METRICS_MAX_CLIENTS; i++) {
+        hh_metrics_client_close(&metrics.clients[i]);
+        hh_metrics_buf_free(&metrics.clients[i].out);
+    }
+    EVENT_OFF(metrics.ev_accept);
+    if (metrics.sock != NO_SOCK) {
+        close(metrics.sock);
+        metrics.sock = NO_SOCK;
+        unlink(metrics.path);
+    }
+    hh_metrics_buf_free(&metrics.text);
+}
@@ -0,0 +1,32 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef SRC_HH_DP_METRICS_H_
+#define SRC_HH_DP_METRICS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Metrics exporter. When a path is set, a unix stream socket is served in the main thread,
+ * outside the dplane pthread: each connection gets the metrics in OpenMetrics text format,
+ * with HTTP headers if it sent an HTTP request. The text is cached for a short while, so that
+ * bursts of scrapes cost a copy. Modules append the metrics they own to a buffer. */
+
+struct hh_metrics_buf {
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+/* append text / the TYPE and HELP lines of a metric family */
+void hh_metrics_printf(struct hh_metrics_buf *b, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+void hh_metrics_family(struct hh_metrics_buf *b, const char *name, const char *type, const char *help);
+
+/* set the path of the exporter socket. Empty (the default) disables the exporter */
+int dp_metrics_set_path(const char *path);
+
+/* start / stop the exporter, in the main thread */
+struct event_loop;
+int init_dp_metrics(struct event_loop *master);
+void fini_dp_metrics(void);
+
+#endif /* SRC_HH_DP_METRICS_H_ */
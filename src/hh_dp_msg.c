@@ -16,11 +16,66 @@
 #include "hh_dp_process.h" /* struct zebra_dplane_provider */
 #include "hh_dp_msg_cache.h"
 #include "hh_dp_rpc_stats.h"
+#include "hh_dp_state.h"
+#include "hh_dp_audit.h"
+#include "hh_dp_conv.h"
+#include "hh_dp_cpu.h"
+#include "hh_dp_trace.h"
+#include "hh_dp_usdt.h"
+#include "hh_dp_standby.h"
 #include "hh_dp_msg.h"
 
-static uint64_t seqnum = 1;
+/* Each shard is a stream of its own, with a seqn space of its own */
+static struct dp_stream {
+    uint64_t seqnum;     /* seqn of the next request */
+    uint64_t last_acked; /* seqn of the last request answered */
+} streams[DP_MAX_SHARDS] = {
+    [0 ... DP_MAX_SHARDS - 1] = { .seqnum = 1 },
+};
+static uint64_t gseqnum = 1; /* order of requests across shards */
+
+/* Cumulative acknowledgements turn a lost or reordered response into a success reported
+ * to zebra, so they are used only if configured and if dataplane advertises support for
+ * them in its Connect response. Until the protocol carries capability flags, support is
+ * advertised with a protocol revision newer than the one we are built against */
+#ifndef DP_CUMULATIVE_ACK_MIN_MAJOR
+#define DP_CUMULATIVE_ACK_MIN_MAJOR VER_DP_MAJOR
+#define DP_CUMULATIVE_ACK_MIN_MINOR (VER_DP_MINOR + 1)
+#endif
+static bool cumulative_acks = false;        /* configured */
+static bool cumulative_acks_dp = false;     /* advertised by dataplane */
+
+/* enable / disable cumulative acknowledgements */
+void dp_msg_set_cumulative_acks(bool enable)
+{
+    cumulative_acks = enable;
+    zlog_info("Cumulative acknowledgements are now %s%s", enable ? "enabled" : "disabled",
+              enable && !cumulative_acks_dp ? ", pending support by dataplane" : "");
+}
+bool dp_msg_cumulative_acks(void)
+{
+    return cumulative_acks && cumulative_acks_dp;
+}
+bool dp_msg_cumulative_acks_configured(void)
+{
+    return cumulative_acks;
+}
+
+/* learn from the connection info of a Connect response if dataplane acks cumulatively */
+static void dp_msg_cumulative_acks_learn(const struct RpcObject *object)
+{
+    bool supported = false;
 
-/* Build an Rpc Msg of type request */
+    if (object && object->type == ConnectInfo) {
+        const struct ver_info *v = &object->conn_info.verinfo;
+        supported = v->major == DP_CUMULATIVE_ACK_MIN_MAJOR && v->minor >= DP_CUMULATIVE_ACK_MIN_MINOR;
+    }
+    if (supported != cumulative_acks_dp)
+        zlog_info("Dataplane %s cumulative acknowledgements", supported ? "supports" : "does not support");
+    cumulative_acks_dp = supported;
+}
+
+/* Build an Rpc Msg of type request. Requests are numbered when their object is set */
 static struct dp_msg *dp_request_new(RpcOp Op, struct zebra_dplane_ctx *ctx)
 {
     BUG(!ctx && Op != Connect, NULL); /* all requests except connect require a context */
@@ -28,16 +83,39 @@ static struct dp_msg *dp_request_new(RpcOp Op, struct zebra_dplane_ctx *ctx)
     if (m) {
         m->msg.type = Request;
         m->msg.request.op = Op;
-        m->msg.request.seqn = Op == Connect ? 0 : seqnum++;
         m->ctx = ctx;
     }
     return m;
 }
 
+/* Set the shard of a request from its object and number it in the stream of the shard */
+static void dp_request_number(struct dp_msg *m)
+{
+    m->shard = dplane_shard_of(&m->msg.request.object);
+    m->msg.request.seqn = streams[m->shard].seqnum++;
+    m->gseqn = gseqnum++;
+}
+
+/* Queue a request for an object to dataplane */
+static int send_rpc_request(struct dp_msg *m)
+{
+    /* after a restart, dataplane may hold the object as requested already */
+    if (m->ctx && dp_state_warm_confirm(&m->msg.request)) {
+        dp_msg_hand_off(m, ZEBRA_DPLANE_REQUEST_SUCCESS);
+        dp_msg_recycle(m);
+        return 0;
+    }
+    dp_request_number(m);
+    dp_state_note_request(&m->msg.request);
+    if (m->ctx)
+        dp_conv_intake(m);
+    return send_rpc_msg(m);
+}
+
 /* send a Connect request with our versioning information. The plugin should not send
  * other messages until the dataplane verifies the versioning information and replies
  * with a success. */
-int send_rpc_request_connect(void)
+void dp_conn_info_object(struct RpcObject *object, uint64_t synt)
 {
     struct conn_info cinfo = {
             .name = "FRR-HHGW-plugin",
@@ -46,10 +124,19 @@ int send_rpc_request_connect(void)
                 .major = VER_DP_MAJOR,
                 .minor = VER_DP_MINOR,
                 .patch = VER_DP_PATCH},
-            .synt = dplane_get_synt()
+            .synt = synt
     };
+    conninfo_as_object(object, &cinfo);
+}
+int send_rpc_request_connect(uint8_t shard)
+{
     struct dp_msg *m = dp_request_new(Connect, NULL);
-    conninfo_as_object(&m->msg.request.object, &cinfo);
+    dp_conn_info_object(&m->msg.request.object, dplane_get_synt());
+
+    /* Connects carry the seqn of the last request answered in the stream of the
+     * shard, so that dataplane can tell which requests we may resend */
+    m->shard = shard;
+    m->msg.request.seqn = streams[shard].last_acked;
     return send_rpc_msg(m);
 }
 
@@ -77,7 +164,7 @@ int send_rpc_request_ifaddress(RpcOp op, struct zebra_dplane_ctx *ctx)
     struct dp_msg *m = dp_request_new(op, ctx);
     ifaddress_as_object(&m->msg.request.object, &ifa);
 
-    return send_rpc_msg(m);
+    return send_rpc_request(m);
 }
 
 /* Send a request to Add / Del an rmac */
@@ -103,7 +190,7 @@ int send_rpc_request_rmac(RpcOp op, struct zebra_dplane_ctx *ctx)
     struct dp_msg *m = dp_request_new(op, ctx);
     rmac_as_object(&m->msg.request.object, &rmac);
 
-    return send_rpc_msg(m);
+    return send_rpc_request(m);
 }
 
 /* encode an ip_route next-hop */
@@ -144,7 +231,7 @@ static inline void nhop_encode(struct next_hop *nhop, struct nexthop *nh)
 }
 
 /* map FRR's route types to the RPC types */
-static RouteType encode_route_type(unsigned int zebra_route_type) {
+RouteType encode_route_type(unsigned int zebra_route_type) {
     switch(zebra_route_type) {
         case ZEBRA_ROUTE_LOCAL: return Local;
         case ZEBRA_ROUTE_CONNECT: return Connected;
@@ -207,15 +294,77 @@ int send_rpc_request_iproute(RpcOp op, struct zebra_dplane_ctx *ctx)
     struct dp_msg *m = dp_request_new(op, ctx);
     iproute_as_object(&m->msg.request.object, &route);
 
+    return send_rpc_request(m);
+}
+
+/* Send a request to Add an object from the plugin's state snapshot. These requests
+ * carry no zebra context: they restore state that zebra already considers programmed. */
+int send_rpc_request_replay(const struct RpcObject *object)
+{
+    BUG(!object, -1);
+    struct dp_msg *m = dp_msg_new();
+    m->msg.type = Request;
+    m->msg.request.op = Add;
+    m->msg.request.object = *object;
+    m->flags |= DP_MSG_F_REPLAY;
+    dp_request_number(m);
     return send_rpc_msg(m);
 }
 
-/* Send a control message (keepalive) */
-int send_rpc_control(uint8_t refresh) {
+/* Send a request to Delete an object that dataplane kept across a restart of ours and
+ * that zebra no longer has. Like replays, these requests carry no zebra context. */
+int send_rpc_request_stale(const struct RpcObject *object)
+{
+    BUG(!object, -1);
+    struct dp_msg *m = dp_msg_new();
+    m->msg.type = Request;
+    m->msg.request.op = Del;
+    m->msg.request.object = *object;
+    dp_request_number(m);
+    return send_rpc_msg(m);
+}
+
+/* Send a Get request to fetch objects from dataplane, for audits. Dataplane answers with
+ * one or more responses carrying the objects, all but the last with result ExpectMore */
+int send_rpc_request_get(const struct RpcObject *object)
+{
+    BUG(!object, -1);
+    struct dp_msg *m = dp_msg_new();
+    m->msg.type = Request;
+    m->msg.request.op = Get;
+    m->msg.request.object = *object;
+    dp_request_number(m);
+    return send_rpc_msg(m);
+}
+
+/* Build a control message (keepalive, refresh echo) for a shard */
+static struct dp_msg *dp_control_new(uint8_t shard, uint8_t refresh) {
     struct dp_msg *m = dp_msg_new();
     m->msg.type = Control;
     m->msg.control.refresh = refresh;
-    return send_rpc_msg(m);
+    m->shard = shard;
+    return m;
+}
+
+/* Build a response to a request from dataplane, for the shard it came from */
+static struct dp_msg *dp_response_new(uint8_t shard, RpcOp op, uint64_t seqn, RpcResultCode rescode) {
+    struct dp_msg *m = dp_msg_new();
+    m->shard = shard;
+    m->msg.type = Response;
+    m->msg.response.op = op;
+    m->msg.response.seqn = seqn;
+    m->msg.response.rescode = rescode;
+    return m;
+}
+
+/* Send a control message (keepalive) over a shard */
+int send_rpc_control(uint8_t shard, uint8_t refresh) {
+    return send_rpc_msg(dp_control_new(shard, refresh));
+}
+
+/* Send a response to a request from dataplane, over the shard it came from */
+int send_rpc_response(uint8_t shard, RpcOp op, uint64_t seqn, RpcResultCode rescode) {
+    return send_rpc_msg(dp_response_new(shard, op, seqn, rescode));
 }
 
 /* handle messages from dataplane */
@@ -233,16 +382,18 @@ static inline bool got_expected_response(struct RpcResponse *resp, struct RpcReq
         return true;
     }
 }
-static struct dp_msg *recover_request(struct RpcResponse *resp)
+static struct dp_msg *recover_request(uint8_t shard, struct RpcResponse *resp)
 {
     BUG(!resp, NULL);
 
-    /* dequeue msg from in-flight list/queue */
-    struct dp_msg *m = dp_msg_pop_inflight();
+    /* dequeue msg from in-flight list/queue of the shard */
+    struct dp_msg *m = dp_msg_pop_inflight(shard);
     if (!m) {
         /* we got a response but had no request outstanding. Either we failed to store a request
          * or received an unsolicited / duplicate response */
+        HH_USDT_PROBE(recover, (uint64_t)resp->seqn, (int)resp->op, 0, (int)resp->rescode, 0, shard);
         zlog_err("Unable to find request with seqn #%lu: there are no outstanding requests", resp->seqn);
+        dp_state_invalidate("unsolicited response");
         return NULL;
     }
     /* we should recover a request, since we only cache requests */
@@ -252,10 +403,16 @@ static struct dp_msg *recover_request(struct RpcResponse *resp)
     }
     /* make sure that the request corresponds to the response. We rely on responses not being re-ordered
      * here, by design. Otherwise a hash table keyed on the seqn could be used, instead of a list */
-    if (!got_expected_response(resp, &m->msg.request))
+    if (!got_expected_response(resp, &m->msg.request)) {
+        dp_state_invalidate("unexpected response");
         goto done;
+    }
 
     /* success: we recovered the right request */
+    HH_USDT_PROBE(recover, (uint64_t)resp->seqn, (int)resp->op, (int)m->msg.request.object.type,
+                  (int)resp->rescode, 1, shard);
+    if (m->ts_sent)
+        dp_tx_note_rtt(hh_monotime_us() - m->ts_sent);
     return m;
 
 done:
@@ -264,7 +421,7 @@ done:
         dp_msg_recycle(m);
     return NULL;
 }
-static void handle_rpc_connect_response(struct RpcResponse *resp, bool purged)
+static void handle_rpc_connect_response(uint8_t shard, struct RpcResponse *resp, bool purged)
 {
     BUG(!resp);
 
@@ -276,14 +433,17 @@ static void handle_rpc_connect_response(struct RpcResponse *resp, bool purged)
 
     if (resp->rescode == Ok) {
         if (!dplane_is_ready())
-            zlog_info("Dataplane positively acked Connect.");
+            zlog_info("Dataplane positively acked Connect on socket %u.", shard);
 
-        /* recall synt */
-        if (resp->objects)
+        /* recall synt. Tell the state snapshot, which may hold objects from a prior run */
+        if (resp->objects) {
+            dp_state_warm_check(resp->objects->conn_info.synt);
             dplane_set_synt(resp->objects->conn_info.synt);
+        }
+        dp_msg_cumulative_acks_learn(resp->objects);
 
-        /* allow further communications */
-        dplane_set_ready(true);
+        /* allow further communications over the shard */
+        dplane_set_ready(shard, true);
 
         /* attempt to send messages that we cached because DP had not opened
          * socket or we had not received response to Connect request, but only if
@@ -298,22 +458,46 @@ static void handle_rpc_connect_response(struct RpcResponse *resp, bool purged)
     }
 }
 
+/* number of contexts handed off to zebra since it was last signaled */
+static uint32_t hand_off_pending = 0;
+
 void dp_msg_hand_off(struct dp_msg *dp_msg, enum zebra_dplane_result result) {
 
+    HH_USDT_PROBE(hand_off, dp_msg->ctx, (int)result, HH_USDT_SEQN(&dp_msg->msg), HH_USDT_OP(&dp_msg->msg),
+                  HH_USDT_OTYPE(&dp_msg->msg));
+
     /* set result */
     dplane_ctx_set_status(dp_msg->ctx, result);
 
-    /* queue back to zebra */
+    /* queue back to zebra. Zebra is signaled once per batch, in dp_msg_hand_off_flush() */
     dplane_provider_enqueue_out_ctx(prov_p, dp_msg->ctx);
-    dplane_provider_work_ready();
+    hand_off_pending++;
     dp_msg->ctx = NULL; /* imposed to allow recycle */
 }
 
+/* signal zebra that the contexts handed off so far are ready */
+void dp_msg_hand_off_flush(void) {
+    if (!hand_off_pending)
+        return;
+
+    dplane_provider_work_ready();
+    rpc_count_hand_off(hand_off_pending);
+    hand_off_pending = 0;
+}
+
 static void handle_rpc_ctx_response(struct dp_msg *m, RpcResultCode rescode)
 {
     BUG(!prov_p);
     BUG(!m);
 
+    /* keep track of what dataplane holds */
+    dp_state_update(&m->msg.request, rescode);
+
+    /* dataplane refused an object that zebra considers programmed. The snapshot no longer
+     * reflects zebra's view: let zebra serve the next refresh */
+    if ((m->flags & DP_MSG_F_REPLAY) && rescode != Ok && rescode != Ignored)
+        dp_state_invalidate("replayed object refused by dataplane");
+
     if (m->ctx) {
         /* set the result - we treat ignored requests as successes for the time being */
         enum zebra_dplane_result result = (rescode == Ok || rescode == Ignored) ? ZEBRA_DPLANE_REQUEST_SUCCESS : ZEBRA_DPLANE_REQUEST_FAILURE;
@@ -325,72 +509,238 @@ static void do_handle_rpc_response(struct RpcResponse *resp, struct dp_msg *m, b
 
     char *pfx = purged ? "(purged)" : " ";
 
-    /* account */
+    /* account. Responses faked on a purge tell nothing about latency */
     rpc_count_request_replied(m->msg.request.op, m->msg.request.object.type, resp->rescode);
-
-    /* log outcome of request */
-    if (log_dataplane_msg) {
-        switch(resp->rescode) {
-            case Ok:
+    if (!purged && m->ts_sent) {
+        uint64_t now = hh_monotime_us();
+        rpc_count_latency(m->msg.request.op, m->msg.request.object.type, now - m->ts_sent);
+        dp_conv_complete(m, now);
+    }
+    if (m->msg.request.op != Connect && m->msg.request.seqn > streams[m->shard].last_acked)
+        streams[m->shard].last_acked = m->msg.request.seqn;
+
+    /* trace outcome of request. Failures are logged regardless */
+    struct hh_cpu_frame cpu;
+    hh_cpu_begin(&cpu);
+    hh_trace_outcome(m->shard, &m->msg.request, resp->rescode, purged);
+    switch(resp->rescode) {
+        case Ok:
+            if (log_dataplane_msg)
                 zlog_debug("%s #%lu Op '%s' succeeded for %s", pfx, resp->seqn, str_rpc_op(m->msg.request.op), fmt_rpcobject(fb, true, &m->msg.request.object));
-                break;
-            case Ignored:
+            break;
+        case Ignored:
+            if (log_dataplane_msg)
                 zlog_debug("%s #%lu Op '%s' was ignored for %s", pfx, resp->seqn, str_rpc_op(m->msg.request.op), fmt_rpcobject(fb, true, &m->msg.request.object));
-                break;
-            default:
-                zlog_err("%s #%lu Op '%s' FAILED(%s) for %s", pfx, resp->seqn, str_rpc_op(m->msg.request.op), str_rescode(resp->rescode), fmt_rpcobject(fb, true, &m->msg.request.object));
-                break;
-        }
+            break;
+        default:
+            zlog_err("%s #%lu Op '%s' FAILED(%s) for %s", pfx, resp->seqn, str_rpc_op(m->msg.request.op), str_rescode(resp->rescode), fmt_rpcobject(fb, true, &m->msg.request.object));
+            break;
     }
+    hh_cpu_end(&cpu, HH_CPU_LOG, 1);
 
     /* handle response */
     switch(resp->op) {
         case Connect:
-            handle_rpc_connect_response(resp, purged);
+            handle_rpc_connect_response(m->shard, resp, purged);
             break;
         case Add:
         case Del:
         case Update:
             handle_rpc_ctx_response(m, resp->rescode);
             break;
+        case Get:
+            /* a faked response carries no objects */
+            if (purged)
+                dp_audit_abort("dataplane restarted");
+            else
+                dp_audit_response(resp);
+            break;
         default:
             zlog_err("Received response to unknown operation %u!!", resp->op);
             break;
     }
 }
-static void handle_rpc_response(struct RpcResponse *resp)
+/* Since responses come in order, a response for a request that is not the oldest one
+ * in flight acknowledges all of the requests before it: dataplane sends a response for
+ * each request that failed, but may skip the responses for those that succeeded.
+ * Connect requests are never acknowledged this way. */
+static void complete_acked_requests(uint8_t shard, struct RpcResponse *resp)
 {
-    BUG(!resp);
+    struct dp_msg *m;
+    uint32_t count = 0;
 
-    /* Check if what we get is a response to a Connect */
-    if (resp->op == Connect && resp->objects != NULL && dplane_get_synt() != 0 && resp->objects->conn_info.synt != dplane_get_synt()) {
-        zlog_warn("Dataplane restarted! Purging in-flight queue...");
+    while ((m = dp_msg_peek_inflight(shard)) != NULL) {
+        if (m->msg.type != Request || m->msg.request.op == Connect || m->msg.request.seqn >= resp->seqn)
+            break;
 
-        /* Alright, we have strong evidence that dataplane restarted: we were connected before and it reports a distinct
-         * sync token. This means chances are that we are expecting responses to requests sent to the previous incarnation
-         * that we will never receive. Since dataplane will request a refresh of the state, drain the in-flight
-         * queue pretending that all of the operations succeeded. On refresh, if they fail, the right state will
-         * be sent back to frr. The only response we don't fake is the one for the Connect request.
-         */
-        struct dp_msg *m;
-        while ((m = dp_msg_pop_inflight()) != 0) {
-            if (m->msg.request.op != Connect) {
+        m = dp_msg_pop_inflight(shard);
+        struct RpcResponse ack = {
+            .op = m->msg.request.op,
+            .seqn = m->msg.request.seqn,
+            .rescode = Ok,
+        };
+        do_handle_rpc_response(&ack, m, false);
+        dp_msg_recycle(m);
+        count++;
+    }
+    if (count)
+        rpc_count_cumulative_ack(count);
+}
+/* Resume after a reconnect to the same dataplane instance. Requests sent before the
+ * socket failed may still be in flight, ahead of the Connect. The Connect response
+ * carries the seqn of the last request that dataplane processed, but not the results:
+ * those requests are sent again along with the rest, before any other message, so
+ * that they complete with the results dataplane gives. */
+static void handle_rpc_connect_resume(uint8_t shard, struct RpcResponse *resp)
+{
+    struct dp_msg_list_head gap;
+    struct dp_msg *m, *connect = NULL;
+    uint32_t processed = 0;
+
+    dp_msg_list_init(&gap);
+    while ((m = dp_msg_pop_inflight(shard)) != NULL) {
+        if (m->msg.request.op == Connect) {
+            /* keep the last Connect only: prior ones were sent on a failed socket */
+            if (connect)
+                dp_msg_recycle(connect);
+            connect = m;
+            continue;
+        }
+        if (m->msg.request.seqn <= resp->seqn)
+            processed++;
+        m->ts_sent = 0;
+        dp_msg_list_add_tail(&gap, m);
+    }
+
+    size_t resend = dp_msg_list_count(&gap);
+    if (resend) {
+        zlog_info("Resuming after reconnect of socket %u: dataplane processed up to #%lu; %zu requests to be resent, %u of them processed",
+                shard, resp->seqn, resend, processed);
+        rpc_count_resume(processed, resend);
+    }
+    dp_msg_unsent_requeue(shard, &gap);
+    dp_msg_list_fini(&gap);
+
+    /* handle the Connect response itself. This sends the messages pending */
+    do_handle_rpc_response(resp, connect, false);
+    dp_msg_recycle(connect);
+}
+/* Failover to the standby dataplane. The requests it confirmed Ok are completed as if the
+ * former dataplane had answered. The rest, including those it failed or may not have got,
+ * are kept to be sent to the new one, which will answer them */
+void dp_msg_failover(const struct dp_standby_acks *acks)
+{
+    BUG(!acks);
+    struct dp_msg_list_head keep;
+    struct dp_msg *m;
+    uint32_t completed = 0, unconfirmed = 0;
+    size_t kept = 0;
+
+    dp_msg_list_init(&keep);
+    for (uint8_t shard = 0; shard < DP_MAX_SHARDS; shard++) {
+        /* in-flight requests precede unsent ones */
+        while ((m = dp_msg_pop_inflight(shard)) != NULL || (m = dp_msg_pop_unsent(shard)) != NULL) {
+            if (m->msg.type == Request && m->msg.request.op == Connect) {
+                dp_msg_recycle(m);
+            } else if (m->msg.type == Request && dp_standby_acks_ok(acks, m->gseqn)) {
                 struct RpcResponse fake = {0};
                 fake.seqn = m->msg.request.seqn;
                 fake.op = m->msg.request.op;
                 fake.rescode = Ok;
                 do_handle_rpc_response(&fake, m, true);
+                dp_msg_recycle(m);
+                completed++;
             } else {
+                if (m->msg.type == Request && m->gseqn <= acks->acked)
+                    unconfirmed++;
+                dp_msg_list_add_tail(&keep, m);
+            }
+        }
+        kept += dp_msg_list_count(&keep);
+        dp_msg_unsent_requeue(shard, &keep);
+    }
+    zlog_info("Failover: %u requests completed by standby dataplane, %zu to be sent (%u it did not confirm)",
+            completed, kept, unconfirmed);
+    dp_msg_list_fini(&keep);
+    dp_msg_hand_off_flush();
+}
+/* Dataplane restarted: purge the in-flight queues of all shards, since it will not answer
+ * the requests sent to its previous incarnation. The Connect response is handled with the
+ * Connect request of its shard. Connects of other shards stay in flight */
+static void purge_rpc_requests(uint8_t shard, struct RpcResponse *resp)
+{
+    struct dp_msg_list_head connects;
+    struct dp_msg *m;
+
+    dp_msg_list_init(&connects);
+    for (uint8_t i = 0; i < DP_MAX_SHARDS; i++) {
+        while ((m = dp_msg_pop_inflight(i)) != 0) {
+            if (m->msg.request.op != Connect) {
+                struct RpcResponse fake = {0};
+                fake.seqn = m->msg.request.seqn;
+                fake.op = m->msg.request.op;
+                fake.rescode = Ok;
+                do_handle_rpc_response(&fake, m, true);
+            } else if (i == shard) {
                 do_handle_rpc_response(resp, m, true);
+            } else {
+                dp_msg_list_add_tail(&connects, m);
+                continue;
             }
             dp_msg_recycle(m);
         }
+    }
+    while ((m = dp_msg_list_pop(&connects)) != NULL)
+        dp_msg_cache_inflight(m);
+    dp_msg_list_fini(&connects);
+}
+
+static void handle_rpc_response(uint8_t shard, struct RpcResponse *resp)
+{
+    BUG(!resp);
+
+    /* Check if what we get is a response to a Connect */
+    if (resp->op == Connect && resp->objects != NULL && dplane_get_synt() != 0 && resp->objects->conn_info.synt != dplane_get_synt()) {
+        zlog_warn("Dataplane restarted! Purging in-flight queues...");
+
+        /* Alright, we have strong evidence that dataplane restarted: we were connected before and it reports a distinct
+         * sync token. This means chances are that we are expecting responses to requests sent to the previous incarnation
+         * that we will never receive. Since dataplane will request a refresh of the state, drain the in-flight
+         * queue pretending that all of the operations succeeded. On refresh, if they fail, the right state will
+         * be sent back to frr. The only response we don't fake is the one for the Connect request.
+         */
+        purge_rpc_requests(shard, resp);
         zlog_debug("Post dataplane restart purge completed");
         return;
     }
 
+    /* Connect responses are not matched against the oldest request in flight: requests
+     * sent before a reconnect may be ahead */
+    if (resp->op == Connect) {
+        if (!dp_msg_inflight_has_connect(shard)) {
+            zlog_err("Unable to find Connect request for Connect response #%lu", resp->seqn);
+            return;
+        }
+        handle_rpc_connect_resume(shard, resp);
+        return;
+    }
+
+    /* complete the requests acknowledged cumulatively by this response */
+    if (dp_msg_cumulative_acks())
+        complete_acked_requests(shard, resp);
+
+    /* partial responses to a Get: the request stays in flight until the last one */
+    if (resp->op == Get && resp->rescode == ExpectMore) {
+        struct dp_msg *m = dp_msg_peek_inflight(shard);
+        if (!m || m->msg.type != Request || !got_expected_response(resp, &m->msg.request))
+            return;
+        rpc_count_request_replied(Get, m->msg.request.object.type, resp->rescode);
+        dp_audit_response(resp);
+        return;
+    }
+
     /* lookup the request that we cached until a response was received */
-    struct dp_msg *m = recover_request(resp);
+    struct dp_msg *m = recover_request(shard, resp);
     if (!m)
         return;
 
@@ -400,32 +750,117 @@ static void handle_rpc_response(struct RpcResponse *resp)
     /* recycle message */
     dp_msg_recycle(m);
 }
-static void handle_rpc_control(struct RpcControl *ctl) {
-    if (ctl->refresh) {
+/* Serve a refresh from our snapshot if we can. Otherwise, ask zebra. Zebra can only
+ * refresh everything, regardless of the scope requested. The answers to the refresh
+ * (echoes or a response) are sent by the replay after the objects replayed. Zebra does
+ * not tell when its refresh completes, so they are sent right away if it serves it. */
+static void do_refresh(const struct dp_state_scope *scope, struct dp_msg_list_head *answers)
+{
+    struct dp_msg *m;
+
+    if (dp_state_replay(scope, answers) == 0) {
+        zlog_warn("Got refresh request from dataplane. Replaying plugin state...");
+    } else {
         zlog_warn("Got refresh request from dataplane. Requesting refresh...");
+        dp_state_flush();
         zebra_dplane_provider_refresh(dplane_provider_get_id(prov_p), DPLANE_REFRESH_ALL);
-        send_rpc_control(1);
+    }
+    while ((m = dp_msg_list_pop(answers)) != NULL)
+        send_rpc_msg(m);
+}
+static void handle_rpc_control(struct RpcControl *ctl) {
+    if (ctl->refresh) {
+        struct dp_state_scope scope = { .otypes = DP_STATE_OTYPES_ALL };
+
+        /* refresh restricted to some object types */
+        if (!(ctl->refresh & DP_REFRESH_ALL)) {
+            scope.otypes = 0;
+            if (ctl->refresh & DP_REFRESH_IFADDRESS)
+                scope.otypes |= DP_STATE_OTYPE(IfAddress);
+            if (ctl->refresh & DP_REFRESH_RMAC)
+                scope.otypes |= DP_STATE_OTYPE(Rmac);
+            if (ctl->refresh & DP_REFRESH_IPROUTE)
+                scope.otypes |= DP_STATE_OTYPE(IpRoute);
+        }
+        /* echo the refresh on every shard, once it is served */
+        struct dp_msg_list_head echoes;
+        dp_msg_list_init(&echoes);
+        for (uint8_t i = 0; i < dplane_num_shards(); i++)
+            dp_msg_list_add_tail(&echoes, dp_control_new(i, ctl->refresh));
+
+        if (scope.otypes) {
+            do_refresh(&scope, &echoes);
+        } else {
+            struct dp_msg *m;
+            zlog_warn("Ignoring refresh request with unknown scope 0x%x", ctl->refresh);
+            while ((m = dp_msg_list_pop(&echoes)) != NULL)
+                send_rpc_msg(m);
+        }
+        dp_msg_list_fini(&echoes);
     }
     rpc_count_ctl_rx();
 }
 
+/* Requests from dataplane. Only Gets for refreshing state are supported */
+static void handle_rpc_request(uint8_t shard, struct RpcRequest *req) {
+    struct dp_state_scope scope = {0};
+
+    if (req->op != Get) {
+        zlog_warn("Received unsupported request '%s' from dataplane", str_rpc_op(req->op));
+        send_rpc_response(shard, req->op, req->seqn, Failure);
+        return;
+    }
+
+    switch(req->object.type) {
+        case IpRoute:
+            /* routes in a vrf, or a table of it */
+            scope.otypes = DP_STATE_OTYPE(IpRoute);
+            scope.has_vrf = true;
+            scope.vrfid = req->object.route.vrfid;
+            scope.has_table = (req->object.route.tableid != 0);
+            scope.tableid = req->object.route.tableid;
+            break;
+        case Rmac:
+        case IfAddress:
+            scope.otypes = DP_STATE_OTYPE(req->object.type);
+            break;
+        default:
+            zlog_warn("Received Get request for unsupported object type '%s'", str_object_type(req->object.type));
+            send_rpc_response(shard, req->op, req->seqn, Failure);
+            return;
+    }
+
+    /* answer the Get once the refresh is served */
+    struct dp_msg_list_head answer;
+    dp_msg_list_init(&answer);
+    dp_msg_list_add_tail(&answer, dp_response_new(shard, req->op, req->seqn, Ok));
+    do_refresh(&scope, &answer);
+    dp_msg_list_fini(&answer);
+}
+
 
-/* entry point for incoming messages */
-void handle_rpc_msg(struct RpcMsg *msg)
+/* entry point for incoming messages, received over a shard */
+void handle_rpc_msg(uint8_t shard, struct RpcMsg *msg)
 {
     BUG(!msg);
 
+    struct hh_cpu_frame cpu;
+    hh_cpu_begin(&cpu);
+    hh_trace_msg(HH_TRACE_RX, shard, msg);
     if (log_dataplane_msg && msg->type != Control && msg->type != Response)
         zlog_debug("Handling %s", fmt_rpc_msg(fb, true, msg));
+    hh_cpu_end(&cpu, HH_CPU_LOG, 1);
 
     switch(msg->type) {
         case Response:
-            handle_rpc_response(&msg->response);
+            handle_rpc_response(shard, &msg->response);
             break;
         case Control:
             handle_rpc_control(&msg->control);
             break;
         case Request:
+            handle_rpc_request(shard, &msg->request);
+            break;
         case Notification:
             /* These messages are not handled yet as the behavior is not specified */
             zlog_warn("Received msg '%s' from dataplane", str_msg_type(msg->type));
@@ -4,18 +4,52 @@
 #define SRC_HH_DP_MSG_H_
 
 #include <dplane-rpc/dplane-rpc.h>
+#include "zebra/zebra_dplane.h"
+#include "hh_dp_msg_cache.h" /* struct dp_msg */
+
+/* Interpretation of RpcControl.refresh. A value of 1 (DP_REFRESH_ALL) requests a full
+ * refresh. Other bits restrict the refresh to some object types. Refreshes of the routes
+ * in a vrf / table are requested by dataplane with a Get request for an IpRoute object,
+ * where the vrfid and tableid (if not 0) determine the scope. */
+#define DP_REFRESH_ALL       0x01
+#define DP_REFRESH_IFADDRESS 0x02
+#define DP_REFRESH_RMAC      0x04
+#define DP_REFRESH_IPROUTE   0x08
+
+/* build the object of a Connect request */
+void dp_conn_info_object(struct RpcObject *object, uint64_t synt);
 
 /* Functions to send dataplane RPC requests */
-int send_rpc_request_connect(void);
+int send_rpc_request_connect(uint8_t shard);
 int send_rpc_request_ifaddress(RpcOp op, struct zebra_dplane_ctx *ctx);
 int send_rpc_request_rmac(RpcOp op, struct zebra_dplane_ctx *ctx);
 int send_rpc_request_iproute(RpcOp op, struct zebra_dplane_ctx *ctx);
+int send_rpc_request_replay(const struct RpcObject *object);
+int send_rpc_request_stale(const struct RpcObject *object);
+int send_rpc_request_get(const struct RpcObject *object);
+
+int send_rpc_control(uint8_t shard, uint8_t refresh);
+int send_rpc_response(uint8_t shard, RpcOp op, uint64_t seqn, RpcResultCode rescode);
+
+/* Enable / disable cumulative acknowledgements: a response to a request completes all
+ * of the requests in flight before it as successful. They are off by default, and only
+ * used if dataplane supports them */
+void dp_msg_set_cumulative_acks(bool enable);
+bool dp_msg_cumulative_acks(void);
+bool dp_msg_cumulative_acks_configured(void);
+
+/* map a zebra route type to dataplane's */
+RouteType encode_route_type(unsigned int zebra_route_type);
 
-int send_rpc_control(uint8_t refresh);
+/* Entry point for RPC msg processing, for messages received over a shard */
+void handle_rpc_msg(uint8_t shard, struct RpcMsg *msg);
 
-/* Entry point for RPC msg processing */
-void handle_rpc_msg(struct RpcMsg *msg);
+/* Failover to the standby dataplane, given what it confirmed of the requests mirrored */
+struct dp_standby_acks;
+void dp_msg_failover(const struct dp_standby_acks *acks);
 
+/* Hand off a context to zebra. Contexts are batched until dp_msg_hand_off_flush() */
 void dp_msg_hand_off(struct dp_msg *dp_msg, enum zebra_dplane_result result);
+void dp_msg_hand_off_flush(void);
 
 #endif /* SRC_HH_DP_MSG_H_ */
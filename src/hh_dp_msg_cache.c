@@ -4,15 +4,42 @@
 #include "lib/libfrr.h"
 #include "hh_dp_internal.h"
 #include "hh_dp_msg_cache.h"
-#include "zebra/zebra_dplane.h" /* dplane_ctx_reset() */
+#include "hh_dp_stats_shm.h"
+#include "hh_dp_metrics.h"
+#include "zebra/zebra_dplane.h" /* dplane_ctx_reset(), dplane_get_thread_master() */
 
 DEFINE_MTYPE(ZEBRA, HH_DP_MSG, "HH Dataplane msg");
 
+/* Queue gauges: lists are sampled every second, and the last samples kept in a ring */
+#define DP_QUEUE_SAMPLE_SEC 1
+#define DP_QUEUE_SAMPLES 300
+#define DP_QUEUE_ROW_SAMPLES 10     /* samples per row shown */
+#define DP_QUEUE_AGE_BUCKETS 7      /* <100us, <1ms, <10ms, <100ms, <1s, <10s, >=10s */
+
+enum dp_queue_id { DP_Q_UNSENT = 0, DP_Q_IN_FLIGHT, DP_Q_MAX };
+
+struct dp_queue_sample {
+    uint64_t t;                     /* usec */
+    uint32_t depth[DP_Q_MAX];
+    uint64_t oldest[DP_Q_MAX];      /* age of oldest message, usec */
+};
+
+static struct dp_queue_gauges {
+    size_t hwm_pool;
+    size_t hwm[DP_Q_MAX];
+    struct event *ev_sample;
+    struct dp_queue_sample samples[DP_QUEUE_SAMPLES];
+    uint64_t num_samples;
+    uint64_t age_hist[DP_Q_MAX][DP_QUEUE_AGE_BUCKETS];  /* at the last sample */
+} gauges;
+
 /* Message cache */
 struct dp_msg_cache {
     struct dp_msg_list_head pool; /* empty messages available for use */
-    struct dp_msg_list_head unsent; /* messages that have not yet been sent */
-    struct dp_msg_list_head in_flight; /* messages sent, not yet answered */
+    struct dp_msg_shard_lists {
+        struct dp_msg_list_head unsent; /* messages that have not yet been sent */
+        struct dp_msg_list_head in_flight; /* messages sent, not yet answered */
+    } shards[DP_MAX_SHARDS];
 } msg_cache = {0};
 
 /* free a dp_msg */
@@ -78,6 +105,12 @@ void dp_msg_recycle(struct dp_msg *msg)
     BUG(!msg);
     BUG(msg->ctx); /* should have been disposed and cleared */
     dp_msg_list_add_tail(&msg_cache.pool, msg);
+    gauges.hwm_pool = MAX(gauges.hwm_pool, dp_msg_list_count(&msg_cache.pool));
+}
+
+static inline void dp_msg_unsent_hwm(void)
+{
+    gauges.hwm[DP_Q_UNSENT] = MAX(gauges.hwm[DP_Q_UNSENT], dp_msg_unsent_count());
 }
 
 /* cache a message that plugin has not been able to send; e.g.
@@ -87,24 +120,36 @@ void dp_msg_recycle(struct dp_msg *msg)
 void dp_msg_cache_unsent(struct dp_msg *msg)
 {
     BUG(!msg);
-    dp_msg_list_add_tail(&msg_cache.unsent, msg);
+    BUG(msg->shard >= DP_MAX_SHARDS);
+    if (!msg->ts_queued)
+        msg->ts_queued = hh_monotime_us();
+    dp_msg_list_add_tail(&msg_cache.shards[msg->shard].unsent, msg);
+    dp_msg_unsent_hwm();
 }
 
 /* cache a message back to the head of unsent messages */
 void dp_msg_unsent_push_back(struct dp_msg *msg)
 {
     BUG(!msg);
-    dp_msg_list_add_head(&msg_cache.unsent, msg);
+    BUG(msg->shard >= DP_MAX_SHARDS);
+    dp_msg_list_add_head(&msg_cache.shards[msg->shard].unsent, msg);
+    dp_msg_unsent_hwm();
 }
 
 /* dequeue msg from unsent queue */
-struct dp_msg *dp_msg_pop_unsent(void) {
-    return dp_msg_list_pop(&msg_cache.unsent);
+struct dp_msg *dp_msg_pop_unsent(uint8_t shard) {
+    return dp_msg_list_pop(&msg_cache.shards[shard].unsent);
 }
 
-/* length of unsent list */
+/* length of unsent lists */
 size_t dp_msg_unsent_count(void) {
-    return dp_msg_list_count(&msg_cache.unsent);
+    size_t count = 0;
+    for (int i = 0; i < DP_MAX_SHARDS; i++)
+        count += dp_msg_list_count(&msg_cache.shards[i].unsent);
+    return count;
+}
+size_t dp_msg_shard_unsent_count(uint8_t shard) {
+    return dp_msg_list_count(&msg_cache.shards[shard].unsent);
 }
 
 /* length of pool list */
@@ -112,22 +157,251 @@ size_t dp_msg_pool_count(void) {
     return dp_msg_list_count(&msg_cache.pool);
 }
 
-/* length of inflight list */
+/* length of inflight lists */
 size_t dp_msg_in_flight_count(void) {
-    return dp_msg_list_count(&msg_cache.in_flight);
+    size_t count = 0;
+    for (int i = 0; i < DP_MAX_SHARDS; i++)
+        count += dp_msg_list_count(&msg_cache.shards[i].in_flight);
+    return count;
+}
+size_t dp_msg_shard_in_flight_count(uint8_t shard) {
+    return dp_msg_list_count(&msg_cache.shards[shard].in_flight);
 }
 
 /* Cache a message (e.g. a Request) until we get the corresponding response */
 void dp_msg_cache_inflight(struct dp_msg *msg)
 {
     BUG(!msg);
+    BUG(msg->shard >= DP_MAX_SHARDS);
     assert(msg->msg.type == Request);
-    dp_msg_list_add_tail(&msg_cache.in_flight, msg);
+    dp_msg_list_add_tail(&msg_cache.shards[msg->shard].in_flight, msg);
+    gauges.hwm[DP_Q_IN_FLIGHT] = MAX(gauges.hwm[DP_Q_IN_FLIGHT], dp_msg_in_flight_count());
 }
 
 /* dequeue msg from in-flight queue */
-struct dp_msg *dp_msg_pop_inflight(void) {
-    return dp_msg_list_pop(&msg_cache.in_flight);
+struct dp_msg *dp_msg_pop_inflight(uint8_t shard) {
+    return dp_msg_list_pop(&msg_cache.shards[shard].in_flight);
+}
+
+/* oldest message in the in-flight list, without dequeueing it */
+struct dp_msg *dp_msg_peek_inflight(uint8_t shard) {
+    return dp_msg_list_first(&msg_cache.shards[shard].in_flight);
+}
+
+/* tell if there is a Connect request in flight */
+bool dp_msg_inflight_has_connect(uint8_t shard)
+{
+    struct dp_msg *msg;
+
+    frr_each(dp_msg_list, &msg_cache.shards[shard].in_flight, msg) {
+        if (msg->msg.type == Request && msg->msg.request.op == Connect)
+            return true;
+    }
+    return false;
+}
+
+/* put a list of messages at the head of the unsent list, keeping their order */
+void dp_msg_unsent_requeue(uint8_t shard, struct dp_msg_list_head *list)
+{
+    BUG(!list);
+    struct dp_msg *msg;
+
+    while ((msg = dp_msg_list_last(list)) != NULL) {
+        dp_msg_list_del(list, msg);
+        msg->shard = shard;
+        dp_msg_list_add_head(&msg_cache.shards[shard].unsent, msg);
+    }
+    dp_msg_unsent_hwm();
+}
+
+/* invoke cb for every message pending to be sent or answered, oldest first in each shard */
+void dp_msg_pending_walk(void (*cb)(struct dp_msg *msg, void *arg), void *arg)
+{
+    BUG(!cb);
+    struct dp_msg *msg;
+
+    for (int i = 0; i < DP_MAX_SHARDS; i++) {
+        frr_each(dp_msg_list, &msg_cache.shards[i].in_flight, msg)
+            cb(msg, arg);
+        frr_each(dp_msg_list, &msg_cache.shards[i].unsent, msg)
+            cb(msg, arg);
+    }
+}
+
+static inline unsigned int dp_queue_age_bucket(uint64_t age)
+{
+    unsigned int b = 0;
+    for (uint64_t bound = 100; b < DP_QUEUE_AGE_BUCKETS - 1 && age >= bound; bound *= 10)
+        b++;
+    return b;
+}
+
+/* account the age of the messages of a list. Returns that of the oldest */
+static uint64_t dp_queue_sample_list(struct dp_msg_list_head *list, enum dp_queue_id q, uint64_t now)
+{
+    struct dp_msg *msg;
+    uint64_t oldest = 0;
+
+    frr_each(dp_msg_list, list, msg) {
+        uint64_t ts = q == DP_Q_UNSENT ? msg->ts_queued : msg->ts_sent;
+        if (!ts)
+            continue;
+        uint64_t age = now > ts ? now - ts : 0;
+        gauges.age_hist[q][dp_queue_age_bucket(age)]++;
+        oldest = MAX(oldest, age);
+    }
+    return oldest;
+}
+
+/* sample the depth and age of the lists. Walking them here, in the dplane pthread that
+ * owns them, spares the vty any access to the lists themselves */
+static void dp_queue_sample(struct event *ev)
+{
+    struct dp_queue_sample *s = &gauges.samples[gauges.num_samples % DP_QUEUE_SAMPLES];
+    uint64_t now = hh_monotime_us();
+
+    event_add_timer(dplane_get_thread_master(), dp_queue_sample, NULL, DP_QUEUE_SAMPLE_SEC, &gauges.ev_sample);
+
+    memset(s, 0, sizeof(*s));
+    memset(gauges.age_hist, 0, sizeof(gauges.age_hist));
+    s->t = now;
+    s->depth[DP_Q_UNSENT] = dp_msg_unsent_count();
+    s->depth[DP_Q_IN_FLIGHT] = dp_msg_in_flight_count();
+    for (int i = 0; i < DP_MAX_SHARDS; i++) {
+        s->oldest[DP_Q_UNSENT] = MAX(s->oldest[DP_Q_UNSENT],
+                dp_queue_sample_list(&msg_cache.shards[i].unsent, DP_Q_UNSENT, now));
+        s->oldest[DP_Q_IN_FLIGHT] = MAX(s->oldest[DP_Q_IN_FLIGHT],
+                dp_queue_sample_list(&msg_cache.shards[i].in_flight, DP_Q_IN_FLIGHT, now));
+    }
+    gauges.num_samples++;
+}
+
+/* vty: show depth and age of the lists */
+void hh_vty_show_queues(struct vty *vty)
+{
+    BUG(!vty);
+    static const char *const names[DP_Q_MAX] = { "unsent", "in-flight" };
+    uint64_t now = hh_monotime_us();
+    uint64_t num = gauges.num_samples;
+    const struct dp_queue_sample *last = num ? &gauges.samples[(num - 1) % DP_QUEUE_SAMPLES] : NULL;
+
+    vty_out(vty, "  ──────────────────────────────────────────── Message queues ────────────────────────────────────────────\n");
+    vty_out(vty, "\n%12.12s %12.12s %12.12s %14.14s\n", "list", "depth", "high-water", "oldest(usec)");
+    vty_out(vty, "%12.12s %12zu %12zu %14s\n", "pool", dp_msg_pool_count(), gauges.hwm_pool, "-");
+    vty_out(vty, "%12.12s %12zu %12zu %14"PRIu64"\n", names[DP_Q_UNSENT], dp_msg_unsent_count(),
+            gauges.hwm[DP_Q_UNSENT], last ? last->oldest[DP_Q_UNSENT] : 0);
+    vty_out(vty, "%12.12s %12zu %12zu %14"PRIu64"\n", names[DP_Q_IN_FLIGHT], dp_msg_in_flight_count(),
+            gauges.hwm[DP_Q_IN_FLIGHT], last ? last->oldest[DP_Q_IN_FLIGHT] : 0);
+    if (!last) {
+        vty_out(vty, "\n");
+        return;
+    }
+
+    vty_out(vty, "\n Age of messages, %"PRIu64" s ago:\n", (now - last->t) / 1000000);
+    vty_out(vty, "%12.12s %10.10s %10.10s %10.10s %10.10s %10.10s %10.10s %10.10s\n", "list",
+            "<100us", "<1ms", "<10ms", "<100ms", "<1s", "<10s", ">=10s");
+    for (enum dp_queue_id q = 0; q < DP_Q_MAX; q++) {
+        vty_out(vty, "%12.12s", names[q]);
+        for (unsigned int b = 0; b < DP_QUEUE_AGE_BUCKETS; b++)
+            vty_out(vty, " %10"PRIu64, gauges.age_hist[q][b]);
+        vty_out(vty, "\n");
+    }
+
+    /* the ring, newest first, a row per DP_QUEUE_ROW_SAMPLES samples with their peaks */
+    vty_out(vty, "\n Last %u minutes, peaks every %u s:\n", DP_QUEUE_SAMPLES * DP_QUEUE_SAMPLE_SEC / 60,
+            DP_QUEUE_ROW_SAMPLES * DP_QUEUE_SAMPLE_SEC);
+    vty_out(vty, "%12.12s %12.12s %14.14s %12.12s %14.14s\n", "ago(s)", "unsent", "oldest(usec)",
+            "in-flight", "oldest(usec)");
+    uint64_t avail = MIN(num, DP_QUEUE_SAMPLES);
+    for (uint64_t i = 0; i < avail; i += DP_QUEUE_ROW_SAMPLES) {
+        struct dp_queue_sample peak = {0};
+        const struct dp_queue_sample *first = &gauges.samples[(num - 1 - i) % DP_QUEUE_SAMPLES];
+        for (uint64_t j = i; j < MIN(i + DP_QUEUE_ROW_SAMPLES, avail); j++) {
+            const struct dp_queue_sample *s = &gauges.samples[(num - 1 - j) % DP_QUEUE_SAMPLES];
+            for (enum dp_queue_id q = 0; q < DP_Q_MAX; q++) {
+                peak.depth[q] = MAX(peak.depth[q], s->depth[q]);
+                peak.oldest[q] = MAX(peak.oldest[q], s->oldest[q]);
+            }
+        }
+        vty_out(vty, "%12"PRIu64" %12u %14"PRIu64" %12u %14"PRIu64"\n", (now - first->t) / 1000000,
+                peak.depth[DP_Q_UNSENT], peak.oldest[DP_Q_UNSENT],
+                peak.depth[DP_Q_IN_FLIGHT], peak.oldest[DP_Q_IN_FLIGHT]);
+    }
+    vty_out(vty, "\n");
+}
+/* fill the queue gauges of the stats page */
+void dp_msg_cache_shm_fill(struct hh_stats_shm *shm)
+{
+    BUG(!shm);
+    uint64_t num = gauges.num_samples;
+    const struct dp_queue_sample *last = num ? &gauges.samples[(num - 1) % DP_QUEUE_SAMPLES] : NULL;
+
+    shm->queues[HH_STATS_SHM_POOL].depth = dp_msg_pool_count();
+    shm->queues[HH_STATS_SHM_POOL].high_water = gauges.hwm_pool;
+    shm->queues[HH_STATS_SHM_UNSENT].depth = dp_msg_unsent_count();
+    shm->queues[HH_STATS_SHM_UNSENT].high_water = gauges.hwm[DP_Q_UNSENT];
+    shm->queues[HH_STATS_SHM_UNSENT].oldest_usec = last ? last->oldest[DP_Q_UNSENT] : 0;
+    shm->queues[HH_STATS_SHM_IN_FLIGHT].depth = dp_msg_in_flight_count();
+    shm->queues[HH_STATS_SHM_IN_FLIGHT].high_water = gauges.hwm[DP_Q_IN_FLIGHT];
+    shm->queues[HH_STATS_SHM_IN_FLIGHT].oldest_usec = last ? last->oldest[DP_Q_IN_FLIGHT] : 0;
+}
+
+/* metrics: depth and age of the lists */
+void dp_msg_cache_metrics(struct hh_metrics_buf *b)
+{
+    BUG(!b);
+    static const char *const names[DP_Q_MAX] = { "unsent", "in_flight" };
+    uint64_t num = gauges.num_samples;
+    const struct dp_queue_sample *last = num ? &gauges.samples[(num - 1) % DP_QUEUE_SAMPLES] : NULL;
+    size_t depth[DP_Q_MAX] = { dp_msg_unsent_count(), dp_msg_in_flight_count() };
+
+    hh_metrics_family(b, "hh_queue_depth", "gauge", "Messages in a queue.");
+    hh_metrics_printf(b, "hh_queue_depth{queue=\"pool\"} %zu\n", dp_msg_pool_count());
+    for (enum dp_queue_id q = 0; q < DP_Q_MAX; q++)
+        hh_metrics_printf(b, "hh_queue_depth{queue=\"%s\"} %zu\n", names[q], depth[q]);
+    hh_metrics_family(b, "hh_queue_high_water", "gauge", "Most messages ever in a queue.");
+    hh_metrics_printf(b, "hh_queue_high_water{queue=\"pool\"} %zu\n", gauges.hwm_pool);
+    for (enum dp_queue_id q = 0; q < DP_Q_MAX; q++)
+        hh_metrics_printf(b, "hh_queue_high_water{queue=\"%s\"} %zu\n", names[q], gauges.hwm[q]);
+    if (!last)
+        return;
+    hh_metrics_family(b, "hh_queue_oldest_age_seconds", "gauge", "Age of the oldest message in a queue, sampled every second.");
+    for (enum dp_queue_id q = 0; q < DP_Q_MAX; q++)
+        hh_metrics_printf(b, "hh_queue_oldest_age_seconds{queue=\"%s\"} %.6f\n", names[q],
+                          (double)last->oldest[q] / 1000000.0);
+}
+
+struct json_object *hh_json_queues(void)
+{
+    static const char *const names[DP_Q_MAX] = { "unsent", "inFlight" };
+    static const char *const ages[DP_QUEUE_AGE_BUCKETS] = { "<100us", "<1ms", "<10ms", "<100ms", "<1s", "<10s", ">=10s" };
+    struct json_object *json = hh_json_new();
+    struct json_object *jq;
+    uint64_t num = gauges.num_samples;
+    const struct dp_queue_sample *last = num ? &gauges.samples[(num - 1) % DP_QUEUE_SAMPLES] : NULL;
+    size_t depth[DP_Q_MAX] = { dp_msg_unsent_count(), dp_msg_in_flight_count() };
+
+    jq = json_object_new_object();
+    json_object_int_add(jq, "depth", dp_msg_pool_count());
+    json_object_int_add(jq, "highWater", gauges.hwm_pool);
+    json_object_object_add(json, "pool", jq);
+
+    if (last)
+        json_object_int_add(json, "sampleUsec", last->t);
+    for (enum dp_queue_id q = 0; q < DP_Q_MAX; q++) {
+        jq = json_object_new_object();
+        json_object_int_add(jq, "depth", depth[q]);
+        json_object_int_add(jq, "highWater", gauges.hwm[q]);
+        if (last) {
+            struct json_object *jages = json_object_new_object();
+            json_object_int_add(jq, "oldestUsec", last->oldest[q]);
+            for (unsigned int b = 0; b < DP_QUEUE_AGE_BUCKETS; b++)
+                json_object_int_add(jages, ages[b], gauges.age_hist[q][b]);
+            json_object_object_add(jq, "ages", jages);
+        }
+        json_object_object_add(json, names[q], jq);
+    }
+    return json;
 }
 
 /* initialize dataplane message cache */
@@ -138,8 +412,10 @@ int init_dp_msg_cache(void)
 
     /* initialize lists */
     dp_msg_list_init(&msg_cache.pool);
-    dp_msg_list_init(&msg_cache.unsent);
-    dp_msg_list_init(&msg_cache.in_flight);
+    for (int i = 0; i < DP_MAX_SHARDS; i++) {
+        dp_msg_list_init(&msg_cache.shards[i].unsent);
+        dp_msg_list_init(&msg_cache.shards[i].in_flight);
+    }
 
     /* prepopulate msg pool */
     struct dp_msg *msg;
@@ -149,6 +425,11 @@ int init_dp_msg_cache(void)
             dp_msg_list_add_tail(&msg_cache.pool, msg);
     }
     zlog_debug("Initialized cache with pool of %zu messages", dp_msg_pool_count());
+
+    /* sample the lists */
+    memset(&gauges, 0, sizeof(gauges));
+    gauges.hwm_pool = dp_msg_pool_count();
+    event_add_timer(dplane_get_thread_master(), dp_queue_sample, NULL, DP_QUEUE_SAMPLE_SEC, &gauges.ev_sample);
     return 0;
 }
 
@@ -156,8 +437,11 @@ int init_dp_msg_cache(void)
 void fini_dp_msg_cache(void)
 {
     zlog_debug("Finalizing dataplane message cache..");
+    EVENT_OFF(gauges.ev_sample);
 
     empty_dp_msg_list(&msg_cache.pool, "pool");
-    empty_dp_msg_list(&msg_cache.unsent, "unsent");
-    empty_dp_msg_list(&msg_cache.in_flight, "in-flight");
+    for (int i = 0; i < DP_MAX_SHARDS; i++) {
+        empty_dp_msg_list(&msg_cache.shards[i].unsent, "unsent");
+        empty_dp_msg_list(&msg_cache.shards[i].in_flight, "in-flight");
+    }
 }
@@ -6,11 +6,16 @@
 #include "config.h" /* FRRs config */
 #include "lib/libfrr.h"
 #include <dplane-rpc/dplane-rpc.h> /* HH's rpc dataplane library */
+#include "lib/vty.h"
+#include "lib/json.h"
 
 /* memory type */
 DECLARE_MGROUP(ZEBRA);
 DECLARE_MTYPE(HH_DP_MSG);
 
+/* max number of sockets (shards) that the RPC stream to dataplane is spread over */
+#define DP_MAX_SHARDS 16
+
 /* custom list type */
 PREDECL_DLIST(dp_msg_list);
 
@@ -18,6 +23,15 @@ PREDECL_DLIST(dp_msg_list);
 struct dp_msg {
     struct RpcMsg msg;
     struct zebra_dplane_ctx *ctx;
+    uint32_t flags;
+#define DP_MSG_F_REPLAY 0x1 /* request replays an object from the plugin state snapshot */
+    uint64_t ts_intake; /* usec when a request was created for a zebra context */
+    uint64_t ts_tx_try; /* usec when a request was first tried on the socket */
+    uint64_t ts_sent; /* usec when a request was sent */
+    uint64_t ts_queued; /* usec when a message was first queued as unsent */
+    uint64_t gseqn;   /* order of a request among those of all shards */
+    uint64_t pseqn;   /* standby: gseqn of the request mirrored, as sent to the primary */
+    uint8_t shard;    /* socket the message is sent over */
     struct dp_msg_list_item cache; /* internal linkage */
 };
 
@@ -33,21 +47,48 @@ struct dp_msg *dp_msg_new(void);
 /* dispose a dp_msg */
 void dp_msg_recycle(struct dp_msg *msg);
 
+/* Each shard has its own unsent and in-flight lists. Messages are queued in those of
+ * the shard they are set to */
+
 /* put message in list (tail) of unsent messages */
 void dp_msg_cache_unsent(struct dp_msg *msg);
 
 /* put message in list (head) of unsent messages */
 void dp_msg_unsent_push_back(struct dp_msg *msg);
 
-struct dp_msg *dp_msg_pop_unsent(void);
+struct dp_msg *dp_msg_pop_unsent(uint8_t shard);
 
-/* length of lists */
+/* length of lists, for all shards */
 size_t dp_msg_pool_count(void);
 size_t dp_msg_unsent_count(void);
 size_t dp_msg_in_flight_count(void);
 
+/* length of lists of a shard */
+size_t dp_msg_shard_unsent_count(uint8_t shard);
+size_t dp_msg_shard_in_flight_count(uint8_t shard);
+
 /* put message in list of sent messages */
 void dp_msg_cache_inflight(struct dp_msg *msg);
-struct dp_msg *dp_msg_pop_inflight(void);
+struct dp_msg *dp_msg_pop_inflight(uint8_t shard);
+struct dp_msg *dp_msg_peek_inflight(uint8_t shard);
+bool dp_msg_inflight_has_connect(uint8_t shard);
+
+/* put a list of messages at the head of the unsent list of a shard, keeping their order */
+void dp_msg_unsent_requeue(uint8_t shard, struct dp_msg_list_head *list);
+
+/* invoke cb for every message pending to be sent or answered, oldest first in each shard */
+void dp_msg_pending_walk(void (*cb)(struct dp_msg *msg, void *arg), void *arg);
+
+/* vty: show depth and age of the lists */
+void hh_vty_show_queues(struct vty *vty);
+struct json_object *hh_json_queues(void);
+
+/* fill the queue gauges of the stats page in shared memory */
+struct hh_stats_shm;
+void dp_msg_cache_shm_fill(struct hh_stats_shm *shm);
+
+/* append the queue metrics */
+struct hh_metrics_buf;
+void dp_msg_cache_metrics(struct hh_metrics_buf *b);
 
 #endif /* SRC_HH_DP_CACHE_H_ */
@@ -12,6 +12,14 @@
 #include "hh_dp_comm.h"
 #include "hh_dp_utils.h"
 #include "hh_dp_vty.h"
+#include "hh_dp_bulk.h"
+#include "hh_dp_rules.h"
+#include "hh_dp_budget.h"
+#include "hh_dp_journal.h"
+#include "hh_dp_msg.h"
+#include "hh_dp_standby.h"
+#include "hh_dp_shm.h"
+#include "hh_dp_metrics.h"
 
 #define PLUGIN_NAME "Hedgehog-GW-plugin"
 
@@ -23,6 +31,12 @@ struct zebra_dplane_provider *prov_p = NULL;
 static const struct option plugin_long_opts[] = {
     {"local-dp-sock-path", required_argument, 0, 'l'},
     {"remote-dp-sock-path", required_argument, 0, 'r'},
+    {"bulk-load-quiet-ms", required_argument, 0, 'q'},
+    {"journal-path", required_argument, 0, 'j'},
+    {"standby-dp-sock-path", required_argument, 0, 's'},
+    {"dp-sockets", required_argument, 0, 'n'},
+    {"stats-shm-path", required_argument, 0, 'm'},
+    {"metrics-sock-path", required_argument, 0, 'x'},
     {NULL}
 };
 
@@ -42,6 +56,24 @@ static int process_plugin_opt(int opt, const char *opt_arg, const struct option
         case 'r':
             r = set_dp_sock_remote_path(opt_arg);
             break;
+        case 'q':
+            r = dp_bulk_set_quiet_msec(opt_arg);
+            break;
+        case 'j':
+            r = dp_journal_set_path(opt_arg);
+            break;
+        case 's':
+            r = dp_standby_set_path(opt_arg);
+            break;
+        case 'n':
+            r = set_dp_num_shards(opt_arg);
+            break;
+        case 'm':
+            r = dp_stats_shm_set_path(opt_arg);
+            break;
+        case 'x':
+            r = dp_metrics_set_path(opt_arg);
+            break;
         default:
             /* If we get here, either there is a bug in the utils,
              * or the plugin_long_opts[] array defines an option
@@ -69,18 +101,26 @@ static int zd_hh_start(struct zebra_dplane_provider *prov)
         abort();
     }
 
+    /* hold routes during initial convergence */
+    init_dp_bulk(zd_hh_process_bulk);
+
     return 0; /* unused */
 }
 
 /*
- * Shutdown/cleanup callback, called from the dataplane pthread.
+ * Shutdown/cleanup callback. The early call runs in zebra's main pthread,
+ * the final one in the dataplane pthread, which owns the RPC and bulk state.
  */
 static int zd_hh_fini(struct zebra_dplane_provider *prov, bool early)
 {
     if (early) {
         zlog_info("%s: Finalizing...", dplane_provider_get_name(prov));
         finalizing = true;
+        fini_hh_rules();
+        fini_dp_metrics();
     } else {
+        fini_dp_bulk();
+        fini_hh_route_decisions();
         fini_dplane_rpc();
     }
     return 0;
@@ -95,13 +135,15 @@ static int zd_hh_process(struct zebra_dplane_provider *prov)
 {
     int counter;
     int limit;
-    struct zebra_dplane_ctx *ctx;
+    struct zebra_dplane_ctx *ctx = NULL;
+    struct hh_budget_pass pass;
 
     if (IS_ZEBRA_DEBUG_DPLANE)
         zlog_debug("%s: Process...", dplane_provider_get_name(prov));
 
+    hh_budget_begin(&pass, HH_BUDGET_INTAKE);
     limit = dplane_provider_get_work_limit(prov);
-    for (counter = 0; counter < limit; counter++) {
+    for (counter = 0; counter < limit && hh_budget_left(&pass); counter++, pass.msgs++) {
         ctx = dplane_provider_dequeue_in_ctx(prov);
         if (!ctx)
             break;
@@ -115,7 +157,14 @@ static int zd_hh_process(struct zebra_dplane_provider *prov)
         }
     }
 
-    if (finalizing)
+    /* out of budget with contexts possibly left: have zebra call us again */
+    bool exhausted = ctx && counter < limit;
+    hh_budget_end(&pass, exhausted);
+
+    /* contexts completed without a request to dataplane */
+    dp_msg_hand_off_flush();
+
+    if (finalizing || exhausted)
         dplane_provider_work_ready();
     return 0;
 }
@@ -128,6 +177,12 @@ static int init_hh_dplane_plugin(struct event_loop *tm)
 {
     int ret;
 
+    /* route filters are configured from the main thread */
+    init_hh_rules(tm);
+
+    /* metrics are served from the main thread too, sparing the dplane pthread */
+    init_dp_metrics(tm);
+
     /* Register the plugin with the dataplane infrastructure. We
      * register to be called before the kernel, and we register
      * our init, process work, and shutdown callbacks.
@@ -9,6 +9,10 @@
 #include "hh_dp_internal.h"
 #include "hh_dp_process.h"
 #include "hh_dp_msg.h"
+#include "hh_dp_bulk.h"
+#include "hh_dp_rules.h"
+#include "hh_dp_cpu.h"
+#include "hh_dp_usdt.h"
 
 typedef enum hh_dp_res_e {
     HH_OK = ZEBRA_DPLANE_REQUEST_SUCCESS,
@@ -46,6 +50,16 @@ static enum zebra_dplane_result hh_ret_to_zebra(hh_dp_res_t r) {
     }
 }
 
+/* send a route to dataplane, as the filter and kernel rules decide */
+static hh_dp_res_t hh_send_route(struct zebra_dplane_ctx *ctx)
+{
+    RpcOp op;
+    if (!hh_route_decide(ctx, &op))
+        return HH_IGNORED;
+
+    int r = send_rpc_request_iproute(op, ctx);
+    return !r ? HH_QUEUED: HH_FAIL;
+}
 static hh_dp_res_t hh_process_routes(struct zebra_dplane_ctx *ctx)
 {
     afi_t afi = dplane_ctx_get_afi(ctx);
@@ -61,23 +75,15 @@ static hh_dp_res_t hh_process_routes(struct zebra_dplane_ctx *ctx)
     if (safi != SAFI_UNICAST && safi != SAFI_EVPN)
         return HH_IGNORED;
 
-    /* do not install in kernel routes for non-default vrf */
-    VrfId vrfid = dplane_ctx_get_vrf(ctx);
-    if (vrfid != 0) {
-        dplane_ctx_set_skip_kernel(ctx);
-    }
-
-    int r;
     switch(dplane_ctx_get_op(ctx)) {
         case DPLANE_OP_ROUTE_INSTALL:
-            r = send_rpc_request_iproute(Add, ctx);
-            break;
         case DPLANE_OP_ROUTE_UPDATE:
-            r = send_rpc_request_iproute(Update, ctx);
-            break;
         case DPLANE_OP_ROUTE_DELETE:
-            r = send_rpc_request_iproute(Del, ctx);
-            break;
+            /* during initial convergence, routes are held and sent sorted later. The
+             * filter and kernel rules apply when they are */
+            if (dp_bulk_hold(ctx))
+                return HH_QUEUED;
+            return hh_send_route(ctx);
         case DPLANE_OP_ROUTE_NOTIFY:
             return HH_IGNORED;
         case DPLANE_OP_SYS_ROUTE_ADD:
@@ -86,7 +92,6 @@ static hh_dp_res_t hh_process_routes(struct zebra_dplane_ctx *ctx)
         default:
             BUG(true, HH_BUG);
     }
-    return !r ? HH_QUEUED: HH_FAIL;
 }
 static hh_dp_res_t hh_process_ifaddr(struct zebra_dplane_ctx *ctx)
 {
@@ -149,6 +154,12 @@ static hh_dp_res_t hh_process_macinfo(struct zebra_dplane_ctx *ctx)
     }
     return !r ? HH_QUEUED: HH_FAIL;
 }
+static hh_dp_res_t hh_process_startup(struct zebra_dplane_ctx *ctx)
+{
+    zlog_info("HH-Plugin: zebra startup stage %u", dplane_ctx_get_startup_spot(ctx));
+    dp_bulk_startup_stage();
+    return HH_IGNORED;
+}
 static hh_dp_res_t hh_process(struct zebra_dplane_ctx *ctx)
 {
     if (IS_ZEBRA_DEBUG_DPLANE)
@@ -276,7 +287,7 @@ static hh_dp_res_t hh_process(struct zebra_dplane_ctx *ctx)
 
         /* Startup Control */
         case DPLANE_OP_STARTUP_STAGE:
-            return HH_IGNORED;
+            return hh_process_startup(ctx);
 
         /* Source address for SRv6 encapsulation */
         case DPLANE_OP_SRV6_ENCAP_SRCADDR_SET:
@@ -286,10 +297,8 @@ static hh_dp_res_t hh_process(struct zebra_dplane_ctx *ctx)
     return HH_FAIL;
 }
 
-void zd_hh_process_update(struct zebra_dplane_provider *prov, struct zebra_dplane_ctx *ctx)
+static void zd_hh_complete(struct zebra_dplane_provider *prov, struct zebra_dplane_ctx *ctx, hh_dp_res_t r)
 {
-    hh_dp_res_t r = hh_process(ctx);
-
     if (IS_ZEBRA_DEBUG_DPLANE)
         zlog_debug("result: %s", zd_hh_ret_str(r));
 
@@ -304,3 +313,28 @@ void zd_hh_process_update(struct zebra_dplane_provider *prov, struct zebra_dplan
         dplane_provider_enqueue_out_ctx(prov, ctx);
     }
 }
+
+void zd_hh_process_update(struct zebra_dplane_provider *prov, struct zebra_dplane_ctx *ctx)
+{
+    struct hh_cpu_frame cpu;
+
+    HH_USDT_PROBE(intake, ctx, (int)dplane_ctx_get_op(ctx));
+    hh_cpu_begin(&cpu);
+    hh_dp_res_t r = hh_process(ctx);
+    hh_cpu_end(&cpu, HH_CPU_CLASSIFY, 1);
+    zd_hh_complete(prov, ctx, r);
+}
+
+/* send a route context released from bulk-load. Since this does not happen from
+ * the provider's process callback, zebra must be told if the context is returned */
+void zd_hh_process_bulk(struct zebra_dplane_ctx *ctx)
+{
+    struct hh_cpu_frame cpu;
+
+    hh_cpu_begin(&cpu);
+    hh_dp_res_t r = hh_send_route(ctx);
+    hh_cpu_end(&cpu, HH_CPU_CLASSIFY, 1);
+    zd_hh_complete(prov_p, ctx, r);
+    if (r != HH_QUEUED)
+        dplane_provider_work_ready();
+}
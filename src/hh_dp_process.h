@@ -8,5 +8,6 @@
 extern struct zebra_dplane_provider *prov_p;
 
 void zd_hh_process_update(struct zebra_dplane_provider *prov, struct zebra_dplane_ctx *ctx);
+void zd_hh_process_bulk(struct zebra_dplane_ctx *ctx);
 
 #endif
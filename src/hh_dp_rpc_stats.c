@@ -5,47 +5,119 @@
 #include "hh_dp_internal.h"
 #include "hh_dp_rpc_stats.h"
 #include "hh_dp_comm.h"
+#include "hh_dp_msg.h" /* dp_msg_cumulative_acks */
+#include "hh_dp_stats_shm.h"
+#include "hh_dp_metrics.h"
+#include "zebra/zebra_dplane.h" /* dplane_get_thread_master() */
 
-/* RPC statistics */
-static struct rpc_stats RPC_STATS = {0};
+/*
+ * RPC statistics. Counters are sharded per thread, each shard on cache lines of its own, so
+ * that counting is a plain load and store rather than a locked read-modify-write. Updates
+ * of a shard are sequenced (seqlock), so that readers get a consistent snapshot of it.
+ * Threads beyond the number of shards share shard 0, under a spinlock.
+ */
+#define RPC_STATS_SHARDS 8
+#define RPC_STATS_WORDS (sizeof(struct rpc_stats) / sizeof(uint64_t))
+#define RPC_SNAPSHOT_TRIES 1000
+_Static_assert(sizeof(struct rpc_stats) % sizeof(uint64_t) == 0, "rpc_stats members must be uint64_t");
+
+struct rpc_stats_shard {
+    _Atomic uint64_t seq;   /* odd while counters are being updated */
+    atomic_flag lock;       /* serializes the writers of a shared shard */
+    bool shared;
+    struct rpc_stats c;
+
+    /* latencies are not sequenced: readers take buckets one by one */
+    struct rpc_lat_hist latency[MaxObjType][MaxRpcOp];
+} __attribute__((aligned(64)));
+
+static struct rpc_stats_shard RPC_STATS[RPC_STATS_SHARDS] = {
+    [0] = { .lock = ATOMIC_FLAG_INIT, .shared = true },
+};
+static _Atomic unsigned int rpc_stats_shards_used = 1;
+static _Thread_local struct rpc_stats_shard *rpc_stats_shard;
+
+/* get a shard for the calling thread */
+static struct rpc_stats_shard *rpc_stats_claim(void)
+{
+    unsigned int idx = atomic_fetch_add_explicit(&rpc_stats_shards_used, 1, memory_order_relaxed);
+    rpc_stats_shard = &RPC_STATS[idx < RPC_STATS_SHARDS ? idx : 0];
+    return rpc_stats_shard;
+}
+
+/* start / end an update of the shard of the calling thread */
+static inline struct rpc_stats_shard *rpc_stats_begin(void)
+{
+    struct rpc_stats_shard *sh = rpc_stats_shard ? rpc_stats_shard : rpc_stats_claim();
+
+    if (unlikely(sh->shared))
+        while (atomic_flag_test_and_set_explicit(&sh->lock, memory_order_acquire))
+            ;
+    uint64_t seq = atomic_load_explicit(&sh->seq, memory_order_relaxed);
+    atomic_store_explicit(&sh->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    return sh;
+}
+static inline void rpc_stats_end(struct rpc_stats_shard *sh)
+{
+    uint64_t seq = atomic_load_explicit(&sh->seq, memory_order_relaxed);
+    atomic_store_explicit(&sh->seq, seq + 1, memory_order_release);
+    if (unlikely(sh->shared))
+        atomic_flag_clear_explicit(&sh->lock, memory_order_release);
+}
+
+/* a shard has one writer at a time: counters need no read-modify-write */
+#define RPC_ADD(counter, v) \
+    atomic_store_explicit(&(counter), atomic_load_explicit(&(counter), memory_order_relaxed) + (v), memory_order_relaxed)
+#define RPC_MAX(counter, v) \
+    do { \
+        if ((v) > atomic_load_explicit(&(counter), memory_order_relaxed)) \
+            atomic_store_explicit(&(counter), (v), memory_order_relaxed); \
+    } while (0)
+#define RPC_COUNT(name, v) \
+    do { \
+        struct rpc_stats_shard *__sh = rpc_stats_begin(); \
+        RPC_ADD(__sh->c.name, v); \
+        rpc_stats_end(__sh); \
+    } while (0)
 
 /* IO: tx */
 void rpc_count_tx(void) {
-    atomic_fetch_add_explicit(&RPC_STATS.tx_ok, 1, memory_order_relaxed);
+    RPC_COUNT(tx_ok, 1);
 }
 void rpc_count_tx_failure(void) {
-    atomic_fetch_add_explicit(&RPC_STATS.tx_failure, 1, memory_order_relaxed);
+    RPC_COUNT(tx_failure, 1);
 }
 void rpc_count_tx_eagain(void) {
-    atomic_fetch_add_explicit(&RPC_STATS.tx_eagain, 1, memory_order_relaxed);
+    RPC_COUNT(tx_eagain, 1);
 }
 
 /* IO: rx */
 void rpc_count_rx(void) {
-    atomic_fetch_add_explicit(&RPC_STATS.rx_ok, 1, memory_order_relaxed);
+    RPC_COUNT(rx_ok, 1);
 }
 void rpc_count_rx_failure(void) {
-    atomic_fetch_add_explicit(&RPC_STATS.rx_failure, 1, memory_order_relaxed);
+    RPC_COUNT(rx_failure, 1);
 }
 void rpc_count_rx_eagain(void) {
-    atomic_fetch_add_explicit(&RPC_STATS.rx_eagain, 1, memory_order_relaxed);
+    RPC_COUNT(rx_eagain, 1);
 }
 
 /* account: RPC encode failures */
 void rpc_count_encode_failure(void) {
-    atomic_fetch_add_explicit(&RPC_STATS.msg_encode_failure, 1, memory_order_relaxed);
+    RPC_COUNT(msg_encode_failure, 1);
 }
 
 /* account: RPC decode failures */
 void rpc_count_decode_failure(void) {
-    atomic_fetch_add_explicit(&RPC_STATS.msg_decode_failure, 1, memory_order_relaxed);
+    RPC_COUNT(msg_decode_failure, 1);
 }
 
 /* account: RPC requests sent */
 void rpc_count_request_sent(enum RpcOp op, enum ObjType otype) {
     BUG(op >= MaxRpcOp);
     BUG(otype >= MaxObjType);
-    atomic_fetch_add_explicit(&RPC_STATS.requests[otype][op].sent, 1, memory_order_relaxed);
+    RPC_COUNT(requests[otype][op].sent, 1);
 }
 
 /* account: RPC requests replied (responses rx) */
@@ -54,26 +126,207 @@ void rpc_count_request_replied(enum RpcOp op, enum ObjType otype, enum RpcResult
     BUG(op >= MaxRpcOp);
     BUG(otype >= MaxObjType);
 
-    atomic_fetch_add_explicit(&RPC_STATS.requests[otype][op].replied, 1, memory_order_relaxed);
+    struct rpc_stats_shard *sh = rpc_stats_begin();
+    struct rpc_req_stat_cell *cell = &sh->c.requests[otype][op];
+    RPC_ADD(cell->replied, 1);
     if (rescode < RpcResultCodeMax)
-        atomic_fetch_add_explicit(&RPC_STATS.requests[otype][op].rescode[rescode], 1, memory_order_relaxed);
+        RPC_ADD(cell->rescode[rescode], 1);
     else
-        atomic_fetch_add_explicit(&RPC_STATS.requests[otype][op].unk_err, 1, memory_order_relaxed);
+        RPC_ADD(cell->unk_err, 1);
+    rpc_stats_end(sh);
+}
+
+/* bucket of a latency value, and the highest value it holds */
+static inline unsigned int rpc_lat_bucket(uint64_t usec)
+{
+    if (usec < (1u << RPC_LAT_SUB_BITS))
+        return (unsigned int)usec;
+
+    unsigned int msb = 63 - __builtin_clzll(usec);
+    unsigned int idx = ((msb - RPC_LAT_SUB_BITS + 1) << RPC_LAT_SUB_BITS) |
+            (unsigned int)((usec >> (msb - RPC_LAT_SUB_BITS)) & ((1u << RPC_LAT_SUB_BITS) - 1));
+    return MIN(idx, RPC_LAT_BUCKETS - 1);
+}
+static inline uint64_t rpc_lat_bucket_high(unsigned int idx)
+{
+    if (idx < (1u << RPC_LAT_SUB_BITS))
+        return idx;
+
+    unsigned int shift = (idx >> RPC_LAT_SUB_BITS) - 1;
+    uint64_t low = (uint64_t)((1u << RPC_LAT_SUB_BITS) | (idx & ((1u << RPC_LAT_SUB_BITS) - 1))) << shift;
+    return low + (1ULL << shift) - 1;
+}
+
+/* account: round-trip latency of a request */
+void rpc_count_latency(enum RpcOp op, enum ObjType otype, uint64_t usec)
+{
+    BUG(op >= MaxRpcOp);
+    BUG(otype >= MaxObjType);
+    struct rpc_stats_shard *sh = rpc_stats_begin();
+    struct rpc_lat_hist *h = &sh->latency[otype][op];
+
+    RPC_ADD(h->buckets[rpc_lat_bucket(usec)], 1);
+    RPC_ADD(h->count, 1);
+    RPC_ADD(h->sum, usec);
+    RPC_MAX(h->max, usec);
+    rpc_stats_end(sh);
 }
 
 /* account: RPC control msg rx / tx */
 void rpc_count_ctl_tx(void) {
-    atomic_fetch_add_explicit(&RPC_STATS.control_tx, 1, memory_order_relaxed);
+    RPC_COUNT(control_tx, 1);
 }
 void rpc_count_ctl_rx(void) {
-    atomic_fetch_add_explicit(&RPC_STATS.control_rx, 1, memory_order_relaxed);
+    RPC_COUNT(control_rx, 1);
+}
+void rpc_count_ctl_suppressed(void) {
+    RPC_COUNT(control_suppressed, 1);
+}
+
+/* account: contexts handed off to zebra per wakeup */
+void rpc_count_hand_off(uint32_t num_ctxs) {
+    struct rpc_stats_shard *sh = rpc_stats_begin();
+    RPC_ADD(sh->c.hand_off_ctxs, num_ctxs);
+    RPC_ADD(sh->c.hand_off_wakeups, 1);
+    RPC_MAX(sh->c.hand_off_max, num_ctxs);
+    rpc_stats_end(sh);
+}
+
+/* account: requests acknowledged by a cumulative response */
+void rpc_count_cumulative_ack(uint32_t num_reqs) {
+    struct rpc_stats_shard *sh = rpc_stats_begin();
+    RPC_ADD(sh->c.cumulative_acks, 1);
+    RPC_ADD(sh->c.implicit_acks, num_reqs);
+    rpc_stats_end(sh);
+}
+
+/* account: resume after reconnect */
+void rpc_count_resume(uint32_t processed, size_t resent) {
+    struct rpc_stats_shard *sh = rpc_stats_begin();
+    RPC_ADD(sh->c.resumes, 1);
+    RPC_ADD(sh->c.resume_processed, processed);
+    RPC_ADD(sh->c.resume_resent, resent);
+    rpc_stats_end(sh);
+}
+
+/* Sum the counters of all shards. Each is read consistently, retrying while it is updated.
+ * A shard updated without pause for too long is read once more without checking: each
+ * counter is then valid on its own, though not consistent with the others */
+static void rpc_stats_snapshot(struct rpc_stats *snap)
+{
+    _Atomic uint64_t *sum = (_Atomic uint64_t *)snap;
+    const size_t max_idx = offsetof(struct rpc_stats, hand_off_max) / sizeof(uint64_t);
+    uint64_t words[RPC_STATS_WORDS];
+    unsigned int used = atomic_load_explicit(&rpc_stats_shards_used, memory_order_relaxed);
+
+    memset(snap, 0, sizeof(*snap));
+    for (unsigned int n = 0; n < MIN(used, RPC_STATS_SHARDS); n++) {
+        struct rpc_stats_shard *sh = &RPC_STATS[n];
+        _Atomic uint64_t *c = (_Atomic uint64_t *)&sh->c;
+        bool stable = false;
+
+        for (unsigned int tries = 0; tries < RPC_SNAPSHOT_TRIES && !stable; tries++) {
+            uint64_t seq = atomic_load_explicit(&sh->seq, memory_order_acquire);
+            if (seq & 1)
+                continue;
+            for (size_t i = 0; i < RPC_STATS_WORDS; i++)
+                words[i] = atomic_load_explicit(&c[i], memory_order_relaxed);
+            atomic_thread_fence(memory_order_acquire);
+            stable = atomic_load_explicit(&sh->seq, memory_order_relaxed) == seq;
+        }
+        if (!stable) {
+            for (size_t i = 0; i < RPC_STATS_WORDS; i++)
+                words[i] = atomic_load_explicit(&c[i], memory_order_relaxed);
+        }
+        for (size_t i = 0; i < RPC_STATS_WORDS; i++) {
+            if (i == max_idx)
+                RPC_MAX(sum[i], words[i]);
+            else
+                RPC_ADD(sum[i], words[i]);
+        }
+    }
+}
+
+/* there are some combinations that are not possible. Exclude them from output */
+static inline bool rpc_req_possible(enum ObjType ot, enum RpcOp op)
+{
+    return !((ot == ConnectInfo && op != Connect) || (ot != ConnectInfo && op == Connect) ||
+             (op == Update && ot != IpRoute));
+}
+
+/* Rates: the main counters are sampled every second in the dplane pthread, and rates are
+ * taken between the newest and the oldest samples kept */
+#define RPC_RATE_SAMPLE_SEC 1
+#define RPC_RATE_SAMPLES 12     /* rates over the last 10 s: the oldest slot is the next written */
+
+enum rpc_rate_id { RPC_RATE_TX = 0, RPC_RATE_RX, RPC_RATE_SENT, RPC_RATE_REPLIED, RPC_RATE_COMPLETED, RPC_RATE_MAX };
+static const char *const rpc_rate_names[RPC_RATE_MAX] = {
+    [RPC_RATE_TX] = "txPerSec",
+    [RPC_RATE_RX] = "rxPerSec",
+    [RPC_RATE_SENT] = "requestsPerSec",
+    [RPC_RATE_REPLIED] = "repliesPerSec",
+    [RPC_RATE_COMPLETED] = "completionsPerSec",
+};
+
+struct rpc_rate_sample {
+    uint64_t t;     /* usec */
+    uint64_t v[RPC_RATE_MAX];
+};
+
+static struct {
+    struct event *ev_sample;
+    struct rpc_rate_sample samples[RPC_RATE_SAMPLES];
+    _Atomic uint64_t num_samples;
+} rates;
+
+static void rpc_rate_sample(struct event *ev)
+{
+    struct rpc_stats st;
+    uint64_t num = atomic_load_explicit(&rates.num_samples, memory_order_relaxed);
+    struct rpc_rate_sample *s = &rates.samples[num % RPC_RATE_SAMPLES];
+
+    event_add_timer(dplane_get_thread_master(), rpc_rate_sample, NULL, RPC_RATE_SAMPLE_SEC, &rates.ev_sample);
+
+    rpc_stats_snapshot(&st);
+    memset(s, 0, sizeof(*s));
+    s->t = hh_monotime_us();
+    s->v[RPC_RATE_TX] = atomic_load_explicit(&st.tx_ok, memory_order_relaxed);
+    s->v[RPC_RATE_RX] = atomic_load_explicit(&st.rx_ok, memory_order_relaxed);
+    s->v[RPC_RATE_COMPLETED] = atomic_load_explicit(&st.hand_off_ctxs, memory_order_relaxed);
+    for (enum ObjType ot = None + 1; ot < MaxObjType; ot++) {
+        for (enum RpcOp op = Connect; op < MaxRpcOp; op++) {
+            s->v[RPC_RATE_SENT] += atomic_load_explicit(&st.requests[ot][op].sent, memory_order_relaxed);
+            s->v[RPC_RATE_REPLIED] += atomic_load_explicit(&st.requests[ot][op].replied, memory_order_relaxed);
+        }
+    }
+    atomic_store_explicit(&rates.num_samples, num + 1, memory_order_release);
+}
+
+/* json: rates over the samples kept. Absent until two samples were taken */
+static struct json_object *rpc_rates_json(void)
+{
+    uint64_t num = atomic_load_explicit(&rates.num_samples, memory_order_acquire);
+    if (num < 2)
+        return NULL;
+
+    const struct rpc_rate_sample *last = &rates.samples[(num - 1) % RPC_RATE_SAMPLES];
+    const struct rpc_rate_sample *first = &rates.samples[(num - MIN(num, RPC_RATE_SAMPLES - 1)) % RPC_RATE_SAMPLES];
+    if (last->t <= first->t)
+        return NULL;
+
+    struct json_object *jrates = json_object_new_object();
+    double secs = (double)(last->t - first->t) / 1000000.0;
+    json_object_int_add(jrates, "intervalUsec", last->t - first->t);
+    for (enum rpc_rate_id r = 0; r < RPC_RATE_MAX; r++)
+        json_object_double_add(jrates, rpc_rate_names[r], (double)(last->v[r] - first->v[r]) / secs);
+    return jrates;
 }
 
 /* vty: show RPC stats */
-#define GET_REQ_COUNT(ot, op, name)  ({uint64_t __count = atomic_load_explicit(&RPC_STATS.requests[ot][op].name, memory_order_relaxed); __count;})
-#define GET_REQ_COUNT_RC(ot, op, rc) ({uint64_t __count = atomic_load_explicit(&RPC_STATS.requests[ot][op].rescode[rc], memory_order_relaxed); __count;})
-#define GET_IO_COUNT(name)  ({uint64_t __count = atomic_load_explicit(&RPC_STATS.name, memory_order_relaxed); __count;})
-static inline void hh_vty_show_stats_io(struct vty *vty)
+#define GET_REQ_COUNT(ot, op, name)  ({uint64_t __count = atomic_load_explicit(&st->requests[ot][op].name, memory_order_relaxed); __count;})
+#define GET_REQ_COUNT_RC(ot, op, rc) ({uint64_t __count = atomic_load_explicit(&st->requests[ot][op].rescode[rc], memory_order_relaxed); __count;})
+#define GET_IO_COUNT(name)  ({uint64_t __count = atomic_load_explicit(&st->name, memory_order_relaxed); __count;})
+static inline void hh_vty_show_stats_io(struct vty *vty, struct rpc_stats *st)
 {
     BUG(!vty);
     vty_out(vty, "  ─────────────────────────────────────────────── IO stats ───────────────────────────────────────────────\n");
@@ -87,18 +340,18 @@ static inline void hh_vty_show_stats_io(struct vty *vty)
             GET_IO_COUNT(rx_eagain)
     );
 }
-static void hh_vty_show_stats_serialization(struct vty *vty)
+static void hh_vty_show_stats_serialization(struct vty *vty, struct rpc_stats *st)
 {
     BUG(!vty);
     uint64_t countval64;
 
     vty_out(vty, "  ───────────────────────────────────────── Serialization errors ─────────────────────────────────────────\n");
-    countval64 = atomic_load_explicit(&RPC_STATS.msg_encode_failure, memory_order_relaxed);
+    countval64 = atomic_load_explicit(&st->msg_encode_failure, memory_order_relaxed);
     vty_out(vty, "   encoding failures: %llu\n", countval64);
-    countval64 = atomic_load_explicit(&RPC_STATS.msg_decode_failure, memory_order_relaxed);
+    countval64 = atomic_load_explicit(&st->msg_decode_failure, memory_order_relaxed);
     vty_out(vty, "   decoding failures: %llu\n", countval64);
 }
-static void hh_vty_show_stats_rpc(struct vty *vty)
+static void hh_vty_show_stats_rpc(struct vty *vty, struct rpc_stats *st)
 {
     BUG(!vty);
 
@@ -110,9 +363,7 @@ static void hh_vty_show_stats_rpc(struct vty *vty)
 
     for (enum ObjType ot = None + 1; ot < MaxObjType; ot++) {
         for (enum RpcOp op = Connect; op < MaxRpcOp; op++) {
-            /* there are some combinations that are not possible. Exclude them from output */
-            if ((ot == ConnectInfo && op != Connect) || (ot != ConnectInfo && op == Connect) ||
-               (op == Update && ot != IpRoute ))
+            if (!rpc_req_possible(ot, op))
                 continue;
 
             /* sent, received, unknown-rescode */
@@ -129,28 +380,387 @@ static void hh_vty_show_stats_rpc(struct vty *vty)
     }
     vty_out(vty, "\n\n");
 }
-static void hh_vty_show_stats_rpc_control(struct vty *vty)
+static void hh_vty_show_stats_rpc_control(struct vty *vty, struct rpc_stats *st)
 {
     BUG(!vty);
 
     uint64_t countval64;
 
     vty_out(vty, "  ───────────────────────────────────────── Control / Keepalives ─────────────────────────────────────────\n");
-    countval64 = atomic_load_explicit(&RPC_STATS.control_tx, memory_order_relaxed);
+    countval64 = atomic_load_explicit(&st->control_tx, memory_order_relaxed);
     vty_out(vty, "   control tx: %llu\n", countval64);
-    countval64 = atomic_load_explicit(&RPC_STATS.control_rx, memory_order_relaxed);
+    countval64 = atomic_load_explicit(&st->control_rx, memory_order_relaxed);
     vty_out(vty, "   control rx: %llu\n", countval64);
+    countval64 = atomic_load_explicit(&st->control_suppressed, memory_order_relaxed);
+    vty_out(vty, "   keepalives suppressed: %"PRIu64"\n", countval64);
+    vty_out(vty, "   resumes after reconnect: %"PRIu64" (requests resent: %"PRIu64", %"PRIu64" of them processed)\n",
+            GET_IO_COUNT(resumes), GET_IO_COUNT(resume_resent), GET_IO_COUNT(resume_processed));
+}
+static void hh_vty_show_stats_hand_off(struct vty *vty, struct rpc_stats *st)
+{
+    BUG(!vty);
+
+    uint64_t ctxs = atomic_load_explicit(&st->hand_off_ctxs, memory_order_relaxed);
+    uint64_t wakeups = atomic_load_explicit(&st->hand_off_wakeups, memory_order_relaxed);
+
+    vty_out(vty, "  ───────────────────────────────────────── Completions to zebra ─────────────────────────────────────────\n");
+    vty_out(vty, "   contexts completed: %"PRIu64"\n", ctxs);
+    vty_out(vty, "   zebra wakeups: %"PRIu64"\n", wakeups);
+    vty_out(vty, "   completions per wakeup: %.2f (max %"PRIu64")\n", wakeups ? (double)ctxs / wakeups : 0.0,
+            GET_IO_COUNT(hand_off_max));
+    vty_out(vty, "   cumulative acks: %s, %"PRIu64" responses acked %"PRIu64" requests\n",
+            dp_msg_cumulative_acks() ? "enabled" :
+            dp_msg_cumulative_acks_configured() ? "not supported by dataplane" : "disabled",
+            GET_IO_COUNT(cumulative_acks), GET_IO_COUNT(implicit_acks));
+}
+/* latencies of a kind of request, summed across shards */
+static const double lat_percentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+static const char *const lat_percentile_names[] = { "p50", "p90", "p99", "p99.9" };
+struct rpc_lat_summary {
+    uint64_t total;
+    uint64_t avg;
+    uint64_t max;
+    uint64_t pct[array_size(lat_percentiles)];
+};
+static bool rpc_lat_summarize(enum ObjType ot, enum RpcOp op, struct rpc_lat_summary *s)
+{
+    uint64_t buckets[RPC_LAT_BUCKETS] = {0};
+    uint64_t count = 0, sum = 0;
+    unsigned int used = atomic_load_explicit(&rpc_stats_shards_used, memory_order_relaxed);
+
+    /* sum the shards: buckets may be updated meanwhile */
+    memset(s, 0, sizeof(*s));
+    for (unsigned int n = 0; n < MIN(used, RPC_STATS_SHARDS); n++) {
+        struct rpc_lat_hist *h = &RPC_STATS[n].latency[ot][op];
+        for (unsigned int i = 0; i < RPC_LAT_BUCKETS; i++)
+            buckets[i] += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        count += atomic_load_explicit(&h->count, memory_order_relaxed);
+        sum += atomic_load_explicit(&h->sum, memory_order_relaxed);
+        s->max = MAX(s->max, atomic_load_explicit(&h->max, memory_order_relaxed));
+    }
+    for (unsigned int i = 0; i < RPC_LAT_BUCKETS; i++)
+        s->total += buckets[i];
+    if (!s->total)
+        return false;
+
+    s->avg = count ? sum / count : 0;
+    unsigned int idx = 0;
+    uint64_t seen = buckets[0];
+    for (size_t p = 0; p < array_size(lat_percentiles); p++) {
+        uint64_t rank = (uint64_t)((double)s->total * lat_percentiles[p] / 100.0 + 0.5);
+        rank = MAX(rank, 1);
+        while (seen < rank && idx < RPC_LAT_BUCKETS - 1)
+            seen += buckets[++idx];
+        s->pct[p] = rpc_lat_bucket_high(idx);
+    }
+    return true;
+}
+
+/* vty: show percentiles of round-trip latencies */
+void hh_vty_show_latency(struct vty *vty)
+{
+    BUG(!vty);
+    struct rpc_lat_summary s;
+
+    vty_out(vty, "  ──────────────────────────────────────── Round-trip latency (usec) ─────────────────────────────────────\n");
+    vty_out(vty, "\n%10.10s:%-9.9s: %12.12s %10.10s %10.10s %10.10s %10.10s %10.10s %10.10s\n", "Object", "Operation",
+            "count", "avg", "p50", "p90", "p99", "p99.9", "max");
+
+    for (enum ObjType ot = None + 1; ot < MaxObjType; ot++) {
+        for (enum RpcOp op = Connect; op < MaxRpcOp; op++) {
+            if (!rpc_lat_summarize(ot, op, &s))
+                continue;
+            vty_out(vty, "%10.10s:%-9.9s: %12"PRIu64" %10"PRIu64, str_object_type(ot), str_rpc_op(op),
+                    s.total, s.avg);
+            for (size_t p = 0; p < array_size(lat_percentiles); p++)
+                vty_out(vty, " %10"PRIu64, s.pct[p]);
+            vty_out(vty, " %10"PRIu64"\n", s.max);
+        }
+    }
+    vty_out(vty, "\n");
+}
+
+/* json: percentiles of round-trip latencies, in usec */
+struct json_object *hh_json_latency(void)
+{
+    struct json_object *json = hh_json_new();
+    struct json_object *jreqs = json_object_new_array();
+    struct rpc_lat_summary s;
+
+    for (enum ObjType ot = None + 1; ot < MaxObjType; ot++) {
+        for (enum RpcOp op = Connect; op < MaxRpcOp; op++) {
+            if (!rpc_lat_summarize(ot, op, &s))
+                continue;
+            struct json_object *jreq = json_object_new_object();
+            json_object_string_add(jreq, "object", str_object_type(ot));
+            json_object_string_add(jreq, "operation", str_rpc_op(op));
+            json_object_int_add(jreq, "count", s.total);
+            json_object_int_add(jreq, "avg", s.avg);
+            for (size_t p = 0; p < array_size(lat_percentiles); p++)
+                json_object_int_add(jreq, lat_percentile_names[p], s.pct[p]);
+            json_object_int_add(jreq, "max", s.max);
+            json_object_array_add(jreqs, jreq);
+        }
+    }
+    json_object_object_add(json, "requests", jreqs);
+    return json;
 }
+
 void hh_vty_show_stats(struct vty *vty)
 {
     BUG(!vty);
+    struct rpc_stats st;
+
+    rpc_stats_snapshot(&st);
 
     // N.B. connected state and readiness are booleans but not atomic
     vty_out(vty, " Dataplane sock connected: %s\n", dplane_sock_is_connected() ? "yes" : "no");
     vty_out(vty, " Dataplane ready (configured): %s\n", dplane_is_ready() ? "yes" : "no");
 
-    hh_vty_show_stats_io(vty);
-    hh_vty_show_stats_serialization(vty);
-    hh_vty_show_stats_rpc_control(vty);
-    hh_vty_show_stats_rpc(vty);
+    hh_vty_show_shards(vty);
+    hh_vty_show_stats_io(vty, &st);
+    hh_vty_show_stats_serialization(vty, &st);
+    hh_vty_show_stats_rpc_control(vty, &st);
+    hh_vty_show_stats_hand_off(vty, &st);
+    hh_vty_show_tx_window(vty);
+    hh_vty_show_stats_rpc(vty, &st);
+}
+
+/* json: RPC stats, with rates of the main counters */
+struct json_object *hh_json_stats(void)
+{
+    struct json_object *json = hh_json_new();
+    struct json_object *jobj, *jreqs, *jrates;
+    struct rpc_stats st_, *st = &st_;
+
+    rpc_stats_snapshot(st);
+    json_object_boolean_add(json, "connected", dplane_sock_is_connected());
+    json_object_boolean_add(json, "ready", dplane_is_ready());
+    json_object_object_add(json, "shards", hh_json_shards());
+
+    jobj = json_object_new_object();
+    json_object_int_add(jobj, "tx", GET_IO_COUNT(tx_ok));
+    json_object_int_add(jobj, "txFailures", GET_IO_COUNT(tx_failure));
+    json_object_int_add(jobj, "txRetries", GET_IO_COUNT(tx_eagain));
+    json_object_int_add(jobj, "rx", GET_IO_COUNT(rx_ok));
+    json_object_int_add(jobj, "rxFailures", GET_IO_COUNT(rx_failure));
+    json_object_int_add(jobj, "rxRetries", GET_IO_COUNT(rx_eagain));
+    json_object_object_add(json, "io", jobj);
+
+    jobj = json_object_new_object();
+    json_object_int_add(jobj, "encodeFailures", GET_IO_COUNT(msg_encode_failure));
+    json_object_int_add(jobj, "decodeFailures", GET_IO_COUNT(msg_decode_failure));
+    json_object_object_add(json, "serialization", jobj);
+
+    jobj = json_object_new_object();
+    json_object_int_add(jobj, "tx", GET_IO_COUNT(control_tx));
+    json_object_int_add(jobj, "rx", GET_IO_COUNT(control_rx));
+    json_object_int_add(jobj, "keepalivesSuppressed", GET_IO_COUNT(control_suppressed));
+    json_object_int_add(jobj, "resumes", GET_IO_COUNT(resumes));
+    json_object_int_add(jobj, "resumeProcessed", GET_IO_COUNT(resume_processed));
+    json_object_int_add(jobj, "resumeResent", GET_IO_COUNT(resume_resent));
+    json_object_object_add(json, "control", jobj);
+
+    jobj = json_object_new_object();
+    json_object_int_add(jobj, "contexts", GET_IO_COUNT(hand_off_ctxs));
+    json_object_int_add(jobj, "wakeups", GET_IO_COUNT(hand_off_wakeups));
+    json_object_int_add(jobj, "maxPerWakeup", GET_IO_COUNT(hand_off_max));
+    json_object_boolean_add(jobj, "cumulativeAcks", dp_msg_cumulative_acks());
+    json_object_int_add(jobj, "cumulativeResponses", GET_IO_COUNT(cumulative_acks));
+    json_object_int_add(jobj, "implicitAcks", GET_IO_COUNT(implicit_acks));
+    json_object_object_add(json, "completions", jobj);
+
+    json_object_object_add(json, "txCoalescing", hh_json_tx_window());
+
+    jreqs = json_object_new_array();
+    for (enum ObjType ot = None + 1; ot < MaxObjType; ot++) {
+        for (enum RpcOp op = Connect; op < MaxRpcOp; op++) {
+            if (!rpc_req_possible(ot, op))
+                continue;
+            struct json_object *jreq = json_object_new_object();
+            json_object_string_add(jreq, "object", str_object_type(ot));
+            json_object_string_add(jreq, "operation", str_rpc_op(op));
+            json_object_int_add(jreq, "sent", GET_REQ_COUNT(ot, op, sent));
+            json_object_int_add(jreq, "replied", GET_REQ_COUNT(ot, op, replied));
+            json_object_int_add(jreq, "unknownResult", GET_REQ_COUNT(ot, op, unk_err));
+            jobj = json_object_new_object();
+            for (enum RpcResultCode rc = Ok; rc < RpcResultCodeMax; rc++)
+                json_object_int_add(jobj, str_rescode(rc), GET_REQ_COUNT_RC(ot, op, rc));
+            json_object_object_add(jreq, "results", jobj);
+            json_object_array_add(jreqs, jreq);
+        }
+    }
+    json_object_object_add(json, "requests", jreqs);
+
+    if ((jrates = rpc_rates_json()) != NULL)
+        json_object_object_add(json, "rates", jrates);
+    return json;
+}
+
+/* fill the counters of the stats page, and the latency summaries if asked to */
+#define SHM_COPY(name) shm->name = GET_IO_COUNT(name)
+void rpc_stats_shm_fill(struct hh_stats_shm *shm, bool latency)
+{
+    BUG(!shm);
+    struct rpc_stats st_, *st = &st_;
+    struct rpc_lat_summary s;
+
+    rpc_stats_snapshot(st);
+    shm->tx = GET_IO_COUNT(tx_ok);
+    shm->tx_failure = GET_IO_COUNT(tx_failure);
+    shm->tx_eagain = GET_IO_COUNT(tx_eagain);
+    shm->rx = GET_IO_COUNT(rx_ok);
+    shm->rx_failure = GET_IO_COUNT(rx_failure);
+    shm->rx_eagain = GET_IO_COUNT(rx_eagain);
+    shm->encode_failure = GET_IO_COUNT(msg_encode_failure);
+    shm->decode_failure = GET_IO_COUNT(msg_decode_failure);
+    SHM_COPY(control_tx);
+    SHM_COPY(control_rx);
+    SHM_COPY(control_suppressed);
+    SHM_COPY(resumes);
+    SHM_COPY(resume_processed);
+    SHM_COPY(resume_resent);
+    SHM_COPY(hand_off_ctxs);
+    SHM_COPY(hand_off_wakeups);
+    SHM_COPY(hand_off_max);
+    SHM_COPY(cumulative_acks);
+    SHM_COPY(implicit_acks);
+
+    for (enum ObjType ot = None; ot < MaxObjType; ot++) {
+        for (enum RpcOp op = Connect; op < MaxRpcOp; op++) {
+            struct hh_stats_shm_req *req = &shm->requests[ot][op];
+            req->sent = GET_REQ_COUNT(ot, op, sent);
+            req->replied = GET_REQ_COUNT(ot, op, replied);
+            req->unk_err = GET_REQ_COUNT(ot, op, unk_err);
+            for (enum RpcResultCode rc = Ok; rc < RpcResultCodeMax; rc++)
+                req->rescode[rc] = GET_REQ_COUNT_RC(ot, op, rc);
+
+            if (!latency || !rpc_lat_summarize(ot, op, &s))
+                continue;
+            req->lat_count = s.total;
+            req->lat_avg = s.avg;
+            req->lat_p50 = s.pct[0];
+            req->lat_p90 = s.pct[1];
+            req->lat_p99 = s.pct[2];
+            req->lat_p999 = s.pct[3];
+            req->lat_max = s.max;
+        }
+    }
+}
+
+/* metrics: plain counters */
+static const struct {
+    const char *name;
+    size_t offset;
+    const char *help;
+} rpc_metric_counters[] = {
+#define RPC_METRIC(name, member, help) { name, offsetof(struct rpc_stats, member), help }
+    RPC_METRIC("hh_rpc_tx", tx_ok, "Messages sent to dataplane."),
+    RPC_METRIC("hh_rpc_tx_failures", tx_failure, "Failures to send messages to dataplane."),
+    RPC_METRIC("hh_rpc_tx_retries", tx_eagain, "Sends retried since the socket was not writable."),
+    RPC_METRIC("hh_rpc_rx", rx_ok, "Messages received from dataplane."),
+    RPC_METRIC("hh_rpc_rx_failures", rx_failure, "Failures to receive messages from dataplane."),
+    RPC_METRIC("hh_rpc_rx_retries", rx_eagain, "Receives retried since the socket was not readable."),
+    RPC_METRIC("hh_rpc_encode_failures", msg_encode_failure, "Messages that could not be encoded."),
+    RPC_METRIC("hh_rpc_decode_failures", msg_decode_failure, "Messages that could not be decoded."),
+    RPC_METRIC("hh_rpc_control_tx", control_tx, "Control messages sent."),
+    RPC_METRIC("hh_rpc_control_rx", control_rx, "Control messages received."),
+    RPC_METRIC("hh_rpc_keepalives_suppressed", control_suppressed, "Keepalives not sent since the channel was busy."),
+    RPC_METRIC("hh_rpc_completions", hand_off_ctxs, "Contexts completed back to zebra."),
+    RPC_METRIC("hh_rpc_completion_wakeups", hand_off_wakeups, "Times zebra was signaled of completions."),
+    RPC_METRIC("hh_rpc_cumulative_acks", cumulative_acks, "Responses that acknowledged prior requests."),
+    RPC_METRIC("hh_rpc_implicit_acks", implicit_acks, "Requests acknowledged by a cumulative response."),
+    RPC_METRIC("hh_rpc_resumes", resumes, "Resumes after reconnecting to dataplane."),
+    RPC_METRIC("hh_rpc_resume_processed", resume_processed, "Requests dataplane processed before resumes, resent for their results."),
+    RPC_METRIC("hh_rpc_resume_resent", resume_resent, "Requests resent on resumes."),
+#undef RPC_METRIC
+};
+
+/* Latency histograms are exported with a bucket per power of 2 (the 8 sub-buckets of each
+ * summed), up to RPC_METRIC_LAT_GROUPS: beyond, only +Inf */
+#define RPC_METRIC_LAT_GROUPS 23    /* up to 2^25 usec (33 s) */
+
+static void rpc_lat_metrics(struct hh_metrics_buf *b, enum ObjType ot, enum RpcOp op)
+{
+    uint64_t buckets[RPC_LAT_BUCKETS] = {0};
+    uint64_t sum = 0, total = 0, cumulative = 0;
+    unsigned int used = atomic_load_explicit(&rpc_stats_shards_used, memory_order_relaxed);
+
+    for (unsigned int n = 0; n < MIN(used, RPC_STATS_SHARDS); n++) {
+        struct rpc_lat_hist *h = &RPC_STATS[n].latency[ot][op];
+        for (unsigned int i = 0; i < RPC_LAT_BUCKETS; i++)
+            buckets[i] += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        sum += atomic_load_explicit(&h->sum, memory_order_relaxed);
+    }
+    for (unsigned int i = 0; i < RPC_LAT_BUCKETS; i++)
+        total += buckets[i];
+    if (!total)
+        return;
+
+    const char *o = str_object_type(ot), *p = str_rpc_op(op);
+    for (unsigned int g = 0; g < RPC_METRIC_LAT_GROUPS; g++) {
+        unsigned int last = ((g + 1) << RPC_LAT_SUB_BITS) - 1;
+        for (unsigned int i = g << RPC_LAT_SUB_BITS; i <= last; i++)
+            cumulative += buckets[i];
+        hh_metrics_printf(b, "hh_rpc_latency_seconds_bucket{object=\"%s\",operation=\"%s\",le=\"%.6f\"} %"PRIu64"\n",
+                          o, p, (double)rpc_lat_bucket_high(last) / 1000000.0, cumulative);
+    }
+    hh_metrics_printf(b, "hh_rpc_latency_seconds_bucket{object=\"%s\",operation=\"%s\",le=\"+Inf\"} %"PRIu64"\n",
+                      o, p, total);
+    hh_metrics_printf(b, "hh_rpc_latency_seconds_count{object=\"%s\",operation=\"%s\"} %"PRIu64"\n", o, p, total);
+    hh_metrics_printf(b, "hh_rpc_latency_seconds_sum{object=\"%s\",operation=\"%s\"} %.6f\n", o, p,
+                      (double)sum / 1000000.0);
+}
+
+/* metrics: RPC counters, requests and their latency */
+void rpc_stats_metrics(struct hh_metrics_buf *b)
+{
+    BUG(!b);
+    struct rpc_stats st_, *st = &st_;
+
+    rpc_stats_snapshot(st);
+    for (size_t i = 0; i < array_size(rpc_metric_counters); i++) {
+        _Atomic uint64_t *c = (_Atomic uint64_t *)((char *)st + rpc_metric_counters[i].offset);
+        hh_metrics_family(b, rpc_metric_counters[i].name, "counter", rpc_metric_counters[i].help);
+        hh_metrics_printf(b, "%s_total %"PRIu64"\n", rpc_metric_counters[i].name,
+                          atomic_load_explicit(c, memory_order_relaxed));
+    }
+    hh_metrics_family(b, "hh_rpc_completions_per_wakeup_max", "gauge", "Most contexts completed with a single wakeup.");
+    hh_metrics_printf(b, "hh_rpc_completions_per_wakeup_max %"PRIu64"\n", GET_IO_COUNT(hand_off_max));
+
+    hh_metrics_family(b, "hh_rpc_requests_sent", "counter", "Requests sent to dataplane.");
+    for (enum ObjType ot = None + 1; ot < MaxObjType; ot++)
+        for (enum RpcOp op = Connect; op < MaxRpcOp; op++)
+            if (rpc_req_possible(ot, op))
+                hh_metrics_printf(b, "hh_rpc_requests_sent_total{object=\"%s\",operation=\"%s\"} %"PRIu64"\n",
+                                  str_object_type(ot), str_rpc_op(op), GET_REQ_COUNT(ot, op, sent));
+    hh_metrics_family(b, "hh_rpc_responses", "counter", "Responses received from dataplane, per result.");
+    for (enum ObjType ot = None + 1; ot < MaxObjType; ot++) {
+        for (enum RpcOp op = Connect; op < MaxRpcOp; op++) {
+            if (!rpc_req_possible(ot, op))
+                continue;
+            for (enum RpcResultCode rc = Ok; rc < RpcResultCodeMax; rc++)
+                hh_metrics_printf(b, "hh_rpc_responses_total{object=\"%s\",operation=\"%s\",result=\"%s\"} %"PRIu64"\n",
+                                  str_object_type(ot), str_rpc_op(op), str_rescode(rc), GET_REQ_COUNT_RC(ot, op, rc));
+            hh_metrics_printf(b, "hh_rpc_responses_total{object=\"%s\",operation=\"%s\",result=\"unknown\"} %"PRIu64"\n",
+                              str_object_type(ot), str_rpc_op(op), GET_REQ_COUNT(ot, op, unk_err));
+        }
+    }
+
+    hh_metrics_family(b, "hh_rpc_latency_seconds", "histogram", "Round-trip latency of requests.");
+    for (enum ObjType ot = None + 1; ot < MaxObjType; ot++)
+        for (enum RpcOp op = Connect; op < MaxRpcOp; op++)
+            rpc_lat_metrics(b, ot, op);
+}
+
+/* start / stop sampling the counters for rates */
+void init_rpc_stats(void)
+{
+    memset(rates.samples, 0, sizeof(rates.samples));
+    atomic_store_explicit(&rates.num_samples, 0, memory_order_relaxed);
+    rpc_rate_sample(NULL);
+}
+void fini_rpc_stats(void)
+{
+    EVENT_OFF(rates.ev_sample);
 }
@@ -3,9 +3,11 @@
 #ifndef SRC_HH_DP_RPC_STATS_H_
 #define SRC_HH_DP_RPC_STATS_H_
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <dplane-rpc/proto.h> /* Codes for RpcOp and ObjType */
 #include "lib/vty.h"
+#include "lib/json.h"
 
 /* A stats cell for a request */
 struct rpc_req_stat_cell {
@@ -22,7 +24,19 @@ struct rpc_req_stat_cell {
      */
 };
 
-/* Main structure to keep RPC statistic counters */
+/* Log-linear histogram of round-trip latencies (usec). Values below 8 have a bucket each.
+ * Above, each power of 2 is split in 8 buckets, so percentiles are off by 12.5% at most */
+#define RPC_LAT_SUB_BITS 3
+#define RPC_LAT_BUCKETS 256
+struct rpc_lat_hist {
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum;
+    _Atomic uint64_t max;
+    _Atomic uint64_t buckets[RPC_LAT_BUCKETS];
+};
+
+/* Main structure to keep RPC statistic counters. Each thread counting has a copy of its own
+ * (a shard), which readers sum up. All members must be _Atomic uint64_t */
 struct rpc_stats {
     /* IO errors: tx */
     _Atomic uint64_t tx_ok;
@@ -45,6 +59,21 @@ struct rpc_stats {
     /* stats for other RPC message types ... */
     _Atomic uint64_t control_tx;
     _Atomic uint64_t control_rx;
+    _Atomic uint64_t control_suppressed;  /* keepalives not sent since the channel was busy */
+
+    /* contexts handed off to zebra, and times that zebra was signaled */
+    _Atomic uint64_t hand_off_ctxs;
+    _Atomic uint64_t hand_off_wakeups;
+    _Atomic uint64_t hand_off_max;    /* max contexts per wakeup */
+
+    /* responses that acknowledged prior requests, and requests acknowledged that way */
+    _Atomic uint64_t cumulative_acks;
+    _Atomic uint64_t implicit_acks;
+
+    /* resumes after reconnect, requests resent on them and those dataplane had processed */
+    _Atomic uint64_t resumes;
+    _Atomic uint64_t resume_processed;
+    _Atomic uint64_t resume_resent;
 };
 
 /* Increment RPC stats counters */
@@ -52,6 +81,7 @@ void rpc_count_encode_failure(void);
 void rpc_count_decode_failure(void);
 void rpc_count_request_sent(enum RpcOp op, enum ObjType otype);
 void rpc_count_request_replied(enum RpcOp op, enum ObjType otype, enum RpcResultCode rescode);
+void rpc_count_latency(enum RpcOp op, enum ObjType otype, uint64_t usec);
 
 /* increment IO Tx counters */
 void rpc_count_tx(void);
@@ -66,8 +96,35 @@ void rpc_count_rx_eagain(void);
 /* Control / keepalives */
 void rpc_count_ctl_tx(void);
 void rpc_count_ctl_rx(void);
+void rpc_count_ctl_suppressed(void);
+
+/* Contexts handed off to zebra with a single wakeup */
+void rpc_count_hand_off(uint32_t num_ctxs);
+
+/* Requests acknowledged by a cumulative response */
+void rpc_count_cumulative_ack(uint32_t num_reqs);
+
+/* Resume after reconnect */
+void rpc_count_resume(uint32_t processed, size_t resent);
+
+/* fill the counters of the stats page in shared memory, and the latency summaries if asked to */
+struct hh_stats_shm;
+void rpc_stats_shm_fill(struct hh_stats_shm *shm, bool latency);
+
+/* append the RPC metrics */
+struct hh_metrics_buf;
+void rpc_stats_metrics(struct hh_metrics_buf *b);
+
+/* start / stop sampling counters for rates */
+void init_rpc_stats(void);
+void fini_rpc_stats(void);
 
 /* vty: show RPC stats */
 void hh_vty_show_stats(struct vty *vty);
+struct json_object *hh_json_stats(void);
+
+/* vty: show percentiles of round-trip latencies */
+void hh_vty_show_latency(struct vty *vty);
+struct json_object *hh_json_latency(void);
 
 #endif /* SRC_HH_DP_RPC_STATS_H_ */
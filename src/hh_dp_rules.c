@@ -0,0 +1,673 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "config.h" /* FRR config.h */
+#include "lib/zebra.h"
+#include "lib/libfrr.h"
+#include "lib/frrcu.h"
+#include "lib/prefix.h"
+#include "lib/plist.h"
+#include "lib/plist_int.h" /* prefix-list entries */
+#include "zebra/zebra_dplane.h"
+
+#include "hh_dp_internal.h"
+#include "hh_dp_msg_cache.h" /* MGROUP ZEBRA */
+#include "hh_dp_msg.h" /* encode_route_type() */
+#include "hh_dp_rules.h"
+
+/*
+ * Rule engine. Rules are configured from vty in the main thread and compiled into a
+ * single immutable block that the dplane pthread evaluates without locking. Rules are
+ * indexed by route type and prefix lengths are matched with a bitmap. Prefix-lists are
+ * copied into the compiled block, since FRR's are not safe to use from the dplane pthread;
+ * they are re-synced periodically. Compiled blocks are replaced atomically and freed via RCU.
+ *
+ * Rules apply to routes as zebra installs them. What was decided for each route is recorded
+ * in the dplane pthread, so that its updates and deletion go where the route was installed.
+ */
+
+DEFINE_MTYPE_STATIC(ZEBRA, HH_RULES, "HH Dataplane rules");
+DEFINE_MTYPE_STATIC(ZEBRA, HH_RULES_COMPILED, "HH Dataplane compiled rules");
+DEFINE_MTYPE_STATIC(ZEBRA, HH_ROUTE_DECISION, "HH Dataplane route decision");
+
+#define HH_RULES_PLIST_SYNC_SEC 5
+
+/* a prefix-list entry, as copied from FRR's */
+struct hh_plist_entry {
+    struct prefix prefix;
+    uint8_t ge;
+    uint8_t le;
+    bool permit;
+};
+
+/* a compiled rule */
+struct hh_crule {
+    _Atomic uint64_t hits;
+    uint32_t seq;
+    uint8_t action;
+    bool match_vrf;
+    bool match_table;
+    bool has_plist;
+    VrfId vrfid;
+    uint32_t tableid;
+    uint64_t plen[3];            /* bitmap of prefix lengths 0-128 */
+    uint32_t plist_first;        /* prefix-list entries in the compiled block */
+    uint32_t plist_count;
+};
+
+/* compiled rule set: a single allocation */
+struct hh_rules_compiled {
+    struct rcu_head rcu;
+    _Atomic uint64_t no_match;
+    uint32_t num_rules;
+    struct hh_crule *rules;
+    struct hh_plist_entry *plist;
+    uint32_t *index;                    /* rule indices, per route type */
+    uint32_t type_first[HH_RTYPE_MAX];
+    uint32_t type_count[HH_RTYPE_MAX];
+};
+
+/* a rule set */
+struct hh_ruleset {
+    const char *name;
+    const char *action_str[3];        /* names of the actions, as in vty */
+    struct hh_rule_cfg *rules;        /* sorted by seq; main thread only */
+    uint32_t num_rules;
+    struct hh_rules_compiled *_Atomic compiled;
+};
+
+static struct hh_ruleset rulesets[HH_RULESET_MAX] = {
+    [HH_RULESET_FILTER] = {
+        .name = "filter",
+        .action_str = { [HH_RULE_PERMIT] = "permit", [HH_RULE_DENY] = "deny" },
+    },
+    [HH_RULESET_KERNEL] = {
+        .name = "kernel",
+        .action_str = { [HH_RULE_PERMIT] = "install", [HH_RULE_DENY] = "skip" },
+    },
+};
+
+static struct event_loop *main_master;
+static struct event *ev_plist_sync;
+
+PREDECL_RBTREE_UNIQ(hh_route_tree);
+
+/* where a route was installed */
+struct hh_route_decision {
+    uint32_t vrfid;
+    uint32_t tableid;
+    uint8_t family;
+    uint8_t len;
+    uint8_t addr[16];
+    uint8_t flags;
+#define HH_ROUTE_F_SENT   0x1   /* sent to dataplane */
+#define HH_ROUTE_F_KERNEL 0x2   /* programmed in the kernel */
+    struct hh_route_tree_item link;
+};
+
+#define DECISION_CMP(a, b, field) \
+    do { if ((a)->field != (b)->field) return (a)->field < (b)->field ? -1 : 1; } while (0)
+
+static int hh_route_decision_cmp(const struct hh_route_decision *a, const struct hh_route_decision *b)
+{
+    DECISION_CMP(a, b, vrfid);
+    DECISION_CMP(a, b, tableid);
+    DECISION_CMP(a, b, family);
+    DECISION_CMP(a, b, len);
+    return memcmp(a->addr, b->addr, sizeof(a->addr));
+}
+
+DECLARE_RBTREE_UNIQ(hh_route_tree, struct hh_route_decision, link, hh_route_decision_cmp);
+
+/* decisions, per route. Only the dplane pthread uses them; the vty reads the counts */
+static struct {
+    struct hh_route_tree_head tree;
+    size_t num_sent;
+    size_t num_kernel;
+} routes;
+
+/* route type names */
+static const struct {
+    const char *name;
+    RouteType rtype;
+} rtype_names[] = {
+    { "local", Local },
+    { "connected", Connected },
+    { "static", Static },
+    { "ospf", Ospf },
+    { "isis", Isis },
+    { "bgp", Bgp },
+    { "other", Other },
+};
+
+int hh_rtype_from_str(const char *name)
+{
+    for (size_t i = 0; i < array_size(rtype_names); i++) {
+        if (strmatch(rtype_names[i].name, name))
+            return rtype_names[i].rtype;
+    }
+    return -1;
+}
+const char *hh_rtype_str(RouteType rtype)
+{
+    for (size_t i = 0; i < array_size(rtype_names); i++) {
+        if (rtype_names[i].rtype == rtype)
+            return rtype_names[i].name;
+    }
+    return "unknown";
+}
+
+/* count entries of a prefix-list, for both address families */
+static uint32_t hh_plist_count(const char *name)
+{
+    uint32_t count = 0;
+    afi_t afis[] = { AFI_IP, AFI_IP6 };
+
+    for (size_t i = 0; i < array_size(afis); i++) {
+        struct prefix_list *plist = prefix_list_lookup(afis[i], name);
+        for (struct prefix_list_entry *pe = plist ? plist->head : NULL; pe; pe = pe->next)
+            count++;
+    }
+    return count;
+}
+
+/* copy the entries of a prefix-list */
+static uint32_t hh_plist_copy(const char *name, struct hh_plist_entry *dst)
+{
+    uint32_t count = 0;
+    afi_t afis[] = { AFI_IP, AFI_IP6 };
+
+    for (size_t i = 0; i < array_size(afis); i++) {
+        struct prefix_list *plist = prefix_list_lookup(afis[i], name);
+        for (struct prefix_list_entry *pe = plist ? plist->head : NULL; pe; pe = pe->next) {
+            struct hh_plist_entry *e = &dst[count++];
+            e->prefix = pe->prefix;
+            e->ge = (uint8_t)pe->ge;
+            e->le = (uint8_t)pe->le;
+            e->permit = (pe->type == PREFIX_PERMIT);
+        }
+    }
+    return count;
+}
+
+#define ALIGN8(x) (((x) + 7) & ~((size_t)7))
+
+/* compile the rules of a rule set into a single block */
+static struct hh_rules_compiled *hh_rules_compile(struct hh_ruleset *rs)
+{
+    uint32_t num_plist = 0;
+    uint32_t num_index = 0;
+
+    if (!rs->num_rules)
+        return NULL;
+
+    /* size the block */
+    for (uint32_t i = 0; i < rs->num_rules; i++) {
+        const struct hh_rule_cfg *cfg = &rs->rules[i];
+        if (cfg->plist[0])
+            num_plist += hh_plist_count(cfg->plist);
+        for (uint32_t t = 0; t < HH_RTYPE_MAX; t++) {
+            if (!cfg->rtypes || (cfg->rtypes & (1u << t)))
+                num_index++;
+        }
+    }
+    size_t off_rules = ALIGN8(sizeof(struct hh_rules_compiled));
+    size_t off_plist = off_rules + ALIGN8(rs->num_rules * sizeof(struct hh_crule));
+    size_t off_index = off_plist + ALIGN8(num_plist * sizeof(struct hh_plist_entry));
+    size_t size = off_index + num_index * sizeof(uint32_t);
+
+    uint8_t *block = XCALLOC(MTYPE_HH_RULES_COMPILED, size);
+    struct hh_rules_compiled *c = (struct hh_rules_compiled *)block;
+    c->num_rules = rs->num_rules;
+    c->rules = (struct hh_crule *)(block + off_rules);
+    c->plist = (struct hh_plist_entry *)(block + off_plist);
+    c->index = (uint32_t *)(block + off_index);
+
+    /* rules */
+    uint32_t plist_next = 0;
+    for (uint32_t i = 0; i < rs->num_rules; i++) {
+        const struct hh_rule_cfg *cfg = &rs->rules[i];
+        struct hh_crule *r = &c->rules[i];
+
+        r->seq = cfg->seq;
+        r->action = cfg->action;
+        r->match_vrf = cfg->match_vrf;
+        r->vrfid = cfg->vrfid;
+        r->match_table = cfg->match_table;
+        r->tableid = cfg->tableid;
+        for (uint32_t len = cfg->ge; len <= cfg->le && len <= 128; len++)
+            r->plen[len >> 6] |= (1ULL << (len & 63));
+        if (cfg->plist[0]) {
+            r->has_plist = true;
+            r->plist_first = plist_next;
+            r->plist_count = hh_plist_copy(cfg->plist, &c->plist[plist_next]);
+            plist_next += r->plist_count;
+        }
+    }
+
+    /* index rules by route type, keeping their order */
+    uint32_t n = 0;
+    for (uint32_t t = 0; t < HH_RTYPE_MAX; t++) {
+        c->type_first[t] = n;
+        for (uint32_t i = 0; i < rs->num_rules; i++) {
+            if (!rs->rules[i].rtypes || (rs->rules[i].rtypes & (1u << t)))
+                c->index[n++] = i;
+        }
+        c->type_count[t] = n - c->type_first[t];
+    }
+    return c;
+}
+
+/* tell if two compiled blocks of the same rule configuration have the same prefix-lists */
+static bool hh_rules_compiled_equal(const struct hh_rules_compiled *a, const struct hh_rules_compiled *b)
+{
+    if (!a || !b)
+        return a == b;
+    if (a->num_rules != b->num_rules)
+        return false;
+    for (uint32_t i = 0; i < a->num_rules; i++) {
+        const struct hh_crule *ra = &a->rules[i], *rb = &b->rules[i];
+        if (ra->plist_count != rb->plist_count)
+            return false;
+        if (memcmp(&a->plist[ra->plist_first], &b->plist[rb->plist_first],
+                   ra->plist_count * sizeof(struct hh_plist_entry)))
+            return false;
+    }
+    return true;
+}
+
+static bool hh_rules_use_plist(void)
+{
+    for (uint32_t id = 0; id < HH_RULESET_MAX; id++) {
+        for (uint32_t i = 0; i < rulesets[id].num_rules; i++) {
+            if (rulesets[id].rules[i].plist[0])
+                return true;
+        }
+    }
+    return false;
+}
+
+/* publish a new compiled block for a rule set. Hit counters are carried over */
+static void hh_rules_publish(struct hh_ruleset *rs, struct hh_rules_compiled *c)
+{
+    struct hh_rules_compiled *old = atomic_load_explicit(&rs->compiled, memory_order_relaxed);
+
+    if (c && old) {
+        for (uint32_t i = 0; i < c->num_rules; i++) {
+            for (uint32_t j = 0; j < old->num_rules; j++) {
+                if (old->rules[j].seq == c->rules[i].seq) {
+                    atomic_store_explicit(&c->rules[i].hits,
+                            atomic_load_explicit(&old->rules[j].hits, memory_order_relaxed), memory_order_relaxed);
+                    break;
+                }
+            }
+        }
+        atomic_store_explicit(&c->no_match,
+                atomic_load_explicit(&old->no_match, memory_order_relaxed), memory_order_relaxed);
+    }
+
+    atomic_store_explicit(&rs->compiled, c, memory_order_release);
+    if (old)
+        rcu_free(MTYPE_HH_RULES_COMPILED, old, rcu);
+}
+
+/* periodically re-sync the prefix-lists that rules refer to */
+static void hh_rules_plist_sync(struct event *ev)
+{
+    for (uint32_t id = 0; id < HH_RULESET_MAX; id++) {
+        struct hh_ruleset *rs = &rulesets[id];
+        struct hh_rules_compiled *c = hh_rules_compile(rs);
+        if (hh_rules_compiled_equal(c, atomic_load_explicit(&rs->compiled, memory_order_relaxed))) {
+            if (c)
+                XFREE(MTYPE_HH_RULES_COMPILED, c);
+            continue;
+        }
+        zlog_info("Prefix-lists used by %s rules changed: recompiling", rs->name);
+        hh_rules_publish(rs, c);
+    }
+    if (hh_rules_use_plist())
+        event_add_timer(main_master, hh_rules_plist_sync, NULL, HH_RULES_PLIST_SYNC_SEC, &ev_plist_sync);
+}
+
+/* recompile a rule set after a configuration change */
+static void hh_rules_update(struct hh_ruleset *rs)
+{
+    hh_rules_publish(rs, hh_rules_compile(rs));
+
+    if (hh_rules_use_plist()) {
+        if (main_master && !ev_plist_sync)
+            event_add_timer(main_master, hh_rules_plist_sync, NULL, HH_RULES_PLIST_SYNC_SEC, &ev_plist_sync);
+    } else {
+        EVENT_OFF(ev_plist_sync);
+    }
+}
+
+/* add / replace a rule */
+int hh_rule_set(enum hh_ruleset_id id, const struct hh_rule_cfg *cfg)
+{
+    BUG(id >= HH_RULESET_MAX || !cfg, -1);
+    struct hh_ruleset *rs = &rulesets[id];
+    uint32_t i;
+
+    if (cfg->ge > cfg->le || cfg->le > 128)
+        return -1;
+
+    for (i = 0; i < rs->num_rules && rs->rules[i].seq < cfg->seq; i++)
+        ;
+    if (i == rs->num_rules || rs->rules[i].seq != cfg->seq) {
+        rs->rules = XREALLOC(MTYPE_HH_RULES, rs->rules, (rs->num_rules + 1) * sizeof(*rs->rules));
+        memmove(&rs->rules[i + 1], &rs->rules[i], (rs->num_rules - i) * sizeof(*rs->rules));
+        rs->num_rules++;
+    }
+    rs->rules[i] = *cfg;
+    hh_rules_update(rs);
+    return 0;
+}
+
+/* remove a rule */
+int hh_rule_unset(enum hh_ruleset_id id, uint32_t seq)
+{
+    BUG(id >= HH_RULESET_MAX, -1);
+    struct hh_ruleset *rs = &rulesets[id];
+
+    for (uint32_t i = 0; i < rs->num_rules; i++) {
+        if (rs->rules[i].seq == seq) {
+            memmove(&rs->rules[i], &rs->rules[i + 1], (rs->num_rules - i - 1) * sizeof(*rs->rules));
+            rs->num_rules--;
+            hh_rules_update(rs);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void hh_rules_clear_counters(enum hh_ruleset_id id)
+{
+    BUG(id >= HH_RULESET_MAX);
+    struct hh_rules_compiled *c = atomic_load_explicit(&rulesets[id].compiled, memory_order_acquire);
+    if (!c)
+        return;
+    for (uint32_t i = 0; i < c->num_rules; i++)
+        atomic_store_explicit(&c->rules[i].hits, 0, memory_order_relaxed);
+    atomic_store_explicit(&c->no_match, 0, memory_order_relaxed);
+}
+
+/* first-match evaluation of a copied prefix-list, as FRR does */
+static bool hh_plist_match(const struct hh_rules_compiled *c, const struct hh_crule *r, const struct prefix *p)
+{
+    for (uint32_t i = r->plist_first; i < r->plist_first + r->plist_count; i++) {
+        const struct hh_plist_entry *e = &c->plist[i];
+
+        if (!prefix_match(&e->prefix, p))
+            continue;
+        if (!e->le && !e->ge) {
+            if (e->prefix.prefixlen != p->prefixlen)
+                continue;
+        } else {
+            if (e->le && p->prefixlen > e->le)
+                continue;
+            if (e->ge && p->prefixlen < e->ge)
+                continue;
+        }
+        return e->permit;
+    }
+    /* implicit deny. Prefix-lists that do not exist match nothing */
+    return false;
+}
+
+static inline bool hh_rule_match(const struct hh_rules_compiled *c, const struct hh_crule *r,
+                                 const struct hh_rule_match *m)
+{
+    if (r->match_vrf && r->vrfid != m->vrfid)
+        return false;
+    if (r->match_table && r->tableid != m->tableid)
+        return false;
+
+    uint32_t len = m->prefix->prefixlen;
+    if (len > 128 || !(r->plen[len >> 6] & (1ULL << (len & 63))))
+        return false;
+
+    if (r->has_plist && !hh_plist_match(c, r, m->prefix))
+        return false;
+    return true;
+}
+
+/* evaluate a rule set for a route */
+uint8_t hh_rules_eval(enum hh_ruleset_id id, const struct hh_rule_match *m)
+{
+    BUG(id >= HH_RULESET_MAX || !m, HH_RULE_NONE);
+
+    struct hh_rules_compiled *c = atomic_load_explicit(&rulesets[id].compiled, memory_order_acquire);
+    if (!c || m->rtype >= HH_RTYPE_MAX)
+        return HH_RULE_NONE;
+
+    const uint32_t *index = &c->index[c->type_first[m->rtype]];
+    for (uint32_t i = 0; i < c->type_count[m->rtype]; i++) {
+        struct hh_crule *r = &c->rules[index[i]];
+        if (hh_rule_match(c, r, m)) {
+            atomic_fetch_add_explicit(&r->hits, 1, memory_order_relaxed);
+            return r->action;
+        }
+    }
+    atomic_fetch_add_explicit(&c->no_match, 1, memory_order_relaxed);
+    return HH_RULE_NONE;
+}
+
+static inline void hh_rule_match_ctx(struct hh_rule_match *m, const struct zebra_dplane_ctx *ctx)
+{
+    m->vrfid = dplane_ctx_get_vrf(ctx);
+    m->tableid = dplane_ctx_get_table(ctx);
+    m->rtype = encode_route_type(dplane_ctx_get_type(ctx));
+    m->prefix = dplane_ctx_get_dest(ctx);
+}
+
+/* tell if a route context passes the operator-configured filters */
+bool hh_filter_permit(const struct zebra_dplane_ctx *ctx)
+{
+    struct hh_rule_match m;
+    hh_rule_match_ctx(&m, ctx);
+    return hh_rules_eval(HH_RULESET_FILTER, &m) != HH_RULE_DENY;
+}
+
+/* tell if a route should not be programmed in the kernel. Routes that match
+ * no kernel rule are only programmed in the kernel if in the default vrf */
+bool hh_kernel_skip(const struct zebra_dplane_ctx *ctx)
+{
+    struct hh_rule_match m;
+    hh_rule_match_ctx(&m, ctx);
+    switch (hh_rules_eval(HH_RULESET_KERNEL, &m)) {
+        case HH_RULE_PERMIT: return false;
+        case HH_RULE_DENY: return true;
+        default: return m.vrfid != 0;
+    }
+}
+
+/* Apply the filter and kernel rules to a route context. Updates and deletions follow what
+ * was decided when the route was installed: a route sent to dataplane and then denied is
+ * removed from it, and the deletion of a route never sent is not sent. A route programmed
+ * in the kernel stays there, updated, until deleted, since a context can not both update
+ * and remove it. Routes with no decision, installed before the plugin loaded, go by the rules */
+bool hh_route_decide(struct zebra_dplane_ctx *ctx, RpcOp *op)
+{
+    BUG(!ctx || !op, false);
+    const struct prefix *p = dplane_ctx_get_dest(ctx);
+    struct hh_route_decision tmp = {0}, *d;
+
+    tmp.vrfid = dplane_ctx_get_vrf(ctx);
+    tmp.tableid = dplane_ctx_get_table(ctx);
+    tmp.family = p->family;
+    tmp.len = p->prefixlen;
+    memcpy(tmp.addr, &p->u.prefix, p->family == AF_INET ? 4 : 16);
+    d = hh_route_tree_find(&routes.tree, &tmp);
+
+    bool sent = d ? (d->flags & HH_ROUTE_F_SENT) : false;
+    bool kernel = d ? (d->flags & HH_ROUTE_F_KERNEL) : false;
+
+    if (dplane_ctx_get_op(ctx) == DPLANE_OP_ROUTE_DELETE) {
+        if (d) {
+            routes.num_sent -= sent;
+            routes.num_kernel -= kernel;
+            hh_route_tree_del(&routes.tree, d);
+            XFREE(MTYPE_HH_ROUTE_DECISION, d);
+        } else {
+            sent = hh_filter_permit(ctx);
+            kernel = !hh_kernel_skip(ctx);
+        }
+        if (!kernel)
+            dplane_ctx_set_skip_kernel(ctx);
+        *op = Del;
+        return sent;
+    }
+
+    bool permit = hh_filter_permit(ctx);
+    bool install = kernel || !hh_kernel_skip(ctx);
+
+    if (!d) {
+        d = XCALLOC(MTYPE_HH_ROUTE_DECISION, sizeof(*d));
+        *d = tmp;
+        hh_route_tree_add(&routes.tree, d);
+    }
+    routes.num_sent = routes.num_sent - sent + permit;
+    routes.num_kernel = routes.num_kernel - kernel + install;
+    d->flags = (permit ? HH_ROUTE_F_SENT : 0) | (install ? HH_ROUTE_F_KERNEL : 0);
+
+    if (!install)
+        dplane_ctx_set_skip_kernel(ctx);
+    if (!permit) {
+        *op = Del;
+        return sent;
+    }
+    *op = (sent && dplane_ctx_get_op(ctx) == DPLANE_OP_ROUTE_UPDATE) ? Update : Add;
+    return true;
+}
+
+/* vty: a rule, in configuration syntax */
+static void hh_vty_rule_cfg(struct vty *vty, const struct hh_ruleset *rs, const struct hh_rule_cfg *cfg)
+{
+    vty_out(vty, "hedgehog %s %u %s", rs->name, cfg->seq, rs->action_str[cfg->action]);
+    if (cfg->match_vrf)
+        vty_out(vty, " vrf %u", cfg->vrfid);
+    if (cfg->match_table)
+        vty_out(vty, " table %u", cfg->tableid);
+    for (uint32_t t = 0; t < HH_RTYPE_MAX; t++) {
+        if (cfg->rtypes & (1u << t))
+            vty_out(vty, " type %s", hh_rtype_str(t));
+    }
+    if (cfg->ge)
+        vty_out(vty, " ge %u", cfg->ge);
+    if (cfg->le != 128)
+        vty_out(vty, " le %u", cfg->le);
+    if (cfg->plist[0])
+        vty_out(vty, " prefix-list %s", cfg->plist);
+}
+
+/* vty: write the rules of a rule set to the running config. Returns the lines written */
+int hh_rules_config_write(struct vty *vty, enum hh_ruleset_id id)
+{
+    BUG(!vty || id >= HH_RULESET_MAX, 0);
+    struct hh_ruleset *rs = &rulesets[id];
+
+    for (uint32_t i = 0; i < rs->num_rules; i++) {
+        hh_vty_rule_cfg(vty, rs, &rs->rules[i]);
+        vty_out(vty, "\n");
+    }
+    return rs->num_rules;
+}
+
+/* vty: show rules, in configuration syntax, with their hit counters */
+void hh_vty_show_rules(struct vty *vty, enum hh_ruleset_id id)
+{
+    BUG(!vty || id >= HH_RULESET_MAX);
+    struct hh_ruleset *rs = &rulesets[id];
+    struct hh_rules_compiled *c = atomic_load_explicit(&rs->compiled, memory_order_acquire);
+
+    vty_out(vty, " Hedgehog %s rules: %u\n", rs->name, rs->num_rules);
+    for (uint32_t i = 0; i < rs->num_rules; i++) {
+        const struct hh_rule_cfg *cfg = &rs->rules[i];
+        uint64_t hits = 0;
+
+        if (c && i < c->num_rules && c->rules[i].seq == cfg->seq)
+            hits = atomic_load_explicit(&c->rules[i].hits, memory_order_relaxed);
+
+        vty_out(vty, "  ");
+        hh_vty_rule_cfg(vty, rs, cfg);
+        vty_out(vty, "   (%"PRIu64" hits)\n", hits);
+    }
+    if (c)
+        vty_out(vty, "  no rule matched: %"PRIu64"\n", atomic_load_explicit(&c->no_match, memory_order_relaxed));
+    if (id == HH_RULESET_FILTER)
+        vty_out(vty, "  routes sent to dataplane: %zu\n", routes.num_sent);
+    else
+        vty_out(vty, "  routes programmed in the kernel: %zu\n", routes.num_kernel);
+}
+struct json_object *hh_json_rules(enum hh_ruleset_id id)
+{
+    BUG(id >= HH_RULESET_MAX, NULL);
+    struct hh_ruleset *rs = &rulesets[id];
+    struct hh_rules_compiled *c = atomic_load_explicit(&rs->compiled, memory_order_acquire);
+    struct json_object *json = hh_json_new();
+    struct json_object *jrules = json_object_new_array();
+
+    for (uint32_t i = 0; i < rs->num_rules; i++) {
+        const struct hh_rule_cfg *cfg = &rs->rules[i];
+        struct json_object *jr = json_object_new_object();
+        uint64_t hits = 0;
+
+        if (c && i < c->num_rules && c->rules[i].seq == cfg->seq)
+            hits = atomic_load_explicit(&c->rules[i].hits, memory_order_relaxed);
+
+        json_object_int_add(jr, "seq", cfg->seq);
+        json_object_string_add(jr, "action", rs->action_str[cfg->action]);
+        if (cfg->match_vrf)
+            json_object_int_add(jr, "vrf", cfg->vrfid);
+        if (cfg->match_table)
+            json_object_int_add(jr, "table", cfg->tableid);
+        if (cfg->rtypes) {
+            struct json_object *jtypes = json_object_new_array();
+            for (uint32_t t = 0; t < HH_RTYPE_MAX; t++) {
+                if (cfg->rtypes & (1u << t))
+                    json_object_array_add(jtypes, json_object_new_string(hh_rtype_str(t)));
+            }
+            json_object_object_add(jr, "types", jtypes);
+        }
+        json_object_int_add(jr, "ge", cfg->ge);
+        json_object_int_add(jr, "le", cfg->le);
+        if (cfg->plist[0])
+            json_object_string_add(jr, "prefixList", cfg->plist);
+        json_object_int_add(jr, "hits", hits);
+        json_object_array_add(jrules, jr);
+    }
+    json_object_object_add(json, "rules", jrules);
+    json_object_int_add(json, "noMatch", c ? atomic_load_explicit(&c->no_match, memory_order_relaxed) : 0);
+    json_object_int_add(json, "routes", id == HH_RULESET_FILTER ? routes.num_sent : routes.num_kernel);
+    return json;
+}
+
+void init_hh_rules(struct event_loop *master)
+{
+    main_master = master;
+    hh_route_tree_init(&routes.tree);
+}
+
+/* finalize rule sets. Called from the main thread */
+void fini_hh_rules(void)
+{
+    EVENT_OFF(ev_plist_sync);
+    for (uint32_t id = 0; id < HH_RULESET_MAX; id++) {
+        struct hh_ruleset *rs = &rulesets[id];
+        hh_rules_publish(rs, NULL);
+        if (rs->rules)
+            XFREE(MTYPE_HH_RULES, rs->rules);
+        rs->num_rules = 0;
+    }
+}
+
+/* drop the decisions recorded for routes. Called from the dplane pthread */
+void fini_hh_route_decisions(void)
+{
+    struct hh_route_decision *d;
+
+    while ((d = hh_route_tree_pop(&routes.tree)) != NULL)
+        XFREE(MTYPE_HH_ROUTE_DECISION, d);
+    hh_route_tree_fini(&routes.tree);
+    routes.num_sent = routes.num_kernel = 0;
+}
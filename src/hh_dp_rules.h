@@ -0,0 +1,85 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef SRC_HH_DP_RULES_H_
+#define SRC_HH_DP_RULES_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <dplane-rpc/dplane-rpc.h> /* RouteType, VrfId */
+#include "lib/prefix.h"
+#include "lib/vty.h"
+#include "lib/json.h"
+#include "zebra/zebra_dplane.h"
+
+/* Rule sets. Each rule set is an ordered list of rules matching routes; the first
+ * rule that matches a route determines the action for it */
+enum hh_ruleset_id {
+    HH_RULESET_FILTER = 0,  /* routes sent to dataplane */
+    HH_RULESET_KERNEL,      /* routes programmed in the kernel (permit) or not (deny) */
+    HH_RULESET_MAX
+};
+
+/* rule actions. HH_RULE_NONE means that no rule matched */
+#define HH_RULE_NONE   0
+#define HH_RULE_PERMIT 1
+#define HH_RULE_DENY   2
+
+#define HH_RTYPE_MAX 32       /* RouteType values must be below this */
+#define HH_PLIST_NAME_MAX 64
+
+/* configuration of a rule */
+struct hh_rule_cfg {
+    uint32_t seq;
+    uint8_t action;
+    bool match_vrf;
+    VrfId vrfid;
+    bool match_table;
+    uint32_t tableid;
+    uint32_t rtypes;                 /* mask of (1 << RouteType); 0 matches any */
+    uint8_t ge;                      /* prefix-length range */
+    uint8_t le;
+    char plist[HH_PLIST_NAME_MAX];   /* prefix-list name; empty if none */
+};
+
+/* route attributes that rules match on */
+struct hh_rule_match {
+    VrfId vrfid;
+    uint32_t tableid;
+    RouteType rtype;
+    const struct prefix *prefix;
+};
+
+/* initialize / finalize rule sets. Configuration happens in the main thread */
+void init_hh_rules(struct event_loop *master);
+void fini_hh_rules(void);
+
+/* add / replace or remove a rule. These should only be called from the main thread */
+int hh_rule_set(enum hh_ruleset_id id, const struct hh_rule_cfg *cfg);
+int hh_rule_unset(enum hh_ruleset_id id, uint32_t seq);
+void hh_rules_clear_counters(enum hh_ruleset_id id);
+
+/* evaluate a rule set for a route. Lock-free; may be called from any thread */
+uint8_t hh_rules_eval(enum hh_ruleset_id id, const struct hh_rule_match *m);
+
+/* tell if a route context passes the operator-configured filters */
+bool hh_filter_permit(const struct zebra_dplane_ctx *ctx);
+
+/* tell if a route context should skip kernel programming */
+bool hh_kernel_skip(const struct zebra_dplane_ctx *ctx);
+
+/* Decide where a route context goes, from the rules or, for updates and deletions, from
+ * what was decided when the route was installed. Sets skip-kernel on the context if needed.
+ * Returns true if a request is to be sent to dataplane, with *op. Dplane pthread only */
+bool hh_route_decide(struct zebra_dplane_ctx *ctx, RpcOp *op);
+void fini_hh_route_decisions(void);
+
+/* route type names, as used in vty */
+int hh_rtype_from_str(const char *name);
+const char *hh_rtype_str(RouteType rtype);
+
+/* vty: show rules, write them to the running config */
+void hh_vty_show_rules(struct vty *vty, enum hh_ruleset_id id);
+int hh_rules_config_write(struct vty *vty, enum hh_ruleset_id id);
+struct json_object *hh_json_rules(enum hh_ruleset_id id);
+
+#endif /* SRC_HH_DP_RULES_H_ */
@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "config.h" /* FRR config.h */
+#include "lib/zebra.h"
+#include "lib/libfrr.h"
+#include "zebra/zebra_dplane.h" /* dplane_get_thread_master */
+
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "hh_dp_internal.h"
+#include "hh_dp_rpc_stats.h"
+#include "hh_dp_msg_cache.h"
+#include "hh_dp_stats_shm.h"
+#include "hh_dp_shm.h"
+
+/* counters are published every DP_SHM_PERIOD_MSEC. Latency summaries take longer to compute
+ * and are refreshed every DP_SHM_LAT_EVERY updates */
+#define DP_SHM_PERIOD_MSEC 100
+#define DP_SHM_LAT_EVERY 10
+
+static struct dp_stats_shm {
+    char path[PATH_MAX];
+    int fd;
+    struct hh_stats_shm *page;
+    struct hh_stats_shm stage;   /* built here, then copied to the page under the seqlock */
+    struct event *ev_publish;
+} shm = {
+    .path = HH_STATS_SHM_DFLT_PATH,
+    .fd = -1,
+};
+
+/* set the path of the page */
+int dp_stats_shm_set_path(const char *path)
+{
+    BUG(!path, -1);
+    if (strlen(path) >= sizeof(shm.path)) {
+        zlog_err("Invalid stats page path %s: too long", path);
+        return -1;
+    }
+    strlcpy(shm.path, path, sizeof(shm.path));
+    zlog_debug("Configured stats page path to '%s'", shm.path[0] ? shm.path : "(disabled)");
+    return 0;
+}
+
+/* copy the stage to the page. Readers retry while seq is odd or changes */
+static void dp_stats_shm_commit(void)
+{
+    uint64_t seq = atomic_load_explicit(&shm.page->seq, memory_order_relaxed);
+
+    atomic_store_explicit(&shm.page->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy((char *)shm.page + offsetof(struct hh_stats_shm, ts_usec),
+           (char *)&shm.stage + offsetof(struct hh_stats_shm, ts_usec),
+           sizeof(struct hh_stats_shm) - offsetof(struct hh_stats_shm, ts_usec));
+    atomic_store_explicit(&shm.page->seq, seq + 2, memory_order_release);
+}
+
+static void dp_stats_shm_publish(struct event *ev)
+{
+    struct hh_stats_shm *s = &shm.stage;
+
+    event_add_timer_msec(dplane_get_thread_master(), dp_stats_shm_publish, NULL, DP_SHM_PERIOD_MSEC,
+            &shm.ev_publish);
+
+    rpc_stats_shm_fill(s, s->updates % DP_SHM_LAT_EVERY == 0);
+    dp_msg_cache_shm_fill(s);
+    s->ts_usec = hh_monotime_us();
+    s->updates++;
+    dp_stats_shm_commit();
+}
+
+/* create the page. A page left by a prior run is unlinked rather than truncated, so that
+ * readers still mapping it do not fault */
+int init_dp_stats_shm(void)
+{
+    if (!shm.path[0]) {
+        zlog_info("Stats page in shared memory is disabled");
+        return 0;
+    }
+
+    if (unlink(shm.path) < 0 && errno != ENOENT)
+        zlog_warn("Failed to remove stale stats page '%s': %s", shm.path, strerror(errno));
+    shm.fd = open(shm.path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (shm.fd < 0) {
+        zlog_err("Failed to create stats page '%s': %s", shm.path, strerror(errno));
+        return -1;
+    }
+    if (ftruncate(shm.fd, sizeof(struct hh_stats_shm)) < 0) {
+        zlog_err("Failed to size stats page '%s': %s", shm.path, strerror(errno));
+        goto fail;
+    }
+    void *addr = mmap(NULL, sizeof(struct hh_stats_shm), PROT_READ | PROT_WRITE, MAP_SHARED, shm.fd, 0);
+    if (addr == MAP_FAILED) {
+        zlog_err("Failed to map stats page '%s': %s", shm.path, strerror(errno));
+        goto fail;
+    }
+    shm.page = addr;
+
+    memset(&shm.stage, 0, sizeof(shm.stage));
+    shm.stage.magic = HH_STATS_SHM_MAGIC;
+    shm.stage.version = HH_STATS_SHM_VERSION;
+    shm.stage.size = sizeof(struct hh_stats_shm);
+    shm.stage.pid = getpid();
+    shm.stage.num_otypes = MaxObjType;
+    shm.stage.num_ops = MaxRpcOp;
+    shm.stage.num_rescodes = RpcResultCodeMax;
+    memcpy(shm.page, &shm.stage, offsetof(struct hh_stats_shm, seq));
+
+    zlog_info("Publishing stats in shared memory at '%s' every %u ms", shm.path, DP_SHM_PERIOD_MSEC);
+    dp_stats_shm_publish(NULL);
+    return 0;
+
+fail:
+    close(shm.fd);
+    shm.fd = -1;
+    unlink(shm.path);
+    return -1;
+}
+
+/* remove the page. Readers that mapped it keep the last values published */
+void fini_dp_stats_shm(void)
+{
+    EVENT_OFF(shm.ev_publish);
+    if (shm.page) {
+        munmap(shm.page, sizeof(struct hh_stats_shm));
+        shm.page = NULL;
+    }
+    if (shm.fd >= 0) {
+        close(shm.fd);
+        shm.fd = -1;
+        unlink(shm.path);
+    }
+}
@@ -0,0 +1,17 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef SRC_HH_DP_SHM_H_
+#define SRC_HH_DP_SHM_H_
+
+/* Stats page in shared memory: the RPC counters, queue gauges and latency summaries are
+ * published periodically in a file that local collectors map read-only. See the layout
+ * in hh_dp_stats_shm.h */
+
+/* set the path of the page. An empty path disables it */
+int dp_stats_shm_set_path(const char *path);
+
+/* create / remove the page. Publishing runs in the dplane pthread */
+int init_dp_stats_shm(void);
+void fini_dp_stats_shm(void);
+
+#endif /* SRC_HH_DP_SHM_H_ */
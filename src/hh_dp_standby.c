@@ -0,0 +1,768 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "config.h" /* FRR config.h */
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "lib/zebra.h"
+#include "lib/libfrr.h"
+#include "zebra/zebra_dplane.h" /* dplane_get_thread_master() */
+#include <dplane-rpc/dplane-rpc.h> /* HH's rpc dataplane library */
+
+#include "hh_dp_internal.h"
+#include "hh_dp_comm.h"
+#include "hh_dp_msg.h"
+#include "hh_dp_msg_cache.h"
+#include "hh_dp_state.h"
+#include "hh_dp_standby.h"
+
+DEFINE_MTYPE_STATIC(ZEBRA, HH_DP_STANDBY, "HH Dataplane standby");
+
+#define DP_STANDBY_CONNECT_SEC 5
+#define DP_STANDBY_KEEPALIVE_SEC 5
+#define DP_STANDBY_RX_BATCH 256         /* max messages received per read event */
+#define DP_STANDBY_SYNC_BATCH 256       /* max objects synced per event loop run */
+#define DP_STANDBY_SYNC_HIWAT 1024      /* sync stalls if the unsent queue grows beyond this */
+#define DP_STANDBY_SYNC_RETRY_MSEC 10
+#define DP_STANDBY_MAX_QUEUED 65536     /* beyond this, the standby is resynced */
+#define DP_STANDBY_MAX_UNCONFIRMED 4096 /* requests not confirmed Ok tracked one by one */
+#define DP_STANDBY_SUFFIX ".standby"
+#define NO_SOCK -1
+
+static struct dp_standby {
+    char local_path[MAX_SUN_PATH + 1];
+    char remote_path[MAX_SUN_PATH + 1];
+    int sock;
+    bool connected;
+    bool ready;                 /* Connect acked */
+    uint64_t synt;              /* synt of the standby dataplane; 0 if it must be synced */
+    uint64_t seqnum;            /* seqn of the next request */
+    uint64_t last_acked;        /* seqn of the last request answered */
+    uint64_t pseqn_acked;       /* gseqn (on the primary) of the last request mirrored and answered */
+    uint64_t pseqn_mirrored;    /* gseqn (on the primary) of the last request mirrored */
+    uint64_t pseqn_lost;        /* requests up to this gseqn may not have reached the standby */
+    uint64_t *unconfirmed;      /* sorted gseqns of requests answered, but not confirmed Ok */
+    size_t num_unconfirmed;
+    size_t cap_unconfirmed;
+    uint64_t last_tx;
+    buff_t *tx_buff;
+    buff_t *rx_buff;
+    struct dp_msg_list_head unsent;
+    struct dp_msg_list_head in_flight;
+    struct dp_msg_list_head held;   /* requests mirrored during a sync, sent when it completes */
+    struct event *ev_connect;
+    struct event *ev_recv;
+    struct event *ev_send;
+    struct event *ev_keepalive;
+    struct event *ev_sync;
+
+    /* full sync from the state snapshot */
+    bool syncing;
+    bool synced;
+    bool sync_started;              /* sync_cursor is set */
+    struct RpcObject sync_cursor;
+    uint64_t sync_objects;
+
+    /* stats */
+    uint64_t tx;
+    uint64_t tx_failures;
+    uint64_t rx;
+    uint64_t acks;
+    uint64_t implicit_acks;
+    uint64_t failures;
+    uint64_t syncs;
+    uint64_t synced_objects;
+    uint64_t overflows;
+    uint64_t takeovers;
+} standby = {
+    .sock = NO_SOCK,
+    .seqnum = 1,
+};
+
+static void dp_standby_connect(struct event *ev);
+static void dp_standby_send_pending(void);
+
+/* set the path of the standby dataplane socket */
+int dp_standby_set_path(const char *path)
+{
+    BUG(!path, -1);
+    if (path[0] && !is_valid_unix_path(path))
+        return -1;
+    strlcpy(standby.remote_path, path, sizeof(standby.remote_path));
+    zlog_debug("Configured standby dp remote sock path to '%s'", path);
+    return 0;
+}
+
+static inline size_t dp_standby_queued(void)
+{
+    return dp_msg_list_count(&standby.unsent) + dp_msg_list_count(&standby.held);
+}
+
+/* drain a list. Returns the highest gseqn of the requests mirrored in it */
+static uint64_t dp_standby_list_drain(struct dp_msg_list_head *list)
+{
+    struct dp_msg *m;
+    uint64_t pseqn = 0;
+
+    while ((m = dp_msg_list_pop(list)) != NULL) {
+        pseqn = MAX(pseqn, m->pseqn);
+        dp_msg_recycle(m);
+    }
+    return pseqn;
+}
+
+/* lowest gseqn of the requests pending on the primary */
+static void dp_standby_min_pending(struct dp_msg *m, void *arg)
+{
+    uint64_t *min = arg;
+    if (m->msg.type == Request && m->gseqn && m->gseqn < *min)
+        *min = m->gseqn;
+}
+
+/* Track a mirrored request that the standby answered without confirming it Ok: it failed it,
+ * or its response was skipped or lost. Only requests still pending on the primary matter on
+ * failover, so older ones are pruned when the set fills up. If it is still full, the set is
+ * folded into pseqn_lost: the requests up to it are then all considered unconfirmed */
+static void dp_standby_unconfirmed_add(uint64_t pseqn)
+{
+    if (!pseqn || pseqn <= standby.pseqn_lost)
+        return;
+
+    if (standby.num_unconfirmed == DP_STANDBY_MAX_UNCONFIRMED) {
+        uint64_t min = UINT64_MAX;
+        size_t n = 0;
+
+        dp_msg_pending_walk(dp_standby_min_pending, &min);
+        for (size_t i = 0; i < standby.num_unconfirmed; i++) {
+            if (standby.unconfirmed[i] >= min)
+                standby.unconfirmed[n++] = standby.unconfirmed[i];
+        }
+        standby.num_unconfirmed = n;
+        if (n == DP_STANDBY_MAX_UNCONFIRMED) {
+            standby.pseqn_lost = MAX(pseqn, standby.unconfirmed[n - 1]);
+            standby.num_unconfirmed = 0;
+            return;
+        }
+    }
+    if (standby.num_unconfirmed == standby.cap_unconfirmed) {
+        standby.cap_unconfirmed = standby.cap_unconfirmed ? standby.cap_unconfirmed * 2 : 64;
+        standby.unconfirmed = XREALLOC(MTYPE_HH_DP_STANDBY, standby.unconfirmed,
+                standby.cap_unconfirmed * sizeof(*standby.unconfirmed));
+    }
+
+    /* responses mostly come in the order requests were mirrored: look up from the tail */
+    size_t i = standby.num_unconfirmed;
+    while (i && standby.unconfirmed[i - 1] > pseqn)
+        i--;
+    if (i && standby.unconfirmed[i - 1] == pseqn)
+        return;
+    memmove(&standby.unconfirmed[i + 1], &standby.unconfirmed[i],
+            (standby.num_unconfirmed - i) * sizeof(*standby.unconfirmed));
+    standby.unconfirmed[i] = pseqn;
+    standby.num_unconfirmed++;
+}
+
+static struct dp_msg *dp_standby_request_new(RpcOp op)
+{
+    struct dp_msg *m = dp_msg_new();
+    m->msg.type = Request;
+    m->msg.request.op = op;
+    m->msg.request.seqn = standby.seqnum++;
+    return m;
+}
+
+/* (re)open the socket and schedule a connection attempt */
+static void dp_standby_reset_sock(uint32_t delay_sec)
+{
+    EVENT_OFF(standby.ev_send);
+    EVENT_OFF(standby.ev_recv);
+    EVENT_OFF(standby.ev_sync);
+    EVENT_OFF(standby.ev_connect);
+    if (standby.sock != NO_SOCK)
+        close(standby.sock);
+    standby.connected = false;
+    standby.ready = false;
+
+    standby.sock = dp_unix_sock_open(standby.local_path);
+    if (standby.sock == NO_SOCK) {
+        zlog_err("Could not create socket to standby dataplane");
+        return;
+    }
+    event_add_timer(dplane_get_thread_master(), dp_standby_connect, NULL, delay_sec, &standby.ev_connect);
+}
+
+/* tx */
+static void dp_standby_send_cb(struct event *ev)
+{
+    dp_standby_send_pending();
+}
+
+/* send a message. Returns 0 if sent, -1 if it should be retried and 1 if it can't be sent */
+static int dp_standby_send_msg(struct RpcMsg *msg)
+{
+    buff_clear(standby.tx_buff);
+    int r = encode_msg(standby.tx_buff, msg);
+    if (r != E_OK) {
+        zlog_err("Failed to encode msg for standby dataplane: %s", err2str(r));
+        return 1;
+    }
+    if (send(standby.sock, standby.tx_buff->storage, standby.tx_buff->w, MSG_DONTWAIT) < 0) {
+        int _err = errno;
+        switch (_err) {
+            case EAGAIN:
+            case ENOBUFS:
+            case ENOMEM:
+                event_add_write(dplane_get_thread_master(), dp_standby_send_cb, NULL, standby.sock, &standby.ev_send);
+                return -1;
+            case EINTR:
+                return -1;
+            default:
+                standby.tx_failures++;
+                zlog_err("Error sending msg to standby dataplane: %s(%d)", strerror(_err), _err);
+                dp_standby_reset_sock(DP_STANDBY_CONNECT_SEC);
+                return -1;
+        }
+    }
+    standby.tx++;
+    standby.last_tx = hh_monotime_us();
+    return 0;
+}
+
+static void dp_standby_send_pending(void)
+{
+    struct dp_msg *m;
+
+    if (!standby.ready || standby.ev_send)
+        return;
+
+    while ((m = dp_msg_list_pop(&standby.unsent)) != NULL) {
+        int r = dp_standby_send_msg(&m->msg);
+        if (r < 0) {
+            dp_msg_list_add_head(&standby.unsent, m);
+            return;
+        }
+        if (r == 0 && m->msg.type == Request)
+            dp_msg_list_add_tail(&standby.in_flight, m);
+        else
+            dp_msg_recycle(m);
+    }
+}
+
+static void dp_standby_queue(struct dp_msg *m)
+{
+    dp_msg_list_add_tail(&standby.unsent, m);
+    dp_standby_send_pending();
+}
+
+/* sync */
+static void dp_standby_sync_obj(const struct RpcObject *object, void *arg)
+{
+    struct dp_msg *m = dp_standby_request_new(Add);
+    m->msg.request.object = *object;
+    dp_msg_list_add_tail(&standby.unsent, m);
+    standby.sync_objects++;
+}
+
+static void dp_standby_sync_run(struct event *ev)
+{
+    struct event_loop *ev_loop = dplane_get_thread_master();
+    struct dp_msg *m;
+
+    if (!standby.syncing || !standby.ready)
+        return;
+
+    if (dp_msg_list_count(&standby.unsent) >= DP_STANDBY_SYNC_HIWAT) {
+        dp_standby_send_pending();
+        event_add_timer_msec(ev_loop, dp_standby_sync_run, NULL, DP_STANDBY_SYNC_RETRY_MSEC, &standby.ev_sync);
+        return;
+    }
+
+    bool done = dp_state_walk_from(&standby.sync_cursor, &standby.sync_started, DP_STANDBY_SYNC_BATCH,
+            dp_standby_sync_obj, NULL);
+    if (!done) {
+        dp_standby_send_pending();
+        event_add_event(ev_loop, dp_standby_sync_run, NULL, 0, &standby.ev_sync);
+        return;
+    }
+
+    /* the requests held come after the objects synced, which they may modify */
+    while ((m = dp_msg_list_pop(&standby.held)) != NULL) {
+        m->msg.request.seqn = standby.seqnum++;
+        dp_msg_list_add_tail(&standby.unsent, m);
+    }
+
+    standby.syncing = false;
+    standby.synced = true;
+    standby.synced_objects += standby.sync_objects;
+    zlog_info("Standby dataplane synced: %"PRIu64" objects", standby.sync_objects);
+    dp_standby_send_pending();
+}
+
+/* Start a full sync of the standby from the snapshot. Requests not yet answered by the
+ * primary may not be reflected in the snapshot: they are held and resent after the sync.
+ * If the standby restarted (fresh), the requests in flight will not be answered */
+static void dp_standby_sync_start(bool fresh)
+{
+    struct dp_msg_list_head list;
+    struct dp_msg *m;
+
+    dp_msg_list_init(&list);
+
+    /* requests in flight, then unsent, then held, keep the order in which they were mirrored */
+    if (fresh) {
+        while ((m = dp_msg_list_pop(&standby.in_flight)) != NULL) {
+            if (m->pseqn)
+                dp_msg_list_add_tail(&list, m);
+            else
+                dp_msg_recycle(m);
+        }
+    } else {
+        frr_each(dp_msg_list, &standby.in_flight, m) {
+            if (m->pseqn) {
+                struct dp_msg *c = dp_msg_new();
+                c->msg = m->msg;
+                c->pseqn = m->pseqn;
+                dp_msg_list_add_tail(&list, c);
+            }
+        }
+    }
+    while ((m = dp_msg_list_pop(&standby.unsent)) != NULL) {
+        if (m->pseqn)
+            dp_msg_list_add_tail(&list, m);
+        else
+            dp_msg_recycle(m);
+    }
+    while ((m = dp_msg_list_pop(&standby.held)) != NULL)
+        dp_msg_list_add_tail(&list, m);
+    while ((m = dp_msg_list_pop(&list)) != NULL)
+        dp_msg_list_add_tail(&standby.held, m);
+    dp_msg_list_fini(&list);
+
+    zlog_info("Syncing standby dataplane (%zu requests held)...", dp_msg_list_count(&standby.held));
+    standby.syncing = true;
+    standby.synced = false;
+    standby.sync_started = false;
+    standby.sync_objects = 0;
+    standby.syncs++;
+    EVENT_OFF(standby.ev_sync);
+    event_add_event(dplane_get_thread_master(), dp_standby_sync_run, NULL, 0, &standby.ev_sync);
+}
+
+/* mirror a request queued for the primary dataplane. Requests are mirrored in the order
+ * they were issued across the shards of the primary (gseqn) */
+void dp_standby_mirror(const struct dp_msg *dp_msg)
+{
+    BUG(!dp_msg);
+    const struct RpcMsg *msg = &dp_msg->msg;
+
+    if (standby.sock == NO_SOCK || msg->type != Request)
+        return;
+    if (msg->request.op != Add && msg->request.op != Del && msg->request.op != Update)
+        return;
+
+    /* the standby does not keep up: drop what it has pending and sync it again */
+    if (dp_standby_queued() >= DP_STANDBY_MAX_QUEUED) {
+        zlog_warn("Standby dataplane is lagging behind: dropping %zu requests and resyncing", dp_standby_queued());
+        uint64_t lost = MAX(dp_standby_list_drain(&standby.unsent), dp_standby_list_drain(&standby.held));
+        standby.pseqn_lost = MAX(standby.pseqn_lost, lost);
+        standby.overflows++;
+        standby.synced = false;
+        standby.synt = 0;
+        if (standby.ready)
+            dp_standby_sync_start(false);
+    }
+
+    struct dp_msg *m = dp_standby_request_new(msg->request.op);
+    m->msg.request.object = msg->request.object;
+    m->pseqn = dp_msg->gseqn;
+    standby.pseqn_mirrored = m->pseqn;
+
+    if (standby.syncing)
+        dp_msg_list_add_tail(&standby.held, m);
+    else
+        dp_standby_queue(m);
+}
+
+/* rx */
+static void dp_standby_ack(const struct RpcResponse *resp)
+{
+    struct dp_msg *m;
+
+    /* responses come in order: one for a request also acknowledges those before it */
+    while ((m = dp_msg_list_first(&standby.in_flight)) != NULL) {
+        if (m->msg.request.seqn > resp->seqn)
+            break;
+        dp_msg_list_pop(&standby.in_flight);
+
+        if (m->msg.request.seqn < resp->seqn) {
+            standby.implicit_acks++;
+            dp_standby_unconfirmed_add(m->pseqn);
+        } else if (resp->rescode == Ok || resp->rescode == Ignored) {
+            standby.acks++;
+        } else {
+            standby.failures++;
+            dp_standby_unconfirmed_add(m->pseqn);
+            zlog_warn("Standby dataplane failed request #%lu (%s %s): %s", m->msg.request.seqn,
+                    str_rpc_op(m->msg.request.op), str_object_type(m->msg.request.object.type),
+                    str_rescode(resp->rescode));
+        }
+        standby.last_acked = m->msg.request.seqn;
+        if (m->pseqn)
+            standby.pseqn_acked = m->pseqn;
+        dp_msg_recycle(m);
+    }
+}
+
+static void dp_standby_connect_response(const struct RpcResponse *resp)
+{
+    struct dp_msg_list_head resend;
+    struct dp_msg *m;
+
+    if (resp->rescode != Ok) {
+        zlog_err("Standby dataplane refused Connect: %s", str_rescode(resp->rescode));
+        dp_standby_reset_sock(DP_STANDBY_CONNECT_SEC);
+        return;
+    }
+
+    uint64_t synt = resp->objects ? resp->objects->conn_info.synt : 0;
+    bool resume = standby.synt && synt == standby.synt;
+    standby.synt = synt;
+    standby.ready = true;
+
+    if (!resume) {
+        zlog_info("Connected to standby dataplane (synt %"PRIu64")", synt);
+        dp_standby_sync_start(true);
+        return;
+    }
+
+    /* same instance: it processed the requests up to resp->seqn, with results unknown. Resend the rest */
+    dp_msg_list_init(&resend);
+    while ((m = dp_msg_list_pop(&standby.in_flight)) != NULL) {
+        if (m->msg.request.seqn <= resp->seqn) {
+            standby.last_acked = m->msg.request.seqn;
+            if (m->pseqn)
+                standby.pseqn_acked = m->pseqn;
+            dp_standby_unconfirmed_add(m->pseqn);
+            dp_msg_recycle(m);
+        } else {
+            dp_msg_list_add_tail(&resend, m);
+        }
+    }
+    zlog_info("Reconnected to standby dataplane: resending %zu requests", dp_msg_list_count(&resend));
+    while ((m = dp_msg_list_pop(&standby.unsent)) != NULL)
+        dp_msg_list_add_tail(&resend, m);
+    while ((m = dp_msg_list_pop(&resend)) != NULL)
+        dp_msg_list_add_tail(&standby.unsent, m);
+    dp_msg_list_fini(&resend);
+
+    if (standby.syncing)
+        event_add_event(dplane_get_thread_master(), dp_standby_sync_run, NULL, 0, &standby.ev_sync);
+    dp_standby_send_pending();
+}
+
+static void dp_standby_handle_msg(struct RpcMsg *msg)
+{
+    struct dp_msg *m;
+
+    switch (msg->type) {
+        case Response:
+            if (msg->response.op == Connect)
+                dp_standby_connect_response(&msg->response);
+            else
+                dp_standby_ack(&msg->response);
+            break;
+        case Control:
+            if (msg->control.refresh) {
+                zlog_warn("Standby dataplane requested a refresh");
+                dp_standby_sync_start(false);
+                m = dp_msg_new();
+                m->msg.type = Control;
+                m->msg.control.refresh = msg->control.refresh;
+                dp_standby_queue(m);
+            }
+            break;
+        case Request:
+            m = dp_msg_new();
+            m->msg.type = Response;
+            m->msg.response.op = msg->request.op;
+            m->msg.response.seqn = msg->request.seqn;
+            m->msg.response.rescode = Failure;
+            if (msg->request.op == Get) {
+                zlog_warn("Standby dataplane requested a refresh");
+                dp_standby_sync_start(false);
+                m->msg.response.rescode = Ok;
+            }
+            dp_standby_queue(m);
+            break;
+        default:
+            break;
+    }
+}
+
+static void dp_standby_recv(struct event *ev)
+{
+    event_add_read(ev->master, dp_standby_recv, NULL, standby.sock, &standby.ev_recv);
+
+    for (int n = 0; n < DP_STANDBY_RX_BATCH; n++) {
+        buff_clear(standby.rx_buff);
+        int r = recv(standby.sock, standby.rx_buff->storage, standby.rx_buff->capacity, MSG_DONTWAIT);
+        if (r < 0) {
+            if (errno != EAGAIN && errno != EINTR)
+                zlog_err("Error receiving msg from standby dataplane: %s", strerror(errno));
+            break;
+        }
+        standby.rx_buff->w = (index_t)r;
+        standby.rx++;
+
+        struct RpcMsg msg = {0};
+        r = decode_msg(standby.rx_buff, &msg);
+        if (r != E_OK) {
+            zlog_err("Error decoding msg from standby dataplane: %s", err2str(r));
+            break;
+        }
+        dp_standby_handle_msg(&msg);
+        msg_dispose(&msg);
+    }
+}
+
+/* connect and send a Connect request with the synt of the standby, if known */
+static void dp_standby_connect(struct event *ev)
+{
+    struct event_loop *ev_loop = dplane_get_thread_master();
+
+    if (standby.sock == NO_SOCK)
+        return;
+
+    if (dp_unix_sock_connect(standby.sock, standby.remote_path) != 0) {
+        dp_standby_reset_sock(DP_STANDBY_CONNECT_SEC);
+        return;
+    }
+    standby.connected = true;
+
+    struct RpcMsg msg = { .type = Request };
+    msg.request.op = Connect;
+    msg.request.seqn = standby.last_acked;
+    dp_conn_info_object(&msg.request.object, standby.synt);
+    if (dp_standby_send_msg(&msg) != 0) {
+        if (standby.connected)
+            dp_standby_reset_sock(DP_STANDBY_CONNECT_SEC);
+        return;
+    }
+    event_add_read(ev_loop, dp_standby_recv, NULL, standby.sock, &standby.ev_recv);
+}
+
+static void dp_standby_keepalive(struct event *ev)
+{
+    uint64_t interval = DP_STANDBY_KEEPALIVE_SEC * 1000000ULL;
+
+    if (standby.ready && hh_monotime_us() - standby.last_tx >= interval) {
+        struct dp_msg *m = dp_msg_new();
+        m->msg.type = Control;
+        dp_standby_queue(m);
+    }
+    event_add_timer(dplane_get_thread_master(), dp_standby_keepalive, NULL, DP_STANDBY_KEEPALIVE_SEC,
+            &standby.ev_keepalive);
+}
+
+/* tell if the standby confirmed Ok a request mirrored to it */
+bool dp_standby_acks_ok(const struct dp_standby_acks *acks, uint64_t gseqn)
+{
+    BUG(!acks, false);
+    size_t lo = 0, hi = acks->num_unconfirmed;
+
+    if (gseqn > acks->acked || gseqn <= acks->lost)
+        return false;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (acks->unconfirmed[mid] == gseqn)
+            return false;
+        if (acks->unconfirmed[mid] < gseqn)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return true;
+}
+void dp_standby_acks_release(struct dp_standby_acks *acks)
+{
+    BUG(!acks);
+    if (acks->unconfirmed)
+        XFREE(MTYPE_HH_DP_STANDBY, acks->unconfirmed);
+    acks->num_unconfirmed = 0;
+}
+
+/* take over from the primary */
+int dp_standby_takeover(char *primary_path, size_t len, uint64_t *synt, struct dp_standby_acks *acks)
+{
+    BUG(!primary_path || !synt || !acks, -1);
+    char path[MAX_SUN_PATH + 1];
+
+    if (standby.sock == NO_SOCK) {
+        zlog_err("Can't fail over: no standby dataplane");
+        return -1;
+    }
+    if (!standby.ready || !standby.synced || dp_msg_list_count(&standby.held)) {
+        zlog_err("Can't fail over: standby dataplane is not in sync");
+        return -1;
+    }
+    *synt = standby.synt;
+    acks->acked = standby.pseqn_acked;
+    acks->lost = standby.pseqn_lost;
+    acks->unconfirmed = standby.unconfirmed;
+    acks->num_unconfirmed = standby.num_unconfirmed;
+    standby.unconfirmed = NULL;
+    standby.num_unconfirmed = standby.cap_unconfirmed = 0;
+
+    /* the former primary becomes the standby */
+    strlcpy(path, standby.remote_path, sizeof(path));
+    strlcpy(standby.remote_path, primary_path, sizeof(standby.remote_path));
+    strlcpy(primary_path, path, len);
+
+    dp_standby_list_drain(&standby.unsent);
+    dp_standby_list_drain(&standby.in_flight);
+    dp_standby_list_drain(&standby.held);
+    standby.synt = 0;
+    standby.last_acked = 0;
+    standby.pseqn_acked = 0;
+    standby.pseqn_lost = 0;
+    standby.synced = false;
+    standby.syncing = false;
+    standby.takeovers++;
+    dp_standby_reset_sock(0);
+
+    zlog_info("Standby dataplane at '%s' takes over; '%s' becomes the standby", primary_path, standby.remote_path);
+    return 0;
+}
+
+/* vty: show standby status */
+void hh_vty_show_standby(struct vty *vty)
+{
+    BUG(!vty);
+
+    if (standby.sock == NO_SOCK) {
+        vty_out(vty, " Standby dataplane: not configured\n");
+        return;
+    }
+    vty_out(vty, " Standby dataplane: '%s' (local '%s')\n", standby.remote_path, standby.local_path);
+    vty_out(vty, "   connected: %s, ready: %s, synt: %"PRIu64"\n", standby.connected ? "yes" : "no",
+            standby.ready ? "yes" : "no", standby.synt);
+    if (standby.syncing)
+        vty_out(vty, "   sync: in progress, %"PRIu64" objects sent\n", standby.sync_objects);
+    else
+        vty_out(vty, "   sync: %s\n", standby.synced ? "done" : "needed");
+    vty_out(vty, "   queues: unsent %zu, in-flight %zu, held %zu\n", dp_msg_list_count(&standby.unsent),
+            dp_msg_list_count(&standby.in_flight), dp_msg_list_count(&standby.held));
+    vty_out(vty, "   mirrored up to #%"PRIu64", acked up to #%"PRIu64", %zu unconfirmed, lost up to #%"PRIu64"\n",
+            standby.pseqn_mirrored, standby.pseqn_acked, standby.num_unconfirmed, standby.pseqn_lost);
+    vty_out(vty, "   tx: %"PRIu64" (failures: %"PRIu64"), rx: %"PRIu64"\n", standby.tx, standby.tx_failures, standby.rx);
+    vty_out(vty, "   responses: %"PRIu64" ok, %"PRIu64" failed, %"PRIu64" implicit\n", standby.acks,
+            standby.failures, standby.implicit_acks);
+    vty_out(vty, "   syncs: %"PRIu64" (%"PRIu64" objects), overflows: %"PRIu64", takeovers: %"PRIu64"\n",
+            standby.syncs, standby.synced_objects, standby.overflows, standby.takeovers);
+}
+struct json_object *hh_json_standby(void)
+{
+    struct json_object *json = hh_json_new();
+
+    json_object_boolean_add(json, "configured", standby.sock != NO_SOCK);
+    if (standby.sock == NO_SOCK)
+        return json;
+    json_object_string_add(json, "remotePath", standby.remote_path);
+    json_object_string_add(json, "localPath", standby.local_path);
+    json_object_boolean_add(json, "connected", standby.connected);
+    json_object_boolean_add(json, "ready", standby.ready);
+    json_object_int_add(json, "synt", standby.synt);
+    json_object_string_add(json, "sync", standby.syncing ? "in progress" : standby.synced ? "done" : "needed");
+    if (standby.syncing)
+        json_object_int_add(json, "syncObjectsSent", standby.sync_objects);
+    json_object_int_add(json, "unsent", dp_msg_list_count(&standby.unsent));
+    json_object_int_add(json, "inFlight", dp_msg_list_count(&standby.in_flight));
+    json_object_int_add(json, "held", dp_msg_list_count(&standby.held));
+    json_object_int_add(json, "mirroredSeqn", standby.pseqn_mirrored);
+    json_object_int_add(json, "ackedSeqn", standby.pseqn_acked);
+    json_object_int_add(json, "unconfirmed", standby.num_unconfirmed);
+    json_object_int_add(json, "lostSeqn", standby.pseqn_lost);
+    json_object_int_add(json, "tx", standby.tx);
+    json_object_int_add(json, "txFailures", standby.tx_failures);
+    json_object_int_add(json, "rx", standby.rx);
+    json_object_int_add(json, "responsesOk", standby.acks);
+    json_object_int_add(json, "responsesFailed", standby.failures);
+    json_object_int_add(json, "implicitAcks", standby.implicit_acks);
+    json_object_int_add(json, "syncs", standby.syncs);
+    json_object_int_add(json, "syncedObjects", standby.synced_objects);
+    json_object_int_add(json, "overflows", standby.overflows);
+    json_object_int_add(json, "takeovers", standby.takeovers);
+    return json;
+}
+
+/* initialize the standby channel */
+int init_dp_standby(const char *primary_local_path)
+{
+    BUG(!primary_local_path, -1);
+
+    if (!standby.remote_path[0])
+        return 0;
+
+    /* the standby is a single socket: with a sharded stream, failover would
+     * rebuild per-shard paths that it does not listen on */
+    if (dplane_num_shards() > 1) {
+        zlog_err("A standby dataplane can not be used with %u dataplane sockets", dplane_num_shards());
+        return -1;
+    }
+
+    if (snprintf(standby.local_path, sizeof(standby.local_path), "%s" DP_STANDBY_SUFFIX, primary_local_path)
+            >= (int)MAX_SUN_PATH) {
+        zlog_err("Local path for standby dataplane socket is too long");
+        return -1;
+    }
+
+    zlog_info("Initializing standby dataplane channel to '%s'...", standby.remote_path);
+    dp_msg_list_init(&standby.unsent);
+    dp_msg_list_init(&standby.in_flight);
+    dp_msg_list_init(&standby.held);
+    standby.tx_buff = buff_new(0);
+    standby.rx_buff = buff_new(0);
+    if (!standby.tx_buff || !standby.rx_buff) {
+        zlog_err("Failed to initialize standby rx/tx buffers");
+        fini_dp_standby();
+        return -1;
+    }
+
+    dp_standby_reset_sock(0);
+    if (standby.sock == NO_SOCK) {
+        fini_dp_standby();
+        return -1;
+    }
+    dp_standby_keepalive(NULL);
+    return 0;
+}
+
+void fini_dp_standby(void)
+{
+    EVENT_OFF(standby.ev_connect);
+    EVENT_OFF(standby.ev_recv);
+    EVENT_OFF(standby.ev_send);
+    EVENT_OFF(standby.ev_keepalive);
+    EVENT_OFF(standby.ev_sync);
+    if (standby.sock != NO_SOCK) {
+        close(standby.sock);
+        unlink(standby.local_path);
+        standby.sock = NO_SOCK;
+    }
+    if (standby.tx_buff) {
+        dp_standby_list_drain(&standby.unsent);
+        dp_standby_list_drain(&standby.in_flight);
+        dp_standby_list_drain(&standby.held);
+        buff_free(standby.tx_buff);
+        standby.tx_buff = NULL;
+    }
+    if (standby.rx_buff) {
+        buff_free(standby.rx_buff);
+        standby.rx_buff = NULL;
+    }
+    if (standby.unconfirmed)
+        XFREE(MTYPE_HH_DP_STANDBY, standby.unconfirmed);
+    standby.num_unconfirmed = standby.cap_unconfirmed = 0;
+}
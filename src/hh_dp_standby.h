@@ -0,0 +1,50 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef SRC_HH_DP_STANDBY_H_
+#define SRC_HH_DP_STANDBY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <dplane-rpc/dplane-rpc.h>
+#include "lib/vty.h"
+#include "lib/json.h"
+#include "hh_dp_msg_cache.h"
+
+/* Standby dataplane. It gets a copy of the requests sent to the primary dataplane over a
+ * socket of its own, and is fully synced from the state snapshot when it (re)starts. Its
+ * responses are tracked separately and never complete zebra contexts. Once in sync, it
+ * can take over from the primary without a refresh. */
+
+/* set the path of the standby dataplane socket. Empty disables the standby */
+int dp_standby_set_path(const char *path);
+
+/* initialize / finalize the standby channel. The local path is derived from that of
+ * the primary channel */
+int init_dp_standby(const char *primary_local_path);
+void fini_dp_standby(void);
+
+/* mirror a request queued for the primary dataplane */
+void dp_standby_mirror(const struct dp_msg *dp_msg);
+
+/* What the standby confirmed of the requests mirrored to it, in gseqns of the primary */
+struct dp_standby_acks {
+    uint64_t acked;             /* it answered the requests up to this one */
+    uint64_t lost;              /* requests up to this one may not have reached it */
+    uint64_t *unconfirmed;      /* sorted: requests it answered without confirming them Ok */
+    size_t num_unconfirmed;
+};
+
+/* tell if the standby confirmed Ok a request mirrored to it */
+bool dp_standby_acks_ok(const struct dp_standby_acks *acks, uint64_t gseqn);
+void dp_standby_acks_release(struct dp_standby_acks *acks);
+
+/* Take over: swap the remote paths of the primary and the standby, which then resyncs.
+ * Fails if the standby is not in sync. Gets the synt of the standby dataplane and what it
+ * confirmed of the requests mirrored, to be released by the caller */
+int dp_standby_takeover(char *primary_path, size_t len, uint64_t *synt, struct dp_standby_acks *acks);
+
+/* vty: show standby status */
+void hh_vty_show_standby(struct vty *vty);
+struct json_object *hh_json_standby(void);
+
+#endif /* SRC_HH_DP_STANDBY_H_ */
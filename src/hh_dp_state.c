@@ -0,0 +1,850 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "config.h" /* FRR config.h */
+#include "lib/zebra.h"
+#include "lib/libfrr.h"
+#include "zebra/zebra_dplane.h" /* dplane_get_thread_master() */
+#include <dplane-rpc/dplane-rpc.h> /* HH's rpc dataplane library */
+
+#include "hh_dp_internal.h"
+#include "hh_dp_msg_cache.h"
+#include "hh_dp_msg.h"
+#include "hh_dp_comm.h" /* send_rpc_msg */
+#include "hh_dp_state.h"
+#include "hh_dp_journal.h"
+
+/*
+ * Snapshot of the objects that dataplane acknowledged (or that zebra believes were
+ * programmed). When dataplane restarts and requests a refresh, the snapshot is replayed
+ * to the new incarnation instead of asking zebra to rebuild a context for every object.
+ */
+
+DEFINE_MTYPE_STATIC(ZEBRA, HH_DP_STATE, "HH Dataplane state object");
+
+/* max number of objects replayed per event loop run */
+#define DP_STATE_REPLAY_BATCH 256
+
+/* replay stalls if the unsent queue grows beyond this, to bound memory usage */
+#define DP_STATE_REPLAY_HIWAT 1024
+#define DP_STATE_REPLAY_RETRY_MSEC 10
+
+/* objects restored from the journal and not requested again by zebra within this
+ * time are removed from dataplane. Zebra gives no signal that its clients converged,
+ * so the hold must cover routing protocols relearning their routes */
+#define DP_STATE_WARM_HOLD_SEC 120
+
+/* zebra gives no signal either that a refresh is complete: the snapshot is considered
+ * rebuilt once it did not change for this long */
+#define DP_STATE_SETTLE_SEC 10
+
+/* Key identifying an object. For routes, ordering is by vrf, table and prefix */
+struct dp_state_key {
+    uint8_t otype;      /* ObjType */
+    uint8_t ipver;      /* IPV4 / IPV6; 0 for Rmac */
+    uint8_t len;        /* prefix len */
+    uint32_t vrfid;     /* IpRoute, IfAddress */
+    uint32_t tableid;   /* IpRoute */
+    uint32_t id;        /* ifindex for IfAddress, vni for Rmac */
+    uint8_t addr[16];   /* prefix, address or mac, in network order */
+};
+
+PREDECL_RBTREE_UNIQ(dp_state_tree);
+
+/* An object in the snapshot */
+struct dp_state_obj {
+    struct dp_state_key key;
+    struct RpcObject object;
+    uint32_t flags;
+#define DP_STATE_F_SKIP 0x1 /* object has a pending request: do not replay */
+#define DP_STATE_F_WARM 0x2 /* restored from the journal, not yet requested by zebra */
+#define DP_STATE_F_IGNORED 0x4 /* dataplane ignored the object: it does not hold it */
+    uint32_t jslot;     /* journal slot */
+    struct dp_state_tree_item link;
+};
+
+#define KEY_CMP(a, b, field) \
+    do { if ((a)->field != (b)->field) return (a)->field < (b)->field ? -1 : 1; } while (0)
+
+static int dp_state_obj_cmp(const struct dp_state_obj *a, const struct dp_state_obj *b)
+{
+    const struct dp_state_key *ka = &a->key;
+    const struct dp_state_key *kb = &b->key;
+
+    KEY_CMP(ka, kb, otype);
+    KEY_CMP(ka, kb, vrfid);
+    KEY_CMP(ka, kb, tableid);
+    KEY_CMP(ka, kb, ipver);
+    int r = memcmp(ka->addr, kb->addr, sizeof(ka->addr));
+    if (r)
+        return r;
+    KEY_CMP(ka, kb, len);
+    KEY_CMP(ka, kb, id);
+    return 0;
+}
+
+DECLARE_RBTREE_UNIQ(dp_state_tree, struct dp_state_obj, link, dp_state_obj_cmp);
+
+/* warm restart: objects restored from the journal of a prior run */
+enum dp_state_warm_mode {
+    WARM_NONE = 0,      /* no objects restored */
+    WARM_PENDING,       /* objects restored, dataplane synt not yet verified */
+    WARM_ACTIVE,        /* dataplane still holds the objects restored */
+};
+
+struct dp_state_warm {
+    enum dp_state_warm_mode mode;
+    uint64_t synt;                /* synt of the dataplane that holds the objects */
+    struct event *ev_sweep;
+
+    /* counters */
+    uint64_t restored;
+    uint64_t confirmed;           /* requested again by zebra, not sent */
+    uint64_t swept;               /* not requested again: removed from dataplane */
+    uint64_t discarded;           /* dataplane restarted meanwhile */
+};
+
+/* replay progress */
+struct dp_state_replay {
+    bool active;
+    struct dp_state_scope scope;
+    struct dp_state_obj cursor;   /* last object visited; only the key is used */
+    bool started;                 /* cursor is set */
+    uint64_t replayed;
+    uint64_t skipped;
+};
+
+static struct dp_state {
+    struct dp_state_tree_head objects;
+    bool valid;
+    const char *invalid_reason;
+    struct dp_state_replay replay;
+    struct event *ev_replay;
+    struct dp_msg_list_head answers;    /* sent once the replay completes */
+    struct dp_state_warm warm;
+    uint64_t gen;       /* bumped whenever objects are set or removed */
+
+    /* the snapshot is being rebuilt from zebra, since startup or a flush. It is
+     * rebuilt once gen did not change for DP_STATE_SETTLE_SEC since t_settle */
+    bool rebuilding;
+    uint64_t settle_gen;
+    uint64_t t_settle;
+
+    /* number of objects, per type. Kept as objects are added and removed in the dplane
+     * pthread, so that the vty never walks the tree */
+    size_t num_objects;
+    size_t count[MaxObjType];
+
+    /* counters */
+    uint64_t num_replays;
+    uint64_t num_fallbacks;
+    uint64_t num_invalidations;
+} dp_state = {0};
+
+/* build the key of an address */
+static inline void key_set_addr(struct dp_state_key *key, uint8_t ipver, const void *addr)
+{
+    key->ipver = ipver;
+    memcpy(key->addr, addr, ipver == IPV4 ? 4 : 16);
+}
+
+/* build the key of an object. Returns false if the object is not kept in the snapshot */
+static bool dp_state_key_from_object(struct dp_state_key *key, const struct RpcObject *obj)
+{
+    memset(key, 0, sizeof(*key));
+    key->otype = obj->type;
+
+    switch(obj->type) {
+        case IpRoute:
+            key->vrfid = obj->route.vrfid;
+            key->tableid = obj->route.tableid;
+            key->len = obj->route.len;
+            key_set_addr(key, obj->route.prefix.ipver, &obj->route.prefix.addr);
+            return true;
+        case IfAddress:
+            key->vrfid = obj->ifaddress.vrfid;
+            key->id = obj->ifaddress.ifindex;
+            key->len = obj->ifaddress.len;
+            key_set_addr(key, obj->ifaddress.address.ipver, &obj->ifaddress.address.addr);
+            return true;
+        case Rmac:
+            key->id = obj->rmac.vni;
+            memcpy(key->addr, obj->rmac.mac.bytes, MAC_LEN);
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* insert / remove an object in the tree, keeping the counts */
+static void dp_state_obj_add(struct dp_state_obj *o)
+{
+    dp_state_tree_add(&dp_state.objects, o);
+    dp_state.num_objects++;
+    dp_state.count[o->key.otype]++;
+}
+static void dp_state_obj_del(struct dp_state_obj *o)
+{
+    dp_state_tree_del(&dp_state.objects, o);
+    dp_state.num_objects--;
+    dp_state.count[o->key.otype]--;
+}
+
+/* free all objects */
+static void dp_state_obj_free_all(void)
+{
+    struct dp_state_obj *o;
+
+    while ((o = dp_state_tree_pop(&dp_state.objects)) != NULL)
+        XFREE(MTYPE_HH_DP_STATE, o);
+    dp_state.num_objects = 0;
+    memset(dp_state.count, 0, sizeof(dp_state.count));
+}
+
+/* lookup the object for a request */
+static struct dp_state_obj *dp_state_lookup(const struct RpcObject *object)
+{
+    struct dp_state_obj tmp;
+    if (!dp_state_key_from_object(&tmp.key, object))
+        return NULL;
+    return dp_state_tree_find(&dp_state.objects, &tmp);
+}
+
+/* add or replace an object */
+static void dp_state_set(const struct RpcObject *object, bool ignored)
+{
+    struct dp_state_obj tmp;
+    if (!dp_state_key_from_object(&tmp.key, object))
+        return;
+
+    struct dp_state_obj *o = dp_state_tree_find(&dp_state.objects, &tmp);
+    if (!o) {
+        o = XCALLOC(MTYPE_HH_DP_STATE, sizeof(*o));
+        o->key = tmp.key;
+        dp_state_obj_add(o);
+    }
+    o->object = *object;
+    o->flags &= ~(DP_STATE_F_WARM | DP_STATE_F_IGNORED);
+    if (ignored)
+        o->flags |= DP_STATE_F_IGNORED;
+    dp_state.gen++;
+    o->jslot = dp_journal_put(o->jslot, object);
+}
+
+/* remove an object */
+static void dp_state_unset(const struct RpcObject *object)
+{
+    struct dp_state_obj *o = dp_state_lookup(object);
+    if (o) {
+        dp_state_obj_del(o);
+        dp_journal_del(o->jslot);
+        XFREE(MTYPE_HH_DP_STATE, o);
+        dp_state.gen++;
+    }
+}
+
+/* update the snapshot with the outcome of a request. Deletions always remove the object since
+ * zebra forgets about it regardless of the outcome. Failed adds / updates remove it too, since zebra
+ * will consider the object as not installed. Ignored requests are treated as successes, as zebra does,
+ * but the object is flagged, since dataplane does not report it when asked for its objects. */
+void dp_state_update(const struct RpcRequest *req, RpcResultCode rescode)
+{
+    BUG(!req);
+    bool success = (rescode == Ok || rescode == Ignored);
+
+    switch(req->op) {
+        case Add:
+        case Update:
+            if (success)
+                dp_state_set(&req->object, rescode == Ignored);
+            else
+                dp_state_unset(&req->object);
+            break;
+        case Del:
+            dp_state_unset(&req->object);
+            break;
+        default:
+            break;
+    }
+}
+
+/* A request that will modify an object is about to be queued. If that object has not yet
+ * been replayed, it should not be: the request determines its final state. */
+void dp_state_note_request(const struct RpcRequest *req)
+{
+    BUG(!req);
+    if (!dp_state.replay.active)
+        return;
+
+    struct dp_state_obj *o = dp_state_lookup(&req->object);
+    if (o)
+        o->flags |= DP_STATE_F_SKIP;
+}
+
+/* mark objects referred to by messages pending to be sent or answered */
+static void dp_state_note_pending(struct dp_msg *m, void *arg)
+{
+    if (m->msg.type == Request && m->msg.request.op != Connect)
+        dp_state_note_request(&m->msg.request);
+}
+
+/* send the answers to the refreshes served by the replay */
+static void dp_state_replay_answer(void)
+{
+    struct dp_msg *m;
+    while ((m = dp_msg_list_pop(&dp_state.answers)) != NULL)
+        send_rpc_msg(m);
+}
+
+/* invalidate the snapshot */
+void dp_state_invalidate(const char *reason)
+{
+    if (dp_state.valid) {
+        zlog_warn("Invalidating dataplane state snapshot: %s", reason);
+        dp_state.num_invalidations++;
+    }
+    dp_state.valid = false;
+    dp_state.invalid_reason = reason;
+    dp_journal_set_valid(false);
+}
+
+/* tell if the snapshot can be used to serve refreshes */
+bool dp_state_is_valid(void)
+{
+    return dp_state.valid;
+}
+
+/* drop all objects in the snapshot and mark it valid again. This should be done when
+ * requesting zebra to refresh: zebra will send all of the objects again and the snapshot
+ * will be rebuilt from the responses. */
+void dp_state_flush(void)
+{
+    zlog_debug("Flushing dataplane state snapshot (%zu objects)", dp_state.num_objects);
+    dp_state_obj_free_all();
+    dp_journal_clear();
+    dp_journal_set_valid(true);
+    dp_state.gen++;
+
+    EVENT_OFF(dp_state.ev_replay);
+    EVENT_OFF(dp_state.warm.ev_sweep);
+    dp_state.warm.mode = WARM_NONE;
+    dp_state.replay.active = false;
+    dp_state_replay_answer();
+    dp_state.valid = true;
+    dp_state.invalid_reason = NULL;
+    dp_state.rebuilding = true;
+    dp_state.num_fallbacks++;
+}
+
+/* Tell if the snapshot holds what dataplane should have: it is valid, no replay is
+ * ongoing, no restored objects await confirmation and it is not being rebuilt from zebra */
+bool dp_state_is_settled(void)
+{
+    if (!dp_state.valid || dp_state.replay.active || dp_state.warm.mode != WARM_NONE)
+        return false;
+    if (!dp_state.rebuilding)
+        return true;
+
+    uint64_t now = hh_monotime_us();
+    if (dp_state.settle_gen != dp_state.gen || !dp_state.t_settle) {
+        dp_state.settle_gen = dp_state.gen;
+        dp_state.t_settle = now;
+        return false;
+    }
+    if (now - dp_state.t_settle < DP_STATE_SETTLE_SEC * 1000000ULL)
+        return false;
+
+    zlog_info("Dataplane state snapshot rebuilt from zebra: %zu objects", dp_state.num_objects);
+    dp_state.rebuilding = false;
+    dp_state.t_settle = 0;
+    return true;
+}
+
+/* restore an object from the journal */
+static void dp_state_warm_restore(const struct RpcObject *object, uint32_t slot)
+{
+    struct dp_state_obj tmp;
+    if (!dp_state_key_from_object(&tmp.key, object) || dp_state_tree_find(&dp_state.objects, &tmp)) {
+        dp_journal_del(slot);
+        return;
+    }
+    struct dp_state_obj *o = XCALLOC(MTYPE_HH_DP_STATE, sizeof(*o));
+    o->key = tmp.key;
+    o->object = *object;
+    o->flags = DP_STATE_F_WARM;
+    o->jslot = slot;
+    dp_state_obj_add(o);
+    dp_state.warm.restored++;
+}
+
+/* remove the objects restored from the journal that zebra did not request again */
+static void dp_state_warm_remove(bool send_del)
+{
+    struct dp_state_obj *o;
+
+    frr_each_safe(dp_state_tree, &dp_state.objects, o) {
+        if (!(o->flags & DP_STATE_F_WARM))
+            continue;
+        if (send_del) {
+            send_rpc_request_stale(&o->object);
+            dp_state.warm.swept++;
+        } else {
+            dp_state.warm.discarded++;
+        }
+        dp_state_obj_del(o);
+        dp_journal_del(o->jslot);
+        XFREE(MTYPE_HH_DP_STATE, o);
+        dp_state.gen++;
+    }
+}
+
+/* end of the hold: remove from dataplane the objects restored that zebra no longer has */
+static void dp_state_warm_sweep_timer(struct event *ev)
+{
+    struct dp_state_warm *warm = &dp_state.warm;
+
+    if (warm->mode != WARM_ACTIVE)
+        return;
+
+    warm->mode = WARM_NONE;
+    dp_state_warm_remove(true);
+    zlog_info("Warm restart completed: %"PRIu64" objects confirmed, %"PRIu64" stale objects removed",
+            warm->confirmed, warm->swept);
+}
+
+/* dataplane answered our Connect with its synt. If it is the one that holds the objects
+ * restored, they need not be sent again. Otherwise, dataplane restarted too and they're gone */
+void dp_state_warm_check(uint64_t synt)
+{
+    struct dp_state_warm *warm = &dp_state.warm;
+
+    if (warm->mode != WARM_PENDING)
+        return;
+
+    if (synt == warm->synt) {
+        zlog_info("Dataplane kept its state across restart: %"PRIu64" objects restored", warm->restored);
+        warm->mode = WARM_ACTIVE;
+        event_add_timer(dplane_get_thread_master(), dp_state_warm_sweep_timer, NULL,
+                DP_STATE_WARM_HOLD_SEC, &warm->ev_sweep);
+    } else {
+        zlog_info("Dataplane restarted: discarding %"PRIu64" objects restored", warm->restored);
+        warm->mode = WARM_NONE;
+        dp_state_warm_remove(false);
+    }
+}
+
+/* compare objects field by field, so that padding and unused bytes do not matter */
+static bool dp_state_address_equal(const struct IpAddress *a, const struct IpAddress *b)
+{
+    if (a->ipver != b->ipver)
+        return false;
+    if (a->ipver == IPV4)
+        return a->addr.ipv4 == b->addr.ipv4;
+    if (a->ipver == IPV6)
+        return memcmp(a->addr.ipv6, b->addr.ipv6, sizeof(a->addr.ipv6)) == 0;
+    return true;
+}
+static bool dp_state_nhop_equal(const struct next_hop *a, const struct next_hop *b)
+{
+    if (!dp_state_address_equal(&a->address, &b->address) || a->ifindex != b->ifindex ||
+        a->vrfid != b->vrfid || a->fwaction != b->fwaction || a->encap.type != b->encap.type)
+        return false;
+    return a->encap.type != VXLAN || a->encap.vxlan.vni == b->encap.vxlan.vni;
+}
+static bool dp_state_object_equal(const struct RpcObject *a, const struct RpcObject *b)
+{
+    if (a->type != b->type)
+        return false;
+
+    switch(a->type) {
+        case IpRoute: {
+            const struct ip_route *ra = &a->route, *rb = &b->route;
+            if (!dp_state_address_equal(&ra->prefix, &rb->prefix) || ra->len != rb->len ||
+                ra->vrfid != rb->vrfid || ra->tableid != rb->tableid || ra->type != rb->type ||
+                ra->distance != rb->distance || ra->metric != rb->metric || ra->num_nhops != rb->num_nhops)
+                return false;
+            for (uint8_t i = 0; i < ra->num_nhops; i++) {
+                if (!dp_state_nhop_equal(&ra->nhops[i], &rb->nhops[i]))
+                    return false;
+            }
+            return true;
+        }
+        case IfAddress:
+            return dp_state_address_equal(&a->ifaddress.address, &b->ifaddress.address) &&
+                   a->ifaddress.len == b->ifaddress.len && a->ifaddress.ifindex == b->ifaddress.ifindex &&
+                   a->ifaddress.vrfid == b->ifaddress.vrfid &&
+                   strncmp(a->ifaddress.ifname, b->ifaddress.ifname, sizeof(a->ifaddress.ifname)) == 0;
+        case Rmac:
+            return dp_state_address_equal(&a->rmac.address, &b->rmac.address) &&
+                   memcmp(a->rmac.mac.bytes, b->rmac.mac.bytes, MAC_LEN) == 0 && a->rmac.vni == b->rmac.vni;
+        default:
+            return false;
+    }
+}
+
+/* A request is about to be sent for an object. If it was restored and dataplane holds it
+ * unchanged, the request need not be sent. Returns true in that case */
+bool dp_state_warm_confirm(const struct RpcRequest *req)
+{
+    BUG(!req, false);
+    if (dp_state.warm.mode != WARM_ACTIVE || (req->op != Add && req->op != Update))
+        return false;
+
+    struct dp_state_obj *o = dp_state_lookup(&req->object);
+    if (!o || !(o->flags & DP_STATE_F_WARM))
+        return false;
+
+    o->flags &= ~DP_STATE_F_WARM;
+    if (!dp_state_object_equal(&o->object, &req->object))
+        return false;
+
+    dp_state.warm.confirmed++;
+    return true;
+}
+
+/* generation of the snapshot. It changes whenever objects are set or removed */
+uint64_t dp_state_generation(void)
+{
+    return dp_state.gen;
+}
+
+/* get the first vrf with routes, or the first after *vrfid if after is set */
+bool dp_state_route_vrf_next(bool after, VrfId *vrfid)
+{
+    BUG(!vrfid, false);
+    struct dp_state_obj seek = {0};
+
+    seek.key.otype = IpRoute;
+    if (after) {
+        if (*vrfid == UINT32_MAX)
+            return false;
+        seek.key.vrfid = *vrfid + 1;
+    }
+    struct dp_state_obj *o = dp_state_tree_find_gteq(&dp_state.objects, &seek);
+    if (!o || o->key.otype != IpRoute)
+        return false;
+    *vrfid = o->key.vrfid;
+    return true;
+}
+
+/* walk the routes of a vrf, ordered by table, ip version, prefix and length */
+void dp_state_route_walk(VrfId vrfid, void (*cb)(const struct RpcObject *object, void *arg), void *arg)
+{
+    BUG(!cb);
+    struct dp_state_obj seek = {0};
+
+    seek.key.otype = IpRoute;
+    seek.key.vrfid = vrfid;
+    for (struct dp_state_obj *o = dp_state_tree_find_gteq(&dp_state.objects, &seek);
+         o && o->key.otype == IpRoute && o->key.vrfid == vrfid;
+         o = dp_state_tree_next(&dp_state.objects, o)) {
+        if (!(o->flags & DP_STATE_F_IGNORED))
+            cb(&o->object, arg);
+    }
+}
+
+/* walk up to max objects in key order, resuming after the object in *cursor if started.
+ * The cursor is updated with the last object visited. Returns true if there are no more */
+bool dp_state_walk_from(struct RpcObject *cursor, bool *started, uint32_t max,
+                        void (*cb)(const struct RpcObject *object, void *arg), void *arg)
+{
+    BUG(!cursor || !started || !cb, true);
+    struct dp_state_obj *o;
+
+    if (!*started) {
+        o = dp_state_tree_first(&dp_state.objects);
+    } else {
+        struct dp_state_obj seek;
+        if (!dp_state_key_from_object(&seek.key, cursor))
+            return true;
+        o = dp_state_tree_find_gteq(&dp_state.objects, &seek);
+        if (o && dp_state_obj_cmp(o, &seek) == 0)
+            o = dp_state_tree_next(&dp_state.objects, o);
+    }
+    for (; o && max; o = dp_state_tree_next(&dp_state.objects, o), max--) {
+        cb(&o->object, arg);
+        *cursor = o->object;
+        *started = true;
+    }
+    return o == NULL;
+}
+
+/* tell if an object is within the scope of a replay */
+static bool dp_state_scope_match(const struct dp_state_scope *scope, const struct dp_state_key *key)
+{
+    if (!(scope->otypes & DP_STATE_OTYPE(key->otype)))
+        return false;
+    if (scope->has_vrf && (key->otype == Rmac || key->vrfid != scope->vrfid))
+        return false;
+    if (scope->has_table && (key->otype != IpRoute || key->tableid != scope->tableid))
+        return false;
+    return true;
+}
+
+/* Given an object out of scope, get the first object after it that may be in scope. Since
+ * objects are sorted by type, vrf and table, we can skip whole ranges of them. The object
+ * returned must be matched against the scope again */
+static struct dp_state_obj *dp_state_scope_seek(const struct dp_state_scope *scope, const struct dp_state_obj *o)
+{
+    const struct dp_state_key *key = &o->key;
+    struct dp_state_obj seek = {0};
+    struct dp_state_key *skey = &seek.key;
+
+    /* by default, move to next object type */
+    skey->otype = key->otype + 1;
+
+    if (!(scope->otypes & DP_STATE_OTYPE(key->otype)) || key->otype == Rmac ||
+        (scope->has_table && key->otype != IpRoute))
+        goto seek;
+
+    if (scope->has_vrf && key->vrfid != scope->vrfid) {
+        if (key->vrfid < scope->vrfid) {
+            skey->otype = key->otype;
+            skey->vrfid = scope->vrfid;
+            skey->tableid = scope->has_table ? scope->tableid : 0;
+        }
+        goto seek;
+    }
+    if (scope->has_table && key->tableid != scope->tableid) {
+        if (key->tableid < scope->tableid) {
+            skey->otype = key->otype;
+            skey->vrfid = key->vrfid;
+            skey->tableid = scope->tableid;
+        } else if (!scope->has_vrf && key->vrfid != UINT32_MAX) {
+            skey->otype = key->otype;
+            skey->vrfid = key->vrfid + 1;
+            skey->tableid = scope->tableid;
+        }
+        goto seek;
+    }
+    /* in scope */
+    return (struct dp_state_obj *)o;
+
+seek:
+    return dp_state_tree_find_gteq(&dp_state.objects, &seek);
+}
+
+/* merge the scope of a new replay into that of an ongoing one. The result must cover both */
+static void dp_state_scope_merge(struct dp_state_scope *dst, const struct dp_state_scope *src)
+{
+    if (dst->otypes != src->otypes || !src->has_vrf || dst->vrfid != src->vrfid)
+        dst->has_vrf = false;
+    if (dst->otypes != src->otypes || !src->has_table || dst->tableid != src->tableid)
+        dst->has_table = false;
+    dst->otypes |= src->otypes;
+}
+
+/* get the object following the replay cursor */
+static struct dp_state_obj *dp_state_replay_next(void)
+{
+    struct dp_state_replay *replay = &dp_state.replay;
+
+    if (!replay->started)
+        return dp_state_tree_first(&dp_state.objects);
+
+    struct dp_state_obj *o = dp_state_tree_find_gteq(&dp_state.objects, &replay->cursor);
+    if (o && dp_state_obj_cmp(o, &replay->cursor) == 0)
+        o = dp_state_tree_next(&dp_state.objects, o);
+    return o;
+}
+
+/* replay a batch of objects to dataplane. Objects are queued as Add requests without context.
+ * The replay continues from the key last visited, so that the snapshot can change in between. */
+static void dp_state_replay_run(struct event *ev)
+{
+    struct dp_state_replay *replay = &dp_state.replay;
+    struct event_loop *ev_loop = dplane_get_thread_master();
+    struct dp_state_obj *o;
+    unsigned int budget = DP_STATE_REPLAY_BATCH;
+
+    if (!replay->active)
+        return;
+
+    for (o = dp_state_replay_next(); o && budget; o = dp_state_tree_next(&dp_state.objects, o), budget--) {
+        if (dp_msg_unsent_count() >= DP_STATE_REPLAY_HIWAT)
+            break;
+
+        /* skip objects out of scope. A seek only gets to the first object that may be in
+         * scope, e.g. the next object type, so seek until one is or there are no more */
+        while (o && !dp_state_scope_match(&replay->scope, &o->key))
+            o = dp_state_scope_seek(&replay->scope, o);
+        if (!o)
+            break;
+
+        if (o->flags & DP_STATE_F_SKIP) {
+            replay->skipped++;
+        } else {
+            send_rpc_request_replay(&o->object);
+            replay->replayed++;
+        }
+        o->flags &= ~DP_STATE_F_SKIP;
+        replay->cursor.key = o->key;
+        replay->started = true;
+    }
+
+    if (!o) {
+        replay->active = false;
+        zlog_info("Replay of dataplane state completed: %"PRIu64" objects replayed, %"PRIu64" skipped",
+                replay->replayed, replay->skipped);
+        dp_state_replay_answer();
+        return;
+    }
+
+    /* more to do: continue when the unsent queue drains, or on the next loop iteration */
+    if (dp_msg_unsent_count() >= DP_STATE_REPLAY_HIWAT)
+        event_add_timer_msec(ev_loop, dp_state_replay_run, NULL, DP_STATE_REPLAY_RETRY_MSEC, &dp_state.ev_replay);
+    else
+        event_add_event(ev_loop, dp_state_replay_run, NULL, 0, &dp_state.ev_replay);
+}
+
+/* replay the snapshot to dataplane, or the part of it within scope */
+int dp_state_replay(const struct dp_state_scope *scope, struct dp_msg_list_head *answers)
+{
+    struct dp_state_replay *replay = &dp_state.replay;
+    struct dp_state_scope new_scope = { .otypes = DP_STATE_OTYPES_ALL };
+    struct dp_state_obj *o;
+
+    if (scope)
+        new_scope = *scope;
+
+    if (!dp_state.valid) {
+        zlog_warn("Can't replay dataplane state: snapshot is invalid (%s)",
+                dp_state.invalid_reason ? dp_state.invalid_reason : "unknown");
+        return -1;
+    }
+
+    /* if a replay is ongoing, widen its scope to cover the new one and restart it */
+    if (replay->active)
+        dp_state_scope_merge(&new_scope, &replay->scope);
+
+    /* (re)start the replay from the beginning. Answers are sent after all of it */
+    EVENT_OFF(dp_state.ev_replay);
+    if (answers) {
+        struct dp_msg *m;
+        while ((m = dp_msg_list_pop(answers)) != NULL)
+            dp_msg_list_add_tail(&dp_state.answers, m);
+    }
+    memset(replay, 0, sizeof(*replay));
+    replay->scope = new_scope;
+    frr_each(dp_state_tree, &dp_state.objects, o)
+        o->flags &= ~DP_STATE_F_SKIP;
+
+    /* objects with outstanding requests are not replayed: those requests will set their state */
+    replay->active = true;
+    dp_msg_pending_walk(dp_state_note_pending, NULL);
+
+    if (new_scope.has_vrf || new_scope.has_table || new_scope.otypes != DP_STATE_OTYPES_ALL) {
+        char vrf[16] = "any", table[16] = "any";
+        if (new_scope.has_vrf)
+            snprintf(vrf, sizeof(vrf), "%u", new_scope.vrfid);
+        if (new_scope.has_table)
+            snprintf(table, sizeof(table), "%u", new_scope.tableid);
+        zlog_info("Replaying dataplane state snapshot: object types 0x%x vrf %s table %s",
+                new_scope.otypes, vrf, table);
+    } else
+        zlog_info("Replaying dataplane state snapshot: %zu objects", dp_state.num_objects);
+    dp_state.num_replays++;
+    event_add_event(dplane_get_thread_master(), dp_state_replay_run, NULL, 0, &dp_state.ev_replay);
+    return 0;
+}
+
+/* vty: show snapshot status. The tree belongs to the dplane pthread: only counters are read */
+void hh_vty_show_state(struct vty *vty)
+{
+    BUG(!vty);
+
+    vty_out(vty, " Dataplane state snapshot: %s%s%s\n", dp_state.valid ? "valid" : "invalid",
+            dp_state.valid ? (dp_state.rebuilding ? " (rebuilding from zebra)" : "") : " - ",
+            dp_state.valid ? "" : dp_state.invalid_reason);
+    vty_out(vty, "   objects: %zu\n", dp_state.num_objects);
+    for (enum ObjType ot = None + 1; ot < MaxObjType; ot++) {
+        size_t count = dp_state.count[ot];
+        if (count)
+            vty_out(vty, "   %10.10s: %zu\n", str_object_type(ot), count);
+    }
+    vty_out(vty, "   replays: %"PRIu64" zebra-refreshes: %"PRIu64" invalidations: %"PRIu64"\n",
+            dp_state.num_replays, dp_state.num_fallbacks, dp_state.num_invalidations);
+    vty_out(vty, "   last replay: %s, %"PRIu64" objects replayed, %"PRIu64" skipped\n",
+            dp_state.replay.active ? "in progress" : "done",
+            dp_state.replay.replayed, dp_state.replay.skipped);
+    vty_out(vty, "   warm restart: %s, %"PRIu64" restored, %"PRIu64" confirmed, %"PRIu64" stale, %"PRIu64" discarded\n",
+            dp_state.warm.mode == WARM_ACTIVE ? "in progress" :
+            dp_state.warm.mode == WARM_PENDING ? "pending" : "done",
+            dp_state.warm.restored, dp_state.warm.confirmed, dp_state.warm.swept, dp_state.warm.discarded);
+    hh_vty_show_journal(vty);
+}
+struct json_object *hh_json_state(void)
+{
+    struct json_object *json = hh_json_new();
+    struct json_object *jcount = json_object_new_object();
+    struct json_object *jobj;
+
+    json_object_boolean_add(json, "valid", dp_state.valid);
+    if (!dp_state.valid)
+        json_object_string_add(json, "invalidReason", dp_state.invalid_reason);
+    json_object_boolean_add(json, "rebuilding", dp_state.rebuilding);
+    json_object_int_add(json, "objects", dp_state.num_objects);
+    for (enum ObjType ot = None + 1; ot < MaxObjType; ot++)
+        json_object_int_add(jcount, str_object_type(ot), dp_state.count[ot]);
+    json_object_object_add(json, "objectsByType", jcount);
+    json_object_int_add(json, "replays", dp_state.num_replays);
+    json_object_int_add(json, "zebraRefreshes", dp_state.num_fallbacks);
+    json_object_int_add(json, "invalidations", dp_state.num_invalidations);
+
+    jobj = json_object_new_object();
+    json_object_boolean_add(jobj, "inProgress", dp_state.replay.active);
+    json_object_int_add(jobj, "replayed", dp_state.replay.replayed);
+    json_object_int_add(jobj, "skipped", dp_state.replay.skipped);
+    json_object_object_add(json, "lastReplay", jobj);
+
+    jobj = json_object_new_object();
+    json_object_string_add(jobj, "state", dp_state.warm.mode == WARM_ACTIVE ? "in progress" :
+                           dp_state.warm.mode == WARM_PENDING ? "pending" : "done");
+    json_object_int_add(jobj, "restored", dp_state.warm.restored);
+    json_object_int_add(jobj, "confirmed", dp_state.warm.confirmed);
+    json_object_int_add(jobj, "stale", dp_state.warm.swept);
+    json_object_int_add(jobj, "discarded", dp_state.warm.discarded);
+    json_object_object_add(json, "warmRestart", jobj);
+
+    json_object_object_add(json, "journal", hh_json_journal());
+    return json;
+}
+
+/* initialize the snapshot. An empty snapshot is valid, since nothing has been programmed yet.
+ * If a prior run left a journal, its objects are restored, pending verification that dataplane
+ * still holds them. Returns the synt of the dataplane that does, or 0 */
+uint64_t init_dp_state(void)
+{
+    zlog_debug("Initializing dataplane state snapshot...");
+    memset(&dp_state, 0, sizeof(dp_state));
+    dp_state_tree_init(&dp_state.objects);
+    dp_msg_list_init(&dp_state.answers);
+    dp_state.valid = true;
+    dp_state.rebuilding = true;
+
+    if (init_dp_journal() != 0)
+        return 0;
+
+    dp_state.warm.synt = dp_journal_load(dp_state_warm_restore);
+    if (dp_state.warm.synt && dp_state.warm.restored)
+        dp_state.warm.mode = WARM_PENDING;
+    return dp_state.warm.synt;
+}
+
+/* finalize the snapshot */
+void fini_dp_state(void)
+{
+    zlog_debug("Finalizing dataplane state snapshot...");
+    EVENT_OFF(dp_state.ev_replay);
+    EVENT_OFF(dp_state.warm.ev_sweep);
+
+    /* the message cache is finalized already: answers not sent are freed */
+    struct dp_msg *m;
+    while ((m = dp_msg_list_pop(&dp_state.answers)) != NULL)
+        XFREE(MTYPE_HH_DP_MSG, m);
+    dp_msg_list_fini(&dp_state.answers);
+    dp_state_obj_free_all();
+    dp_state_tree_fini(&dp_state.objects);
+
+    /* the journal keeps the objects for the next run */
+    fini_dp_journal();
+}
@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef SRC_HH_DP_STATE_H_
+#define SRC_HH_DP_STATE_H_
+
+#include <stdbool.h>
+#include <dplane-rpc/dplane-rpc.h>
+#include "lib/vty.h"
+#include "lib/json.h"
+
+/* Scope of a replay: objects of the types in otypes and, if set, in some vrf / table.
+ * Rmacs have no vrf and are excluded by vrf scopes. Table scopes only include routes. */
+struct dp_state_scope {
+    uint32_t otypes;        /* mask of DP_STATE_OTYPE(ObjType) */
+    bool has_vrf;
+    VrfId vrfid;
+    bool has_table;
+    uint32_t tableid;
+};
+#define DP_STATE_OTYPE(ot) (1u << (ot))
+#define DP_STATE_OTYPES_ALL (DP_STATE_OTYPE(IfAddress) | DP_STATE_OTYPE(Rmac) | DP_STATE_OTYPE(IpRoute))
+
+/* initialize / finalize the snapshot of the state acknowledged by dataplane. Initializing
+ * restores the objects in the journal and returns the synt of the dataplane holding them */
+uint64_t init_dp_state(void);
+void fini_dp_state(void);
+
+/* update the snapshot with the outcome of a request */
+void dp_state_update(const struct RpcRequest *req, RpcResultCode rescode);
+
+/* tell the snapshot that a request for some object is about to be sent */
+void dp_state_note_request(const struct RpcRequest *req);
+
+/* invalidate the snapshot. Refreshes will be served by zebra until it is rebuilt */
+void dp_state_invalidate(const char *reason);
+
+/* tell if the snapshot can be used to serve refreshes */
+bool dp_state_is_valid(void);
+
+/* drop all objects in the snapshot, which is then rebuilt from zebra's refresh */
+void dp_state_flush(void);
+
+/* tell if the snapshot is complete: not being replayed, restored or rebuilt from zebra */
+bool dp_state_is_settled(void);
+
+/* replay the snapshot to dataplane, or the part of it within scope (NULL for all).
+ * Returns 0 if the replay was started, in which case it takes the messages in answers
+ * (if any), to send them once it queued all of the objects */
+struct dp_msg_list_head;
+int dp_state_replay(const struct dp_state_scope *scope, struct dp_msg_list_head *answers);
+
+/* warm restart: verify that dataplane (with the given synt) holds the objects restored */
+void dp_state_warm_check(uint64_t synt);
+
+/* warm restart: tell if a request can be spared since dataplane holds its object already */
+bool dp_state_warm_confirm(const struct RpcRequest *req);
+
+/* generation of the snapshot. It changes whenever objects are set or removed */
+uint64_t dp_state_generation(void);
+
+/* get the first vrf with routes, or the first after *vrfid if after is set */
+bool dp_state_route_vrf_next(bool after, VrfId *vrfid);
+
+/* walk the routes of a vrf, ordered by table, ip version, prefix and length. Routes that
+ * dataplane ignored are skipped */
+void dp_state_route_walk(VrfId vrfid, void (*cb)(const struct RpcObject *object, void *arg), void *arg);
+
+/* walk up to max objects in key order, resuming after the object in *cursor if started.
+ * The cursor is updated with the last object visited. Returns true if there are no more */
+bool dp_state_walk_from(struct RpcObject *cursor, bool *started, uint32_t max,
+                        void (*cb)(const struct RpcObject *object, void *arg), void *arg);
+
+/* vty: show snapshot status */
+void hh_vty_show_state(struct vty *vty);
+struct json_object *hh_json_state(void);
+
+#endif /* SRC_HH_DP_STATE_H_ */
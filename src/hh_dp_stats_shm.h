@@ -0,0 +1,127 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef SRC_HH_DP_STATS_SHM_H_
+#define SRC_HH_DP_STATS_SHM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <dplane-rpc/proto.h> /* Codes for RpcOp, ObjType and RpcResultCode */
+
+/*
+ * Layout of the stats page that the plugin publishes in shared memory, for local collectors
+ * to mmap read-only and poll without any IPC into zebra. This header has no dependencies on
+ * FRR, so that readers can be built without it.
+ *
+ * The page is rewritten as a whole under a sequence counter (seqlock): seq is odd while the
+ * page is being written. Readers copy the page and retry if seq was odd or changed meanwhile.
+ * The plugin creates a new file every time it starts: a reader that finds the pid changed or
+ * the timestamp stalled should map the file again.
+ */
+
+#define HH_STATS_SHM_MAGIC 0x48485353  /* "HHSS" */
+#define HH_STATS_SHM_VERSION 1
+#define HH_STATS_SHM_DFLT_PATH "/dev/shm/hhplugin.stats"
+
+enum hh_stats_shm_queue_id {
+    HH_STATS_SHM_POOL = 0,
+    HH_STATS_SHM_UNSENT,
+    HH_STATS_SHM_IN_FLIGHT,
+    HH_STATS_SHM_QUEUES
+};
+
+struct hh_stats_shm_queue {
+    uint64_t depth;
+    uint64_t high_water;
+    uint64_t oldest_usec;   /* age of the oldest message, at the last sample */
+};
+
+/* counters and latency summary of a kind of request */
+struct hh_stats_shm_req {
+    uint64_t sent;
+    uint64_t replied;
+    uint64_t unk_err;
+    uint64_t rescode[RpcResultCodeMax];
+
+    /* round-trip latency, usec */
+    uint64_t lat_count;
+    uint64_t lat_avg;
+    uint64_t lat_p50;
+    uint64_t lat_p90;
+    uint64_t lat_p99;
+    uint64_t lat_p999;
+    uint64_t lat_max;
+};
+
+struct hh_stats_shm {
+    /* header: constant for the life of the file */
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;          /* of the page */
+    uint32_t pid;           /* of zebra */
+    uint32_t num_otypes;    /* dimensions of requests[][] */
+    uint32_t num_ops;
+    uint32_t num_rescodes;
+    uint32_t pad;
+
+    _Atomic uint64_t seq;   /* odd while the page is being written */
+    uint64_t ts_usec;       /* monotonic time of the last update */
+    uint64_t updates;
+
+    /* IO */
+    uint64_t tx;
+    uint64_t tx_failure;
+    uint64_t tx_eagain;
+    uint64_t rx;
+    uint64_t rx_failure;
+    uint64_t rx_eagain;
+    uint64_t encode_failure;
+    uint64_t decode_failure;
+
+    /* control / keepalives */
+    uint64_t control_tx;
+    uint64_t control_rx;
+    uint64_t control_suppressed;
+    uint64_t resumes;
+    uint64_t resume_processed;
+    uint64_t resume_resent;
+
+    /* completions to zebra */
+    uint64_t hand_off_ctxs;
+    uint64_t hand_off_wakeups;
+    uint64_t hand_off_max;
+    uint64_t cumulative_acks;
+    uint64_t implicit_acks;
+
+    struct hh_stats_shm_queue queues[HH_STATS_SHM_QUEUES];
+    struct hh_stats_shm_req requests[MaxObjType][MaxRpcOp];
+};
+
+/* tell if a mapped page is one this header describes */
+static inline bool hh_stats_shm_valid(const struct hh_stats_shm *shm, size_t size)
+{
+    return size >= sizeof(*shm) && shm->magic == HH_STATS_SHM_MAGIC && shm->version == HH_STATS_SHM_VERSION &&
+           shm->size == sizeof(*shm) && shm->num_otypes == MaxObjType && shm->num_ops == MaxRpcOp &&
+           shm->num_rescodes == RpcResultCodeMax;
+}
+
+/* take a consistent copy of a mapped page. Fails if the writer kept it busy for too long */
+#define HH_STATS_SHM_READ_TRIES 1000
+static inline int hh_stats_shm_read(const struct hh_stats_shm *shm, struct hh_stats_shm *copy)
+{
+    _Atomic uint64_t *seqp = (_Atomic uint64_t *)&shm->seq;
+
+    for (unsigned int tries = 0; tries < HH_STATS_SHM_READ_TRIES; tries++) {
+        uint64_t seq = atomic_load_explicit(seqp, memory_order_acquire);
+        if (seq & 1)
+            continue;
+        memcpy(copy, shm, sizeof(*copy));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(seqp, memory_order_relaxed) == seq)
+            return 0;
+    }
+    return -1;
+}
+
+#endif /* SRC_HH_DP_STATS_SHM_H_ */
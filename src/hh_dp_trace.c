@@ -0,0 +1,336 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#include "config.h" /* FRR config.h */
+#include "lib/zebra.h"
+#include "lib/libfrr.h"
+
+#include <arpa/inet.h>
+#include <stdatomic.h>
+
+#include "hh_dp_internal.h"
+#include "hh_dp_msg_cache.h" /* MGROUP ZEBRA */
+#include "hh_dp_trace.h"
+
+DEFINE_MTYPE_STATIC(ZEBRA, HH_DP_TRACE, "HH Dataplane trace");
+
+#define HH_TRACE_SIZE 16384     /* records: must be a power of 2 */
+#define HH_TRACE_MASK (HH_TRACE_SIZE - 1)
+
+/* a message, in compact form: the key of the object it refers to, if any */
+struct hh_trace_rec {
+    uint64_t ts;        /* usec */
+    uint64_t seqn;
+    uint8_t ev;
+    uint8_t shard;
+    uint8_t mtype;
+    uint8_t op;
+    uint8_t otype;
+    uint8_t rescode;
+    uint8_t ipver;
+    uint8_t len;
+    uint32_t vrfid;
+    uint32_t id;        /* ifindex for IfAddress, vni for Rmac, refresh for Control */
+    uint8_t addr[16];   /* prefix, address or mac */
+};
+
+struct hh_trace_slot {
+    _Atomic uint64_t seq;   /* sequence of the record + 1, 0 while written */
+    struct hh_trace_rec rec;
+};
+
+static struct {
+    _Atomic uint64_t head;  /* sequence of the next record */
+    struct hh_trace_slot ring[HH_TRACE_SIZE];
+} trace;
+
+static const char *const hh_trace_ev_names[HH_TRACE_EV_MAX] = {
+    [HH_TRACE_TX] = "tx",
+    [HH_TRACE_RX] = "rx",
+    [HH_TRACE_ACK] = "ack",
+    [HH_TRACE_PURGE] = "purge",
+};
+
+/* set the key of the object of a request */
+static void hh_trace_set_object(struct hh_trace_rec *r, const struct RpcObject *obj)
+{
+    r->otype = obj->type;
+    switch(obj->type) {
+        case IpRoute:
+            r->vrfid = obj->route.vrfid;
+            r->id = obj->route.tableid;
+            r->len = obj->route.len;
+            r->ipver = obj->route.prefix.ipver;
+            memcpy(r->addr, &obj->route.prefix.addr, r->ipver == IPV4 ? 4 : 16);
+            break;
+        case IfAddress:
+            r->vrfid = obj->ifaddress.vrfid;
+            r->id = obj->ifaddress.ifindex;
+            r->len = obj->ifaddress.len;
+            r->ipver = obj->ifaddress.address.ipver;
+            memcpy(r->addr, &obj->ifaddress.address.addr, r->ipver == IPV4 ? 4 : 16);
+            break;
+        case Rmac:
+            r->id = obj->rmac.vni;
+            memcpy(r->addr, obj->rmac.mac.bytes, MAC_LEN);
+            break;
+        default:
+            break;
+    }
+}
+
+/* claim the next slot of the ring. Only the dplane pthread writes */
+static struct hh_trace_rec *hh_trace_begin(enum hh_trace_ev ev, uint8_t shard, uint8_t mtype)
+{
+    uint64_t n = atomic_load_explicit(&trace.head, memory_order_relaxed);
+    struct hh_trace_slot *slot = &trace.ring[n & HH_TRACE_MASK];
+
+    atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    struct hh_trace_rec *r = &slot->rec;
+    memset(r, 0, sizeof(*r));
+    r->ts = hh_monotime_us();
+    r->ev = ev;
+    r->shard = shard;
+    r->mtype = mtype;
+    return r;
+}
+
+/* publish the record in the slot claimed */
+static void hh_trace_commit(void)
+{
+    uint64_t n = atomic_load_explicit(&trace.head, memory_order_relaxed);
+
+    atomic_store_explicit(&trace.ring[n & HH_TRACE_MASK].seq, n + 1, memory_order_release);
+    atomic_store_explicit(&trace.head, n + 1, memory_order_release);
+}
+
+/* record a message sent / received over a shard */
+void hh_trace_msg(enum hh_trace_ev ev, uint8_t shard, const struct RpcMsg *msg)
+{
+    BUG(!msg);
+    struct hh_trace_rec *r = hh_trace_begin(ev, shard, msg->type);
+
+    switch(msg->type) {
+        case Request:
+            r->op = msg->request.op;
+            r->seqn = msg->request.seqn;
+            hh_trace_set_object(r, &msg->request.object);
+            break;
+        case Response:
+            r->op = msg->response.op;
+            r->seqn = msg->response.seqn;
+            r->rescode = msg->response.rescode;
+            r->id = msg->response.num_objects;
+            break;
+        case Control:
+            r->id = msg->control.refresh;
+            break;
+        default:
+            break;
+    }
+    hh_trace_commit();
+}
+
+/* record the outcome of a request */
+void hh_trace_outcome(uint8_t shard, const struct RpcRequest *req, RpcResultCode rescode, bool purged)
+{
+    BUG(!req);
+    struct hh_trace_rec *r = hh_trace_begin(purged ? HH_TRACE_PURGE : HH_TRACE_ACK, shard, Request);
+
+    r->op = req->op;
+    r->seqn = req->seqn;
+    r->rescode = rescode;
+    hh_trace_set_object(r, &req->object);
+    hh_trace_commit();
+}
+
+/* read the record of sequence n. Fails if it was overwritten */
+static bool hh_trace_read(uint64_t n, struct hh_trace_rec *r)
+{
+    struct hh_trace_slot *slot = &trace.ring[n & HH_TRACE_MASK];
+
+    if (atomic_load_explicit(&slot->seq, memory_order_acquire) != n + 1)
+        return false;
+    *r = slot->rec;
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&slot->seq, memory_order_relaxed) == n + 1;
+}
+
+static inline bool hh_trace_failed(const struct hh_trace_rec *r)
+{
+    return r->rescode != Ok && r->rescode != Ignored && r->rescode != ExpectMore;
+}
+
+static bool hh_trace_match(const struct hh_trace_rec *r, const struct hh_trace_filter *f)
+{
+    if (f->ev >= 0 && r->ev != f->ev)
+        return false;
+    if (f->otype >= 0 && (r->mtype != Request || r->otype != f->otype))
+        return false;
+    if (f->match_vrf && (r->mtype != Request || r->vrfid != f->vrfid ||
+                         (r->otype != IpRoute && r->otype != IfAddress)))
+        return false;
+    if (f->failed) {
+        /* only outcomes and responses carry a result */
+        bool result = r->ev == HH_TRACE_ACK || r->ev == HH_TRACE_PURGE || r->mtype == Response;
+        if (!result || !hh_trace_failed(r))
+            return false;
+    }
+    return true;
+}
+
+/* format the object of a record */
+static void hh_trace_fmt_object(struct vty *vty, const struct hh_trace_rec *r)
+{
+    char addr[INET6_ADDRSTRLEN];
+
+    switch(r->otype) {
+        case IpRoute:
+        case IfAddress:
+            inet_ntop(r->ipver == IPV4 ? AF_INET : AF_INET6, r->addr, addr, sizeof(addr));
+            if (r->otype == IpRoute)
+                vty_out(vty, " route vrf %u table %u %s/%u", r->vrfid, r->id, addr, r->len);
+            else
+                vty_out(vty, " ifaddress vrf %u ifindex %u %s/%u", r->vrfid, r->id, addr, r->len);
+            break;
+        case Rmac:
+            vty_out(vty, " rmac vni %u %02x:%02x:%02x:%02x:%02x:%02x", r->id,
+                    r->addr[0], r->addr[1], r->addr[2], r->addr[3], r->addr[4], r->addr[5]);
+            break;
+        default:
+            vty_out(vty, " %s", str_object_type(r->otype));
+            break;
+    }
+}
+
+static void hh_trace_fmt(struct vty *vty, const struct hh_trace_rec *r, uint64_t now)
+{
+    uint64_t age = now > r->ts ? now - r->ts : 0;
+
+    vty_out(vty, " -%"PRIu64".%06"PRIu64" %-5s #%u %-8s", age / 1000000, age % 1000000,
+            hh_trace_ev_names[r->ev], r->shard, str_msg_type(r->mtype));
+    switch(r->mtype) {
+        case Request:
+            vty_out(vty, " %-6s #%"PRIu64, str_rpc_op(r->op), r->seqn);
+            hh_trace_fmt_object(vty, r);
+            if (r->ev == HH_TRACE_ACK || r->ev == HH_TRACE_PURGE)
+                vty_out(vty, ": %s", str_rescode(r->rescode));
+            break;
+        case Response:
+            vty_out(vty, " %-6s #%"PRIu64" %s", str_rpc_op(r->op), r->seqn, str_rescode(r->rescode));
+            if (r->id)
+                vty_out(vty, " (%u objects)", r->id);
+            break;
+        case Control:
+            vty_out(vty, " refresh %u", r->id);
+            break;
+        default:
+            break;
+    }
+    vty_out(vty, "\n");
+}
+
+/* collect the last records that match a filter, newest first. Returns how many */
+static uint32_t hh_trace_collect(uint32_t last, const struct hh_trace_filter *filter, uint64_t head,
+                                 struct hh_trace_rec *recs)
+{
+    uint64_t tail = head > HH_TRACE_SIZE ? head - HH_TRACE_SIZE : 0;
+    uint32_t num = 0;
+
+    /* once a record was overwritten, so were older ones */
+    for (uint64_t n = head; n > tail && num < last; n--) {
+        if (!hh_trace_read(n - 1, &recs[num]))
+            break;
+        if (hh_trace_match(&recs[num], filter))
+            num++;
+    }
+    return num;
+}
+
+/* vty: dump the last records that match a filter, oldest first */
+void hh_vty_show_trace(struct vty *vty, uint32_t last, const struct hh_trace_filter *filter)
+{
+    BUG(!vty || !filter);
+    uint64_t head = atomic_load_explicit(&trace.head, memory_order_acquire);
+    uint64_t now = hh_monotime_us();
+
+    last = MIN(last, HH_TRACE_SIZE);
+    struct hh_trace_rec *recs = XCALLOC(MTYPE_HH_DP_TRACE, last * sizeof(*recs));
+    uint32_t num = hh_trace_collect(last, filter, head, recs);
+
+    vty_out(vty, " RPC trace: %"PRIu64" messages recorded, showing %u (times in seconds, relative to now)\n\n", head, num);
+    while (num)
+        hh_trace_fmt(vty, &recs[--num], now);
+    vty_out(vty, "\n");
+    XFREE(MTYPE_HH_DP_TRACE, recs);
+}
+
+static struct json_object *hh_trace_json(const struct hh_trace_rec *r)
+{
+    struct json_object *jr = json_object_new_object();
+    char addr[INET6_ADDRSTRLEN];
+
+    json_object_int_add(jr, "timestampUsec", r->ts);
+    json_object_string_add(jr, "event", hh_trace_ev_names[r->ev]);
+    json_object_int_add(jr, "shard", r->shard);
+    json_object_string_add(jr, "type", str_msg_type(r->mtype));
+    switch(r->mtype) {
+        case Request:
+        case Response:
+            json_object_string_add(jr, "operation", str_rpc_op(r->op));
+            json_object_int_add(jr, "seqn", r->seqn);
+            if (r->mtype == Response || r->ev == HH_TRACE_ACK || r->ev == HH_TRACE_PURGE)
+                json_object_string_add(jr, "result", str_rescode(r->rescode));
+            if (r->mtype == Response) {
+                json_object_int_add(jr, "objects", r->id);
+                break;
+            }
+            json_object_string_add(jr, "object", str_object_type(r->otype));
+            switch(r->otype) {
+                case IpRoute:
+                case IfAddress:
+                    inet_ntop(r->ipver == IPV4 ? AF_INET : AF_INET6, r->addr, addr, sizeof(addr));
+                    json_object_int_add(jr, "vrf", r->vrfid);
+                    json_object_int_add(jr, r->otype == IpRoute ? "table" : "ifindex", r->id);
+                    json_object_string_add(jr, "address", addr);
+                    json_object_int_add(jr, "len", r->len);
+                    break;
+                case Rmac:
+                    snprintf(addr, sizeof(addr), "%02x:%02x:%02x:%02x:%02x:%02x",
+                             r->addr[0], r->addr[1], r->addr[2], r->addr[3], r->addr[4], r->addr[5]);
+                    json_object_int_add(jr, "vni", r->id);
+                    json_object_string_add(jr, "mac", addr);
+                    break;
+                default:
+                    break;
+            }
+            break;
+        case Control:
+            json_object_int_add(jr, "refresh", r->id);
+            break;
+        default:
+            break;
+    }
+    return jr;
+}
+
+/* json: the last records that match a filter, oldest first */
+struct json_object *hh_json_trace(uint32_t last, const struct hh_trace_filter *filter)
+{
+    BUG(!filter, NULL);
+    uint64_t head = atomic_load_explicit(&trace.head, memory_order_acquire);
+    struct json_object *json = hh_json_new();
+    struct json_object *jrecs = json_object_new_array();
+
+    last = MIN(last, HH_TRACE_SIZE);
+    struct hh_trace_rec *recs = XCALLOC(MTYPE_HH_DP_TRACE, last * sizeof(*recs));
+    uint32_t num = hh_trace_collect(last, filter, head, recs);
+
+    json_object_int_add(json, "recorded", head);
+    while (num)
+        json_object_array_add(jrecs, hh_trace_json(&recs[--num]));
+    json_object_object_add(json, "records", jrecs);
+    XFREE(MTYPE_HH_DP_TRACE, recs);
+    return json;
+}
@@ -0,0 +1,44 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef SRC_HH_DP_TRACE_H_
+#define SRC_HH_DP_TRACE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <dplane-rpc/dplane-rpc.h>
+#include "lib/vty.h"
+#include "lib/json.h"
+
+/* Trace of the RPC messages exchanged with dataplane. Messages are recorded in binary,
+ * compact form in a ring written by the dplane pthread only, and formatted when dumped.
+ * Readers do not lock: each slot carries the sequence of the record it holds, so that
+ * records overwritten while being read are detected and skipped. */
+
+enum hh_trace_ev {
+    HH_TRACE_TX = 0,    /* message sent */
+    HH_TRACE_RX,        /* message received */
+    HH_TRACE_ACK,       /* request answered */
+    HH_TRACE_PURGE,     /* request purged: dataplane restarted */
+    HH_TRACE_EV_MAX
+};
+
+/* record a message sent / received over a shard */
+void hh_trace_msg(enum hh_trace_ev ev, uint8_t shard, const struct RpcMsg *msg);
+
+/* record the outcome of a request */
+void hh_trace_outcome(uint8_t shard, const struct RpcRequest *req, RpcResultCode rescode, bool purged);
+
+/* criteria of the records dumped. Negative values match any */
+struct hh_trace_filter {
+    int ev;
+    int otype;
+    bool match_vrf;
+    VrfId vrfid;
+    bool failed;        /* only requests that failed */
+};
+
+/* vty: dump the last records that match a filter, oldest first */
+void hh_vty_show_trace(struct vty *vty, uint32_t last, const struct hh_trace_filter *filter);
+struct json_object *hh_json_trace(uint32_t last, const struct hh_trace_filter *filter);
+
+#endif /* SRC_HH_DP_TRACE_H_ */
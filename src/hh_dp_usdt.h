@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+#ifndef SRC_HH_DP_USDT_H_
+#define SRC_HH_DP_USDT_H_
+
+#include <stdint.h>
+#include <dplane-rpc/dplane-rpc.h>
+
+/*
+ * USDT static probes on the RPC hot path, for bpftrace & co to attach to without a rebuild.
+ * They are compiled in with the HH_USDT CMake option only; a probe is then a nop until traced.
+ * Provider is "hhdp". Probes and their arguments:
+ *
+ *   intake(ctx, dplane-op)                              context taken in from zebra
+ *   enqueue(ctx, seqn, op, otype, shard)                request queued for sending
+ *   send(seqn, op, otype, bytes, shard, msg-type)       message written to the socket
+ *   recv(bytes, shard)                                  datagram read from the socket
+ *   recover(seqn, op, otype, rescode, found, shard)     response matched to its request, if found
+ *   hand_off(ctx, result, seqn, op, otype)              context handed back to zebra
+ *
+ * seqn, op and otype are 0 for messages other than requests. Seqns are per shard, so requests
+ * are identified by (shard, seqn). See usdt/ for sample bpftrace scripts.
+ */
+
+#if defined(HH_USDT) && HH_USDT
+#include <sys/sdt.h>
+#define HH_USDT_PROBE(name, ...) STAP_PROBEV(hhdp, name, ##__VA_ARGS__)
+#else
+#define HH_USDT_PROBE(name, ...) do { } while (0)
+#endif
+
+/* request fields carried by probes, or 0 if the message is not a request */
+#define HH_USDT_SEQN(msg) ((msg)->type == Request ? (uint64_t)(msg)->request.seqn : 0)
+#define HH_USDT_OP(msg) ((msg)->type == Request ? (int)(msg)->request.op : 0)
+#define HH_USDT_OTYPE(msg) ((msg)->type == Request ? (int)(msg)->request.object.type : 0)
+
+#endif /* SRC_HH_DP_USDT_H_ */
@@ -5,8 +5,20 @@
 #include "lib/command.h"
 #include "lib/zlog.h"
 #include "hh_dp_config.h"
+#include "hh_dp_internal.h" /* hh_json_new */
 #include "hh_dp_vty.h"
 #include "hh_dp_rpc_stats.h"
+#include "hh_dp_state.h"
+#include "hh_dp_bulk.h"
+#include "hh_dp_rules.h"
+#include "hh_dp_budget.h"
+#include "hh_dp_audit.h"
+#include "hh_dp_standby.h"
+#include "hh_dp_conv.h"
+#include "hh_dp_cpu.h"
+#include "hh_dp_trace.h"
+#include "hh_dp_msg_cache.h"
+#include "hh_dp_msg.h" /* dp_msg_set_cumulative_acks */
 #include "hh_dp_comm.h" /* log_dataplane_msg */
 #include "hh_dp_vty_common.h"
 
@@ -17,23 +29,390 @@ static void hh_vty_show_version(struct vty *vty) {
     vty_out(vty, "   Branch: %s\n", GIT_BRANCH);
     vty_out(vty, "   Tag   : %s\n\n", strlen(GIT_TAG) ? GIT_TAG : "none");
 }
+static struct json_object *hh_json_version(void)
+{
+    struct json_object *json = hh_json_new();
+
+    json_object_string_add(json, "version", VER_STRING);
+    json_object_string_add(json, "buildDate", BUILD_DATE);
+    json_object_string_add(json, "buildType", BUILD_TYPE);
+    json_object_string_add(json, "commit", GIT_COMMIT);
+    json_object_string_add(json, "branch", GIT_BRANCH);
+    json_object_string_add(json, "tag", GIT_TAG);
+    return json;
+}
 
 DEFUN (hh_dp_show_plugin_version, hh_dp_show_plugin_version_cmd,
        HH_CMD_SHOW_PLUGIN_VERSION,
-       SHOW_STR HH_STR HH_DP_PLUGIN "version\n")
+       SHOW_STR HH_STR HH_DP_PLUGIN "version\n" JSON_STR)
 {
+    if (use_json(argc, argv))
+        return vty_json(vty, hh_json_version());
     hh_vty_show_version(vty);
     return CMD_SUCCESS;
 }
 
 DEFUN (hh_dp_show_rpc_stats, hh_dp_show_rpc_stats_cmd,
        HH_CMD_SHOW_RPC_STATS,
-       SHOW_STR HH_STR HH_DP_RPC_STR "show rpc stats\n")
+       SHOW_STR HH_STR HH_DP_RPC_STR "show rpc stats\n" JSON_STR)
 {
+    if (use_json(argc, argv))
+        return vty_json(vty, hh_json_stats());
     hh_vty_show_stats(vty);
     return CMD_SUCCESS;
 }
 
+DEFUN (hh_dp_show_rpc_latency, hh_dp_show_rpc_latency_cmd,
+       HH_CMD_SHOW_RPC_LATENCY,
+       SHOW_STR HH_STR HH_DP_RPC_STR "Round-trip latency of requests\n" JSON_STR)
+{
+    if (use_json(argc, argv))
+        return vty_json(vty, hh_json_latency());
+    hh_vty_show_latency(vty);
+    return CMD_SUCCESS;
+}
+
+DEFUN (hh_dp_show_rpc_queues, hh_dp_show_rpc_queues_cmd,
+       HH_CMD_SHOW_RPC_QUEUES,
+       SHOW_STR HH_STR HH_DP_RPC_STR "Depth and age of message queues\n" JSON_STR)
+{
+    if (use_json(argc, argv))
+        return vty_json(vty, hh_json_queues());
+    hh_vty_show_queues(vty);
+    return CMD_SUCCESS;
+}
+
+DEFUN (hh_dp_show_rpc_trace, hh_dp_show_rpc_trace_cmd,
+       HH_CMD_SHOW_RPC_TRACE,
+       SHOW_STR HH_STR HH_DP_RPC_STR HH_DP_TRACE_HELP JSON_STR)
+{
+    struct hh_trace_filter filter = { .ev = -1, .otype = -1 };
+    uint32_t last = HH_TRACE_DFLT_LAST;
+    int idx = 0;
+
+    if (argv_find(argv, argc, "last", &idx))
+        last = strtoul(argv[idx + 1]->arg, NULL, 10);
+    idx = 0;
+    if (argv_find(argv, argc, "tx", &idx))
+        filter.ev = HH_TRACE_TX;
+    else if (argv_find(argv, argc, "rx", &idx))
+        filter.ev = HH_TRACE_RX;
+    else if (argv_find(argv, argc, "ack", &idx))
+        filter.ev = HH_TRACE_ACK;
+    else if (argv_find(argv, argc, "purge", &idx))
+        filter.ev = HH_TRACE_PURGE;
+    idx = 0;
+    if (argv_find(argv, argc, "object", &idx)) {
+        const char *otype = argv[idx + 1]->text;
+        filter.otype = strmatch(otype, "route") ? IpRoute :
+                       strmatch(otype, "ifaddress") ? IfAddress :
+                       strmatch(otype, "rmac") ? Rmac : ConnectInfo;
+    }
+    idx = 0;
+    if (argv_find(argv, argc, "vrf", &idx)) {
+        filter.match_vrf = true;
+        filter.vrfid = strtoul(argv[idx + 1]->arg, NULL, 10);
+    }
+    idx = 0;
+    filter.failed = argv_find(argv, argc, "failed", &idx);
+
+    if (use_json(argc, argv))
+        return vty_json(vty, hh_json_trace(last, &filter));
+    hh_vty_show_trace(vty, last, &filter);
+    return CMD_SUCCESS;
+}
+
+DEFUN (hh_dp_show_convergence, hh_dp_show_convergence_cmd,
+       HH_CMD_SHOW_CONVERGENCE,
+       SHOW_STR HH_STR HH_DP_CONVERGENCE_STR JSON_STR)
+{
+    if (use_json(argc, argv))
+        return vty_json(vty, hh_json_convergence());
+    hh_vty_show_convergence(vty);
+    return CMD_SUCCESS;
+}
+
+DEFUN (hh_dp_show_cpu, hh_dp_show_cpu_cmd,
+       HH_CMD_SHOW_CPU,
+       SHOW_STR HH_STR HH_DP_CPU_STR JSON_STR)
+{
+    if (use_json(argc, argv))
+        return vty_json(vty, hh_json_cpu());
+    hh_vty_show_cpu(vty);
+    return CMD_SUCCESS;
+}
+
+DEFUN (hh_dp_cpu_accounting, hh_dp_cpu_accounting_cmd,
+       HH_CMD_CPU_ACCOUNTING,
+       NO_STR HH_STR HH_DP_CPU_STR)
+{
+    hh_cpu_enable(!strmatch(argv[0]->text, "no"));
+    return CMD_SUCCESS;
+}
+
+DEFUN (hh_dp_clear_cpu, hh_dp_clear_cpu_cmd,
+       HH_CMD_CLEAR_CPU,
+       CLEAR_STR HH_STR HH_DP_CPU_STR)
+{
+    hh_cpu_clear();
+    return CMD_SUCCESS;
+}
+
+DEFUN (hh_dp_show_state, hh_dp_show_state_cmd,
+       HH_CMD_SHOW_STATE,
+       SHOW_STR HH_STR HH_DP_STATE_STR JSON_STR)
+{
+    if (use_json(argc, argv))
+        return vty_json(vty, hh_json_state());
+    hh_vty_show_state(vty);
+    return CMD_SUCCESS;
+}
+
+DEFUN (hh_dp_show_bulk, hh_dp_show_bulk_cmd,
+       HH_CMD_SHOW_BULK,
+       SHOW_STR HH_STR HH_DP_BULK_STR JSON_STR)
+{
+    if (use_json(argc, argv))
+        return vty_json(vty, hh_json_bulk());
+    hh_vty_show_bulk(vty);
+    return CMD_SUCCESS;
+}
+
+DEFUN (hh_dp_show_filter, hh_dp_show_filter_cmd,
+       HH_CMD_SHOW_FILTER,
+       SHOW_STR HH_STR HH_DP_FILTER_STR JSON_STR)
+{
+    if (use_json(argc, argv))
+        return vty_json(vty, hh_json_rules(HH_RULESET_FILTER));
+    hh_vty_show_rules(vty, HH_RULESET_FILTER);
+    return CMD_SUCCESS;
+}
+
+/* parse the match criteria of a rule */
+static int hh_vty_parse_rule(struct vty *vty, int argc, struct cmd_token **argv, struct hh_rule_cfg *cfg)
+{
+    int idx = 0;
+
+    cfg->le = 128;
+    if (argv_find(argv, argc, "vrf", &idx)) {
+        cfg->match_vrf = true;
+        cfg->vrfid = strtoul(argv[idx + 1]->arg, NULL, 10);
+    }
+    idx = 0;
+    if (argv_find(argv, argc, "table", &idx)) {
+        cfg->match_table = true;
+        cfg->tableid = strtoul(argv[idx + 1]->arg, NULL, 10);
+    }
+    idx = 0;
+    if (argv_find(argv, argc, "type", &idx)) {
+        int rtype = hh_rtype_from_str(argv[idx + 1]->text);
+        if (rtype < 0 || rtype >= HH_RTYPE_MAX) {
+            vty_out(vty, "%% Unsupported route type %s\n", argv[idx + 1]->text);
+            return CMD_WARNING_CONFIG_FAILED;
+        }
+        cfg->rtypes = 1u << rtype;
+    }
+    idx = 0;
+    if (argv_find(argv, argc, "ge", &idx))
+        cfg->ge = strtoul(argv[idx + 1]->arg, NULL, 10);
+    idx = 0;
+    if (argv_find(argv, argc, "le", &idx))
+        cfg->le = strtoul(argv[idx + 1]->arg, NULL, 10);
+    if (cfg->ge > cfg->le) {
+        vty_out(vty, "%% Invalid prefix length range: ge %u is above le %u\n", cfg->ge, cfg->le);
+        return CMD_WARNING_CONFIG_FAILED;
+    }
+    idx = 0;
+    if (argv_find(argv, argc, "prefix-list", &idx)) {
+        if (strlen(argv[idx + 1]->arg) >= sizeof(cfg->plist)) {
+            vty_out(vty, "%% Prefix-list name is too long\n");
+            return CMD_WARNING_CONFIG_FAILED;
+        }
+        strlcpy(cfg->plist, argv[idx + 1]->arg, sizeof(cfg->plist));
+    }
+    return CMD_SUCCESS;
+}
+
+DEFUN (hh_dp_filter, hh_dp_filter_cmd,
+       HH_CMD_FILTER,
+       HH_STR HH_DP_FILTER_STR "Sequence number\n" "Send matching routes\n" "Do not send matching routes\n"
+       HH_RULE_MATCH_HELP)
+{
+    struct hh_rule_cfg cfg = {0};
+
+    cfg.seq = strtoul(argv[2]->arg, NULL, 10);
+    cfg.action = strmatch(argv[3]->text, "permit") ? HH_RULE_PERMIT : HH_RULE_DENY;
+    int r = hh_vty_parse_rule(vty, argc, argv, &cfg);
+    if (r != CMD_SUCCESS)
+        return r;
+
+    if (hh_rule_set(HH_RULESET_FILTER, &cfg) != 0) {
+        vty_out(vty, "%% Failed to configure filter %u\n", cfg.seq);
+        return CMD_WARNING_CONFIG_FAILED;
+    }
+    return CMD_SUCCESS;
+}
+
+DEFUN (hh_dp_no_filter, hh_dp_no_filter_cmd,
+       HH_CMD_NO_FILTER,
+       NO_STR HH_STR HH_DP_FILTER_STR "Sequence number\n")
+{
+    uint32_t seq = strtoul(argv[3]->arg, NULL, 10);
+
+    if (hh_rule_unset(HH_RULESET_FILTER, seq) != 0) {
+        vty_out(vty, "%% No filter with sequence number %u\n", seq);
+        return CMD_WARNING_CONFIG_FAILED;
+    }
+    return CMD_SUCCESS;
+}
+
+DEFUN (hh_dp_clear_filter, hh_dp_clear_filter_cmd,
+       HH_CMD_CLEAR_FILTER,
+       CLEAR_STR HH_STR HH_DP_FILTER_STR "Hit counters\n")
+{
+    hh_rules_clear_counters(HH_RULESET_FILTER);
+    return CMD_SUCCESS;
+}
+
+DEFUN (hh_dp_show_kernel, hh_dp_show_kernel_cmd,
+       HH_CMD_SHOW_KERNEL,
+       SHOW_STR HH_STR HH_DP_KERNEL_STR JSON_STR)
+{
+    if (use_json(argc, argv))
+        return vty_json(vty, hh_json_rules(HH_RULESET_KERNEL));
+    hh_vty_show_rules(vty, HH_RULESET_KERNEL);
+    vty_out(vty, "  routes matching no rule are installed in the kernel only in the default vrf\n");
+    vty_out(vty, "  rules apply to routes as they are installed: routes in the kernel stay there until deleted\n");
+    return CMD_SUCCESS;
+}
+
+DEFUN (hh_dp_kernel, hh_dp_kernel_cmd,
+       HH_CMD_KERNEL,
+       HH_STR HH_DP_KERNEL_STR "Sequence number\n" "Install matching routes in the kernel\n"
+       "Do not install matching routes in the kernel\n"
+       HH_RULE_MATCH_HELP)
+{
+    struct hh_rule_cfg cfg = {0};
+
+    cfg.seq = strtoul(argv[2]->arg, NULL, 10);
+    cfg.action = strmatch(argv[3]->text, "install") ? HH_RULE_PERMIT : HH_RULE_DENY;
+    int r = hh_vty_parse_rule(vty, argc, argv, &cfg);
+    if (r != CMD_SUCCESS)
+        return r;
+
+    if (hh_rule_set(HH_RULESET_KERNEL, &cfg) != 0) {
+        vty_out(vty, "%% Failed to configure kernel rule %u\n", cfg.seq);
+        return CMD_WARNING_CONFIG_FAILED;
+    }
+    return CMD_SUCCESS;
+}
+
+DEFUN (hh_dp_no_kernel, hh_dp_no_kernel_cmd,
+       HH_CMD_NO_KERNEL,
+       NO_STR HH_STR HH_DP_KERNEL_STR "Sequence number\n")
+{
+    uint32_t seq = strtoul(argv[3]->arg, NULL, 10);
+
+    if (hh_rule_unset(HH_RULESET_KERNEL, seq) != 0) {
+        vty_out(vty, "%% No kernel rule with sequence number %u\n", seq);
+        return CMD_WARNING_CONFIG_FAILED;
+    }
+    return CMD_SUCCESS;
+}
+
+DEFUN (hh_dp_clear_kernel, hh_dp_clear_kernel_cmd,
+       HH_CMD_CLEAR_KERNEL,
+       CLEAR_STR HH_STR HH_DP_KERNEL_STR "Hit counters\n")
+{
+    hh_rules_clear_counters(HH_RULESET_KERNEL);
+    return CMD_SUCCESS;
+}
+
+DEFUN (hh_dp_show_budgets, hh_dp_show_budgets_cmd,
+       HH_CMD_SHOW_BUDGETS,
+       SHOW_STR HH_STR HH_DP_BUDGET_STR JSON_STR)
+{
+    if (use_json(argc, argv))
+        return vty_json(vty, hh_json_budgets());
+    hh_vty_show_budgets(vty);
+    return CMD_SUCCESS;
+}
+
+DEFUN (hh_dp_budget, hh_dp_budget_cmd,
+       HH_CMD_BUDGET,
+       HH_STR HH_DP_BUDGET_STR HH_DP_BUDGET_HELP)
+{
+    int id = hh_budget_id_from_str(argv[2]->text);
+    if (id < 0) {
+        vty_out(vty, "%% Unknown work loop %s\n", argv[2]->text);
+        return CMD_WARNING_CONFIG_FAILED;
+    }
+    uint32_t max_msgs = strtoul(argv[4]->arg, NULL, 10);
+    uint32_t max_usec = strtoul(argv[6]->arg, NULL, 10);
+    hh_budget_set(id, max_msgs, max_usec);
+    return CMD_SUCCESS;
+}
+
+DEFUN (hh_dp_cumulative_ack, hh_dp_cumulative_ack_cmd,
+       HH_CMD_CUMULATIVE_ACK,
+       NO_STR HH_STR "RPC\n" "Complete requests acknowledged by a later response\n")
+{
+    dp_msg_set_cumulative_acks(!strmatch(argv[0]->text, "no"));
+    return CMD_SUCCESS;
+}
+
+DEFUN (hh_dp_coalesce, hh_dp_coalesce_cmd,
+       HH_CMD_COALESCE,
+       HH_STR "RPC\n" HH_DP_COALESCE_HELP)
+{
+    uint32_t max_usec = strtoul(argv[4]->arg, NULL, 10);
+    uint32_t max_msgs = strtoul(argv[6]->arg, NULL, 10);
+
+    if (dp_tx_set_window(max_usec, max_msgs) != 0) {
+        vty_out(vty, "%% Invalid coalescing parameters\n");
+        return CMD_WARNING_CONFIG_FAILED;
+    }
+    return CMD_SUCCESS;
+}
+
+DEFUN (hh_dp_show_audit, hh_dp_show_audit_cmd,
+       HH_CMD_SHOW_AUDIT,
+       SHOW_STR HH_STR HH_DP_AUDIT_STR JSON_STR)
+{
+    if (use_json(argc, argv))
+        return vty_json(vty, hh_json_audit());
+    hh_vty_show_audit(vty);
+    return CMD_SUCCESS;
+}
+
+DEFUN (hh_dp_audit, hh_dp_audit_cmd,
+       HH_CMD_AUDIT,
+       HH_STR HH_DP_AUDIT_STR HH_DP_AUDIT_HELP)
+{
+    dp_audit_set_interval(strtoul(argv[3]->arg, NULL, 10));
+    return CMD_SUCCESS;
+}
+
+DEFUN (hh_dp_show_standby, hh_dp_show_standby_cmd,
+       HH_CMD_SHOW_STANDBY,
+       SHOW_STR HH_STR HH_DP_STANDBY_STR JSON_STR)
+{
+    if (use_json(argc, argv))
+        return vty_json(vty, hh_json_standby());
+    hh_vty_show_standby(vty);
+    return CMD_SUCCESS;
+}
+
+DEFUN (hh_dp_failover, hh_dp_failover_cmd,
+       HH_CMD_FAILOVER,
+       HH_STR "Dataplane\n" "Fail over to the standby dataplane\n")
+{
+    /* runs in the dplane thread. The outcome is logged */
+    dplane_request_failover();
+    vty_out(vty, "Failover to standby dataplane requested\n");
+    return CMD_SUCCESS;
+}
+
 DEFUN (hh_dp_debug_rpc_msg, hh_dp_debug_rpc_msg_cmd,
        HH_CMD_DEBUG_RPC,
        NO_STR DEBUG_STR HH_STR "RPC messages\n")
@@ -44,10 +423,66 @@ DEFUN (hh_dp_debug_rpc_msg, hh_dp_debug_rpc_msg_cmd,
     return CMD_SUCCESS;
 }
 
+/* write the plugin settings that differ from the defaults to the running config */
+static int hh_dp_config_write(struct vty *vty)
+{
+    int lines = 0;
+
+    lines += hh_rules_config_write(vty, HH_RULESET_FILTER);
+    lines += hh_rules_config_write(vty, HH_RULESET_KERNEL);
+    lines += hh_budget_config_write(vty);
+    if (dp_msg_cumulative_acks_configured()) {
+        vty_out(vty, "hedgehog rpc cumulative-ack\n");
+        lines++;
+    }
+    lines += dp_tx_window_config_write(vty);
+    lines += dp_audit_config_write(vty);
+    if (atomic_load_explicit(&hh_cpu_on, memory_order_relaxed)) {
+        vty_out(vty, "hedgehog cpu-accounting\n");
+        lines++;
+    }
+    return lines;
+}
+
+/* Zebra does not use this node: like zebra_fpm, the plugin uses it to write its settings */
+static struct cmd_node hh_dp_node = {
+    .name = "hedgehog",
+    .node = ZEBRA_NODE,
+    .parent_node = CONFIG_NODE,
+    .prompt = "",
+    .config_write = hh_dp_config_write,
+};
+
 void hh_dp_vty_init(void)
 {
     zlog_info("Initializing HHGW vty commands ...");
+    install_node(&hh_dp_node);
     install_element(VIEW_NODE, &hh_dp_show_plugin_version_cmd);
     install_element(VIEW_NODE, &hh_dp_show_rpc_stats_cmd);
+    install_element(VIEW_NODE, &hh_dp_show_rpc_latency_cmd);
+    install_element(VIEW_NODE, &hh_dp_show_rpc_queues_cmd);
+    install_element(VIEW_NODE, &hh_dp_show_rpc_trace_cmd);
+    install_element(VIEW_NODE, &hh_dp_show_convergence_cmd);
+    install_element(VIEW_NODE, &hh_dp_show_cpu_cmd);
+    install_element(CONFIG_NODE, &hh_dp_cpu_accounting_cmd);
+    install_element(ENABLE_NODE, &hh_dp_clear_cpu_cmd);
+    install_element(VIEW_NODE, &hh_dp_show_state_cmd);
+    install_element(VIEW_NODE, &hh_dp_show_bulk_cmd);
+    install_element(VIEW_NODE, &hh_dp_show_filter_cmd);
+    install_element(CONFIG_NODE, &hh_dp_filter_cmd);
+    install_element(CONFIG_NODE, &hh_dp_no_filter_cmd);
+    install_element(ENABLE_NODE, &hh_dp_clear_filter_cmd);
+    install_element(VIEW_NODE, &hh_dp_show_kernel_cmd);
+    install_element(CONFIG_NODE, &hh_dp_kernel_cmd);
+    install_element(CONFIG_NODE, &hh_dp_no_kernel_cmd);
+    install_element(ENABLE_NODE, &hh_dp_clear_kernel_cmd);
+    install_element(VIEW_NODE, &hh_dp_show_budgets_cmd);
+    install_element(CONFIG_NODE, &hh_dp_budget_cmd);
+    install_element(CONFIG_NODE, &hh_dp_cumulative_ack_cmd);
+    install_element(CONFIG_NODE, &hh_dp_coalesce_cmd);
+    install_element(VIEW_NODE, &hh_dp_show_audit_cmd);
+    install_element(CONFIG_NODE, &hh_dp_audit_cmd);
+    install_element(VIEW_NODE, &hh_dp_show_standby_cmd);
+    install_element(ENABLE_NODE, &hh_dp_failover_cmd);
     install_element(ENABLE_NODE, &hh_dp_debug_rpc_msg_cmd);
 }
@@ -8,9 +8,77 @@
 #define HH_STR "Hedgehog-GW\n"
 #define HH_DP_RPC_STR "RPC stats\n"
 #define HH_DP_PLUGIN "Plugin\n"
+#define HH_DP_CONVERGENCE_STR "Route convergence times, from intake to dataplane ack\n"
+#define HH_DP_TRACE_HELP \
+    "Trace of messages exchanged with dataplane\n" \
+    "Show the last records only\n" "Records (default 50)\n" \
+    "Messages sent\n" "Messages received\n" "Requests answered\n" "Requests purged\n" \
+    "Match object type\n" "Connect info\n" "Interface addresses\n" "Router macs\n" "Routes\n" \
+    "Match vrf\n" "Vrf id\n" \
+    "Failed requests only\n"
+#define HH_TRACE_DFLT_LAST 50
+#define HH_DP_CPU_STR "CPU cost accounting of plugin stages\n"
+#define HH_DP_STATE_STR "Dataplane state snapshot\n"
+#define HH_DP_BULK_STR "Bulk-load mode during initial convergence\n"
+#define HH_DP_FILTER_STR "Filter routes sent to dataplane\n"
+#define HH_DP_KERNEL_STR "Kernel programming policy\n"
+#define HH_DP_AUDIT_STR "Periodic audit of dataplane routes\n"
+#define HH_DP_AUDIT_HELP "Interval between audits\n" "Seconds (0: disabled)\n"
+#define HH_DP_STANDBY_STR "Standby dataplane\n"
+#define HH_DP_BUDGET_STR "Per-pass budgets of work loops\n"
+#define HH_DP_COALESCE_HELP \
+    "Coalesce outbound messages into batches\n" \
+    "Max time to hold messages\n" "Microseconds (0: disabled)\n" \
+    "Number of messages that triggers a send\n" "Messages\n"
+#define HH_DP_BUDGET_HELP \
+    "Reception of messages from dataplane\n" "Transmission of messages to dataplane\n" \
+    "Intake of contexts from zebra\n" \
+    "Max messages per pass\n" "Messages (0: no limit)\n" \
+    "Max time per pass\n" "Microseconds (0: no limit)\n"
 
-#define HH_CMD_SHOW_PLUGIN_VERSION "show hedgehog plugin version"
-#define HH_CMD_SHOW_RPC_STATS "show hedgehog rpc stats"
+/* route match criteria of rules */
+#define HH_RULE_MATCH_CMD \
+    "[vrf (0-4294967295)] [table (1-4294967295)] " \
+    "[type <local|connected|static|ospf|isis|bgp|other>] " \
+    "[ge (0-128)] [le (0-128)] [prefix-list WORD]"
+#define HH_RULE_MATCH_HELP \
+    "Match vrf\n" "Vrf id\n" \
+    "Match routing table\n" "Table id\n" \
+    "Match route type\n" "Local routes\n" "Connected routes\n" "Static routes\n" \
+    "OSPF routes\n" "IS-IS routes\n" "BGP routes\n" "Other routes\n" \
+    "Minimum prefix length\n" "Prefix length\n" \
+    "Maximum prefix length\n" "Prefix length\n" \
+    "Match prefix-list\n" "Prefix-list name\n"
+
+#define HH_CMD_SHOW_PLUGIN_VERSION "show hedgehog plugin version [json]"
+#define HH_CMD_SHOW_RPC_STATS "show hedgehog rpc stats [json]"
+#define HH_CMD_SHOW_RPC_LATENCY "show hedgehog rpc latency [json]"
+#define HH_CMD_SHOW_RPC_QUEUES "show hedgehog rpc queues [json]"
+#define HH_CMD_SHOW_RPC_TRACE \
+    "show hedgehog rpc trace [last (1-16384)] [<tx|rx|ack|purge>] " \
+    "[object <connect|ifaddress|rmac|route>] [vrf (0-4294967295)] [failed] [json]"
+#define HH_CMD_SHOW_CONVERGENCE "show hedgehog convergence [json]"
+#define HH_CMD_SHOW_CPU "show hedgehog cpu [json]"
+#define HH_CMD_CPU_ACCOUNTING "[no] hedgehog cpu-accounting"
+#define HH_CMD_CLEAR_CPU "clear hedgehog cpu"
+#define HH_CMD_SHOW_STATE "show hedgehog state [json]"
+#define HH_CMD_SHOW_BULK "show hedgehog bulk-load [json]"
+#define HH_CMD_SHOW_FILTER "show hedgehog filter [json]"
+#define HH_CMD_FILTER "hedgehog filter (1-65535) <permit|deny> " HH_RULE_MATCH_CMD
+#define HH_CMD_NO_FILTER "no hedgehog filter (1-65535)"
+#define HH_CMD_CLEAR_FILTER "clear hedgehog filter counters"
+#define HH_CMD_SHOW_KERNEL "show hedgehog kernel [json]"
+#define HH_CMD_KERNEL "hedgehog kernel (1-65535) <install|skip> " HH_RULE_MATCH_CMD
+#define HH_CMD_NO_KERNEL "no hedgehog kernel (1-65535)"
+#define HH_CMD_CLEAR_KERNEL "clear hedgehog kernel counters"
+#define HH_CMD_SHOW_BUDGETS "show hedgehog budgets [json]"
+#define HH_CMD_BUDGET "hedgehog budget <rx|tx|intake> msgs (0-1000000) usec (0-1000000)"
+#define HH_CMD_CUMULATIVE_ACK "[no] hedgehog rpc cumulative-ack"
+#define HH_CMD_COALESCE "hedgehog rpc coalesce window (0-100000) msgs (1-64)"
+#define HH_CMD_SHOW_AUDIT "show hedgehog audit [json]"
+#define HH_CMD_AUDIT "hedgehog audit interval (0-86400)"
+#define HH_CMD_SHOW_STANDBY "show hedgehog standby [json]"
+#define HH_CMD_FAILOVER "hedgehog dataplane failover"
 #define HH_CMD_DEBUG_RPC "[no] debug hedgehog rpc"
 
 #endif /* SRC_HH_DP_VTY_COMMON_H_ */
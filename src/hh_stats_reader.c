@@ -0,0 +1,245 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+
+/*
+ * Reader of the stats page that the plugin publishes in shared memory. It maps the page
+ * read-only and prints the counters, once or periodically, without any IPC into zebra.
+ * When printing periodically, the page is mapped again if zebra restarted and created a
+ * new file, or if it stopped updating the page.
+ *
+ *   hh_stats_reader [-f path] [-i interval-ms [-c count]]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dplane-rpc/dplane-rpc.h> /* str_object_type, str_rpc_op, str_rescode */
+
+#include "hh_dp_stats_shm.h"
+
+/* the page is mapped again if not updated for this long */
+#define STALL_USEC 3000000ULL
+
+/* a mapping of the page */
+struct page_map {
+    const struct hh_stats_shm *page;
+    size_t size;
+    dev_t dev;
+    ino_t ino;
+};
+
+static const char *const queue_names[HH_STATS_SHM_QUEUES] = {
+    [HH_STATS_SHM_POOL] = "pool",
+    [HH_STATS_SHM_UNSENT] = "unsent",
+    [HH_STATS_SHM_IN_FLIGHT] = "in_flight",
+};
+
+static void unmap_page(struct page_map *map)
+{
+    if (map->page)
+        munmap((void *)map->page, map->size);
+    memset(map, 0, sizeof(*map));
+}
+
+/* map the page, replacing any prior mapping. Errors are reported unless quiet */
+static int map_page(const char *path, struct page_map *map, bool quiet)
+{
+    struct stat st;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    unmap_page(map);
+    if (fd < 0) {
+        if (!quiet)
+            fprintf(stderr, "Failed to open '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (fstat(fd, &st) < 0) {
+        if (!quiet)
+            fprintf(stderr, "Failed to stat '%s': %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        if (!quiet)
+            fprintf(stderr, "Failed to map '%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (!hh_stats_shm_valid(addr, st.st_size)) {
+        if (!quiet)
+            fprintf(stderr, "'%s' is not a stats page of version %u\n", path, HH_STATS_SHM_VERSION);
+        munmap(addr, st.st_size);
+        return -1;
+    }
+    map->page = addr;
+    map->size = st.st_size;
+    map->dev = st.st_dev;
+    map->ino = st.st_ino;
+    return 0;
+}
+
+/* tell if the file at path is no longer the one mapped, e.g. since zebra restarted */
+static bool page_replaced(const char *path, const struct page_map *map)
+{
+    struct stat st;
+
+    if (stat(path, &st) < 0)
+        return true;
+    return st.st_dev != map->dev || st.st_ino != map->ino;
+}
+
+static uint64_t now_usec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/* print a snapshot, as "name value" lines. Rates are given against the prior snapshot */
+static void print_page(const struct hh_stats_shm *s, const struct hh_stats_shm *prev)
+{
+    printf("pid %u\n", s->pid);
+    printf("timestamp_usec %"PRIu64"\n", s->ts_usec);
+    printf("updates %"PRIu64"\n", s->updates);
+
+#define PRINT(name) printf(#name " %"PRIu64"\n", s->name)
+    PRINT(tx);
+    PRINT(tx_failure);
+    PRINT(tx_eagain);
+    PRINT(rx);
+    PRINT(rx_failure);
+    PRINT(rx_eagain);
+    PRINT(encode_failure);
+    PRINT(decode_failure);
+    PRINT(control_tx);
+    PRINT(control_rx);
+    PRINT(control_suppressed);
+    PRINT(resumes);
+    PRINT(resume_processed);
+    PRINT(resume_resent);
+    PRINT(hand_off_ctxs);
+    PRINT(hand_off_wakeups);
+    PRINT(hand_off_max);
+    PRINT(cumulative_acks);
+    PRINT(implicit_acks);
+#undef PRINT
+
+    if (prev && s->pid == prev->pid && s->ts_usec > prev->ts_usec) {
+        double secs = (double)(s->ts_usec - prev->ts_usec) / 1000000.0;
+        printf("tx_per_sec %.1f\n", (double)(s->tx - prev->tx) / secs);
+        printf("rx_per_sec %.1f\n", (double)(s->rx - prev->rx) / secs);
+        printf("hand_off_ctxs_per_sec %.1f\n", (double)(s->hand_off_ctxs - prev->hand_off_ctxs) / secs);
+    }
+
+    for (int q = 0; q < HH_STATS_SHM_QUEUES; q++) {
+        printf("queue_%s_depth %"PRIu64"\n", queue_names[q], s->queues[q].depth);
+        printf("queue_%s_high_water %"PRIu64"\n", queue_names[q], s->queues[q].high_water);
+        if (q != HH_STATS_SHM_POOL)
+            printf("queue_%s_oldest_usec %"PRIu64"\n", queue_names[q], s->queues[q].oldest_usec);
+    }
+
+    for (int ot = 0; ot < MaxObjType; ot++) {
+        for (int op = 0; op < MaxRpcOp; op++) {
+            const struct hh_stats_shm_req *r = &s->requests[ot][op];
+            if (!r->sent && !r->replied)
+                continue;
+            const char *o = str_object_type(ot), *p = str_rpc_op(op);
+            printf("request_%s_%s_sent %"PRIu64"\n", o, p, r->sent);
+            printf("request_%s_%s_replied %"PRIu64"\n", o, p, r->replied);
+            printf("request_%s_%s_unk_err %"PRIu64"\n", o, p, r->unk_err);
+            for (int rc = 0; rc < RpcResultCodeMax; rc++)
+                printf("request_%s_%s_%s %"PRIu64"\n", o, p, str_rescode(rc), r->rescode[rc]);
+            if (!r->lat_count)
+                continue;
+            printf("latency_%s_%s_count %"PRIu64"\n", o, p, r->lat_count);
+            printf("latency_%s_%s_avg_usec %"PRIu64"\n", o, p, r->lat_avg);
+            printf("latency_%s_%s_p50_usec %"PRIu64"\n", o, p, r->lat_p50);
+            printf("latency_%s_%s_p90_usec %"PRIu64"\n", o, p, r->lat_p90);
+            printf("latency_%s_%s_p99_usec %"PRIu64"\n", o, p, r->lat_p99);
+            printf("latency_%s_%s_p999_usec %"PRIu64"\n", o, p, r->lat_p999);
+            printf("latency_%s_%s_max_usec %"PRIu64"\n", o, p, r->lat_max);
+        }
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-f path] [-i interval-ms [-c count]]\n", prog);
+    fprintf(stderr, "  -f  stats page (default %s)\n", HH_STATS_SHM_DFLT_PATH);
+    fprintf(stderr, "  -i  print every interval-ms, with rates (default: print once)\n");
+    fprintf(stderr, "  -c  number of prints (default: until interrupted)\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = HH_STATS_SHM_DFLT_PATH;
+    unsigned long interval_ms = 0, count = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:i:c:h")) != -1) {
+        switch (opt) {
+            case 'f':
+                path = optarg;
+                break;
+            case 'i':
+                interval_ms = strtoul(optarg, NULL, 10);
+                break;
+            case 'c':
+                count = strtoul(optarg, NULL, 10);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    struct page_map map = {0};
+    if (map_page(path, &map, false) != 0)
+        return 1;
+
+    static struct hh_stats_shm cur, prev;
+    bool have_prev = false;
+    uint64_t last_ts = 0, t_update = now_usec();
+    for (unsigned long n = 0; !count || n < count; n++) {
+        /* map the page again if it was replaced, or it has not been updated for too long */
+        if (!map.page || page_replaced(path, &map) || now_usec() - t_update >= STALL_USEC) {
+            bool was_mapped = map.page != NULL;
+            if (map_page(path, &map, !was_mapped) == 0) {
+                t_update = now_usec();
+                last_ts = 0;
+            } else if (was_mapped) {
+                fprintf(stderr, "Waiting for '%s'...\n", path);
+            }
+        }
+
+        if (!map.page) {
+            /* no page: zebra is not running */
+        } else if (hh_stats_shm_read(map.page, &cur) != 0) {
+            fprintf(stderr, "Stats page busy, skipping\n");
+        } else {
+            if (cur.ts_usec != last_ts) {
+                last_ts = cur.ts_usec;
+                t_update = now_usec();
+            }
+            print_page(&cur, have_prev ? &prev : NULL);
+            prev = cur;
+            have_prev = true;
+        }
+        if (!interval_ms)
+            break;
+
+        struct timespec ts = { .tv_sec = interval_ms / 1000, .tv_nsec = (interval_ms % 1000) * 1000000L };
+        nanosleep(&ts, NULL);
+    }
+    unmap_page(&map);
+    return 0;
+}
@@ -2,28 +2,228 @@
 
 #include "config.h" /* FRR's */
 #include <lib/command.h>
+#include <lib/memory.h> /* MTYPE_TMP */
 
 #include "hh_dp_vty_common.h"
 
 extern int vtysh_client_execute_name(const char *name, const char *line);
 extern int show_one_daemon(struct vty *vty, struct cmd_token **argv, int argc, const char *name);
 
+/* pass a command with arguments to zebra */
+static int vtysh_hh_passthrough(int argc, struct cmd_token **argv)
+{
+    char *line = argv_concat(argv, argc, 0);
+    int r = vtysh_client_execute_name("zebra", line);
+    XFREE(MTYPE_TMP, line);
+    return r;
+}
+
 DEFUN (vtysh_show_hedgehog_plugin_version,
        vtysh_show_hedgehog_plugin_version_cmd,
        HH_CMD_SHOW_PLUGIN_VERSION,
-       SHOW_STR HH_STR HH_DP_PLUGIN "version\n")
+       SHOW_STR HH_STR HH_DP_PLUGIN "version\n" JSON_STR)
 {
-    vtysh_client_execute_name("zebra", self->string);
-    return CMD_SUCCESS;
+    return vtysh_hh_passthrough(argc, argv);
 }
 
 DEFUN (vtysh_show_hedgehog_rpc_stats,
        vtysh_show_hedgehog_rpc_stats_cmd,
        HH_CMD_SHOW_RPC_STATS,
-       SHOW_STR HH_STR HH_DP_RPC_STR "show rpc stats\n")
+       SHOW_STR HH_STR HH_DP_RPC_STR "show rpc stats\n" JSON_STR)
+{
+    return vtysh_hh_passthrough(argc, argv);
+}
+
+DEFUN (vtysh_show_hedgehog_rpc_latency,
+       vtysh_show_hedgehog_rpc_latency_cmd,
+       HH_CMD_SHOW_RPC_LATENCY,
+       SHOW_STR HH_STR HH_DP_RPC_STR "Round-trip latency of requests\n" JSON_STR)
+{
+    return vtysh_hh_passthrough(argc, argv);
+}
+
+DEFUN (vtysh_show_hedgehog_rpc_queues,
+       vtysh_show_hedgehog_rpc_queues_cmd,
+       HH_CMD_SHOW_RPC_QUEUES,
+       SHOW_STR HH_STR HH_DP_RPC_STR "Depth and age of message queues\n" JSON_STR)
+{
+    return vtysh_hh_passthrough(argc, argv);
+}
+
+DEFUN (vtysh_show_hedgehog_rpc_trace,
+       vtysh_show_hedgehog_rpc_trace_cmd,
+       HH_CMD_SHOW_RPC_TRACE,
+       SHOW_STR HH_STR HH_DP_RPC_STR HH_DP_TRACE_HELP JSON_STR)
+{
+    return vtysh_hh_passthrough(argc, argv);
+}
+
+DEFUN (vtysh_show_hedgehog_convergence,
+       vtysh_show_hedgehog_convergence_cmd,
+       HH_CMD_SHOW_CONVERGENCE,
+       SHOW_STR HH_STR HH_DP_CONVERGENCE_STR JSON_STR)
+{
+    return vtysh_hh_passthrough(argc, argv);
+}
+
+DEFUN (vtysh_show_hedgehog_cpu,
+       vtysh_show_hedgehog_cpu_cmd,
+       HH_CMD_SHOW_CPU,
+       SHOW_STR HH_STR HH_DP_CPU_STR JSON_STR)
+{
+    return vtysh_hh_passthrough(argc, argv);
+}
+
+DEFUN (vtysh_hedgehog_cpu_accounting,
+       vtysh_hedgehog_cpu_accounting_cmd,
+       HH_CMD_CPU_ACCOUNTING,
+       NO_STR HH_STR HH_DP_CPU_STR)
+{
+    return vtysh_hh_passthrough(argc, argv);
+}
+
+DEFUN (vtysh_clear_hedgehog_cpu,
+       vtysh_clear_hedgehog_cpu_cmd,
+       HH_CMD_CLEAR_CPU,
+       CLEAR_STR HH_STR HH_DP_CPU_STR)
+{
+    return vtysh_hh_passthrough(argc, argv);
+}
+
+DEFUN (vtysh_show_hedgehog_state,
+       vtysh_show_hedgehog_state_cmd,
+       HH_CMD_SHOW_STATE,
+       SHOW_STR HH_STR HH_DP_STATE_STR JSON_STR)
+{
+    return vtysh_hh_passthrough(argc, argv);
+}
+
+DEFUN (vtysh_show_hedgehog_bulk,
+       vtysh_show_hedgehog_bulk_cmd,
+       HH_CMD_SHOW_BULK,
+       SHOW_STR HH_STR HH_DP_BULK_STR JSON_STR)
+{
+    return vtysh_hh_passthrough(argc, argv);
+}
+
+DEFUN (vtysh_show_hedgehog_filter,
+       vtysh_show_hedgehog_filter_cmd,
+       HH_CMD_SHOW_FILTER,
+       SHOW_STR HH_STR HH_DP_FILTER_STR JSON_STR)
+{
+    return vtysh_hh_passthrough(argc, argv);
+}
+
+DEFUN (vtysh_hedgehog_filter, vtysh_hedgehog_filter_cmd,
+       HH_CMD_FILTER,
+       HH_STR HH_DP_FILTER_STR "Sequence number\n" "Send matching routes\n" "Do not send matching routes\n"
+       HH_RULE_MATCH_HELP)
+{
+    return vtysh_hh_passthrough(argc, argv);
+}
+
+DEFUN (vtysh_no_hedgehog_filter, vtysh_no_hedgehog_filter_cmd,
+       HH_CMD_NO_FILTER,
+       NO_STR HH_STR HH_DP_FILTER_STR "Sequence number\n")
+{
+    return vtysh_hh_passthrough(argc, argv);
+}
+
+DEFUN (vtysh_clear_hedgehog_filter, vtysh_clear_hedgehog_filter_cmd,
+       HH_CMD_CLEAR_FILTER,
+       CLEAR_STR HH_STR HH_DP_FILTER_STR "Hit counters\n")
+{
+    return vtysh_hh_passthrough(argc, argv);
+}
+
+DEFUN (vtysh_show_hedgehog_kernel,
+       vtysh_show_hedgehog_kernel_cmd,
+       HH_CMD_SHOW_KERNEL,
+       SHOW_STR HH_STR HH_DP_KERNEL_STR JSON_STR)
+{
+    return vtysh_hh_passthrough(argc, argv);
+}
+
+DEFUN (vtysh_hedgehog_kernel, vtysh_hedgehog_kernel_cmd,
+       HH_CMD_KERNEL,
+       HH_STR HH_DP_KERNEL_STR "Sequence number\n" "Install matching routes in the kernel\n"
+       "Do not install matching routes in the kernel\n"
+       HH_RULE_MATCH_HELP)
+{
+    return vtysh_hh_passthrough(argc, argv);
+}
+
+DEFUN (vtysh_no_hedgehog_kernel, vtysh_no_hedgehog_kernel_cmd,
+       HH_CMD_NO_KERNEL,
+       NO_STR HH_STR HH_DP_KERNEL_STR "Sequence number\n")
+{
+    return vtysh_hh_passthrough(argc, argv);
+}
+
+DEFUN (vtysh_clear_hedgehog_kernel, vtysh_clear_hedgehog_kernel_cmd,
+       HH_CMD_CLEAR_KERNEL,
+       CLEAR_STR HH_STR HH_DP_KERNEL_STR "Hit counters\n")
+{
+    return vtysh_hh_passthrough(argc, argv);
+}
+
+DEFUN (vtysh_show_hedgehog_budgets,
+       vtysh_show_hedgehog_budgets_cmd,
+       HH_CMD_SHOW_BUDGETS,
+       SHOW_STR HH_STR HH_DP_BUDGET_STR JSON_STR)
+{
+    return vtysh_hh_passthrough(argc, argv);
+}
+
+DEFUN (vtysh_hedgehog_budget, vtysh_hedgehog_budget_cmd,
+       HH_CMD_BUDGET,
+       HH_STR HH_DP_BUDGET_STR HH_DP_BUDGET_HELP)
+{
+    return vtysh_hh_passthrough(argc, argv);
+}
+
+DEFUN (vtysh_hedgehog_cumulative_ack, vtysh_hedgehog_cumulative_ack_cmd,
+       HH_CMD_CUMULATIVE_ACK,
+       NO_STR HH_STR "RPC\n" "Complete requests acknowledged by a later response\n")
+{
+    return vtysh_hh_passthrough(argc, argv);
+}
+
+DEFUN (vtysh_hedgehog_coalesce, vtysh_hedgehog_coalesce_cmd,
+       HH_CMD_COALESCE,
+       HH_STR "RPC\n" HH_DP_COALESCE_HELP)
+{
+    return vtysh_hh_passthrough(argc, argv);
+}
+
+DEFUN (vtysh_show_hedgehog_audit,
+       vtysh_show_hedgehog_audit_cmd,
+       HH_CMD_SHOW_AUDIT,
+       SHOW_STR HH_STR HH_DP_AUDIT_STR JSON_STR)
+{
+    return vtysh_hh_passthrough(argc, argv);
+}
+
+DEFUN (vtysh_hedgehog_audit, vtysh_hedgehog_audit_cmd,
+       HH_CMD_AUDIT,
+       HH_STR HH_DP_AUDIT_STR HH_DP_AUDIT_HELP)
+{
+    return vtysh_hh_passthrough(argc, argv);
+}
+
+DEFUN (vtysh_show_hedgehog_standby,
+       vtysh_show_hedgehog_standby_cmd,
+       HH_CMD_SHOW_STANDBY,
+       SHOW_STR HH_STR HH_DP_STANDBY_STR JSON_STR)
+{
+    return vtysh_hh_passthrough(argc, argv);
+}
+
+DEFUN (vtysh_hedgehog_failover, vtysh_hedgehog_failover_cmd,
+       HH_CMD_FAILOVER,
+       HH_STR "Dataplane\n" "Fail over to the standby dataplane\n")
 {
-    vtysh_client_execute_name("zebra", self->string);
-    return CMD_SUCCESS;
+    return vtysh_hh_passthrough(argc, argv);
 }
 
 DEFUN (vtysh_debug_hh_rpc_msg, vtysh_debug_hh_rpc_msg_cmd,
@@ -36,7 +236,32 @@ DEFUN (vtysh_debug_hh_rpc_msg, vtysh_debug_hh_rpc_msg_cmd,
 int vtysh_extension(void)
 {
     install_element(VIEW_NODE, &vtysh_show_hedgehog_rpc_stats_cmd);
+    install_element(VIEW_NODE, &vtysh_show_hedgehog_rpc_latency_cmd);
+    install_element(VIEW_NODE, &vtysh_show_hedgehog_rpc_queues_cmd);
+    install_element(VIEW_NODE, &vtysh_show_hedgehog_rpc_trace_cmd);
+    install_element(VIEW_NODE, &vtysh_show_hedgehog_convergence_cmd);
+    install_element(VIEW_NODE, &vtysh_show_hedgehog_cpu_cmd);
+    install_element(CONFIG_NODE, &vtysh_hedgehog_cpu_accounting_cmd);
+    install_element(ENABLE_NODE, &vtysh_clear_hedgehog_cpu_cmd);
     install_element(VIEW_NODE, &vtysh_show_hedgehog_plugin_version_cmd);
+    install_element(VIEW_NODE, &vtysh_show_hedgehog_state_cmd);
+    install_element(VIEW_NODE, &vtysh_show_hedgehog_bulk_cmd);
+    install_element(VIEW_NODE, &vtysh_show_hedgehog_filter_cmd);
+    install_element(CONFIG_NODE, &vtysh_hedgehog_filter_cmd);
+    install_element(CONFIG_NODE, &vtysh_no_hedgehog_filter_cmd);
+    install_element(ENABLE_NODE, &vtysh_clear_hedgehog_filter_cmd);
+    install_element(VIEW_NODE, &vtysh_show_hedgehog_kernel_cmd);
+    install_element(CONFIG_NODE, &vtysh_hedgehog_kernel_cmd);
+    install_element(CONFIG_NODE, &vtysh_no_hedgehog_kernel_cmd);
+    install_element(ENABLE_NODE, &vtysh_clear_hedgehog_kernel_cmd);
+    install_element(VIEW_NODE, &vtysh_show_hedgehog_budgets_cmd);
+    install_element(CONFIG_NODE, &vtysh_hedgehog_budget_cmd);
+    install_element(CONFIG_NODE, &vtysh_hedgehog_cumulative_ack_cmd);
+    install_element(CONFIG_NODE, &vtysh_hedgehog_coalesce_cmd);
+    install_element(VIEW_NODE, &vtysh_show_hedgehog_audit_cmd);
+    install_element(CONFIG_NODE, &vtysh_hedgehog_audit_cmd);
+    install_element(VIEW_NODE, &vtysh_show_hedgehog_standby_cmd);
+    install_element(ENABLE_NODE, &vtysh_hedgehog_failover_cmd);
     install_element(ENABLE_NODE, &vtysh_debug_hh_rpc_msg_cmd);
     return 0;
 }